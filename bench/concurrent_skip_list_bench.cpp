@@ -0,0 +1,96 @@
+#include "ConcurrentSkipList.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using namespace kvaaas;
+
+using Clock = std::chrono::steady_clock;
+
+// what writers would share without the lock-free list
+struct LockedMap {
+  void put(const KeyType &key, std::uint64_t offset) {
+    std::lock_guard lock(mutex);
+    map[key] = IndexEntry{offset};
+  }
+  std::optional<std::uint64_t> find(const KeyType &key) {
+    std::lock_guard lock(mutex);
+    auto it = map.find(key);
+    if (it == map.end()) {
+      return std::nullopt;
+    }
+    return it->second.offset;
+  }
+
+  std::mutex mutex;
+  std::map<KeyType, IndexEntry> map;
+};
+
+std::vector<KeyType> gen_keys(std::size_t n) {
+  std::mt19937_64 rnd(n);
+  std::vector<KeyType> keys(n);
+  for (auto &key : keys) {
+    for (auto &b : key) {
+      b = std::byte(rnd() & 0xFF);
+    }
+  }
+  return keys;
+}
+
+// Every thread puts its share of the keys, then looks all of its keys up.
+template <typename L>
+void run(const char *name, const std::vector<KeyType> &keys,
+         std::size_t threads) {
+  L list;
+  std::size_t share = keys.size() / threads;
+  auto in_parallel = [&](auto work) {
+    std::vector<std::thread> workers;
+    auto begin = Clock::now();
+    for (std::size_t t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t] {
+        for (std::size_t i = t * share; i < (t + 1) * share; ++i) {
+          work(i);
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+  };
+  double put = in_parallel([&](std::size_t i) { list.put(keys[i], i); });
+  std::atomic<std::uint64_t> found{0};
+  double get = in_parallel([&](std::size_t i) {
+    if (list.find(keys[i])) {
+      found.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  double ops = static_cast<double>(share * threads);
+  std::cout << name << " threads=" << threads
+            << " put=" << ops / put / 1e6 << "M/s get=" << ops / get / 1e6
+            << "M/s (found " << found << ")" << std::endl;
+}
+} // namespace
+
+// usage: %program% [THREADS...], defaults to 1, 2, 4 and 8 threads
+// putting 1M keys between them
+int main(int argc, const char **argv) {
+  std::vector<std::size_t> thread_counts;
+  for (int i = 1; i < argc; ++i) {
+    thread_counts.push_back(std::stoul(argv[i]));
+  }
+  if (thread_counts.empty()) {
+    thread_counts = {1, 2, 4, 8};
+  }
+  auto keys = gen_keys(1'000'000);
+  for (auto threads : thread_counts) {
+    run<LockedMap>("locked map ", keys, threads);
+    run<ConcurrentSkipList>("lock-free  ", keys, threads);
+  }
+}
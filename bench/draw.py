@@ -31,9 +31,11 @@ def print_plots_from_file(file):
         for_draw.pop("already_in", None)
         for_draw.pop("read_percent", None)
         for_draw.pop("total_queries", None)
+        for_draw.pop("manager", None)
         df = pd.DataFrame(for_draw, index=[0])
         print_plots(df, "already_in = " + str(data_map["already_in"]) + " keys\nread_percent = " + str(data_map["read_percent"]) 
-        + "%\ntotal_queries = " + str(data_map["total_queries"]), file)
+        + "%\ntotal_queries = " + str(data_map["total_queries"])
+        + "\nmanager = " + str(data_map.get("manager", "file")), file)
 for file in sys.argv[1:]:
     print("file = " + file)
     print_plots_from_file(file)
@@ -0,0 +1,98 @@
+#include "Log.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+namespace {
+using namespace kvaaas;
+
+using Clock = std::chrono::steady_clock;
+
+// the node-based Log the flat table replaced
+struct MapLog {
+  std::size_t size() const noexcept { return map.size(); }
+  void add(const KeyType &key, std::uint64_t offset) {
+    map[key] = IndexEntry{offset};
+  }
+  std::optional<IndexEntry> get_entry(const KeyType &key) {
+    auto it = map.find(key);
+    if (it == map.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+  void clear() { map.clear(); }
+  auto begin() { return map.begin(); }
+  auto end() { return map.end(); }
+
+  std::unordered_map<KeyType, IndexEntry> map;
+};
+
+std::vector<KeyType> gen_keys(std::size_t n, std::mt19937_64 &rnd) {
+  std::vector<KeyType> keys(n);
+  for (auto &key : keys) {
+    for (auto &b : key) {
+      b = std::byte(rnd() & 0xFF);
+    }
+  }
+  return keys;
+}
+
+// One Shard cycle per round: fill the log to size, look up every key and
+// as many missing ones, walk it like push_to_skip_list, clear it.
+template <typename L> void run(const char *name, std::size_t size) {
+  constexpr std::size_t ROUNDS = 200;
+  std::mt19937_64 rnd(size);
+  L log;
+  std::chrono::nanoseconds add{0}, get{0}, scan{0}, clear{0};
+  std::uint64_t checksum = 0;
+  for (std::size_t round = 0; round < ROUNDS; ++round) {
+    auto keys = gen_keys(size, rnd);
+    auto missing = gen_keys(size, rnd);
+    auto t0 = Clock::now();
+    for (std::size_t i = 0; i < size; ++i) {
+      log.add(keys[i], i);
+    }
+    auto t1 = Clock::now();
+    for (std::size_t i = 0; i < size; ++i) {
+      checksum += log.get_entry(keys[i])->offset;
+      checksum += log.get_entry(missing[i]).has_value();
+    }
+    auto t2 = Clock::now();
+    for (const auto &entry : log) {
+      checksum += entry.second.offset;
+    }
+    auto t3 = Clock::now();
+    log.clear();
+    auto t4 = Clock::now();
+    add += t1 - t0;
+    get += t2 - t1;
+    scan += t3 - t2;
+    clear += t4 - t3;
+  }
+  double ops = static_cast<double>(ROUNDS * size);
+  std::cout << name << " size=" << size
+            << " add=" << static_cast<double>(add.count()) / ops
+            << "ns get=" << static_cast<double>(get.count()) / (2 * ops)
+            << "ns scan=" << static_cast<double>(scan.count()) / ops
+            << "ns clear=" << static_cast<double>(clear.count()) / ROUNDS
+            << "ns/round (checksum " << checksum << ")" << std::endl;
+}
+} // namespace
+
+// usage: %program% [LOG_MAX_SIZE...], defaults to 1000 (DefaultOnDisk),
+// 10000 and 100000
+int main(int argc, const char **argv) {
+  std::vector<std::size_t> sizes;
+  for (int i = 1; i < argc; ++i) {
+    sizes.push_back(std::stoul(argv[i]));
+  }
+  if (sizes.empty()) {
+    sizes = {1000, 10000, 100000};
+  }
+  for (auto size : sizes) {
+    run<MapLog>("unordered_map", size);
+    run<Log>("flat         ", size);
+  }
+}
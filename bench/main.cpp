@@ -47,7 +47,7 @@ struct stat {
 };
 
 stat collect_stat(const unsigned already, const unsigned total,
-                  const unsigned read_percent) {
+                  const unsigned read_percent, const KvaaasOption &opt) {
   // Write "already in" recordings
   std::set<KeyType> keys_already_in;
   while (keys_already_in.size() < already) {
@@ -55,7 +55,7 @@ stat collect_stat(const unsigned already, const unsigned total,
   }
 
   std::filesystem::create_directory("abobus");
-  Kvaaas kvs("abobus", DefaultOnDisk);
+  Kvaaas kvs("abobus", opt);
 
   for (const auto &key : keys_already_in) {
     kvs.add(key, gen_value());
@@ -95,10 +95,12 @@ stat collect_stat(const unsigned already, const unsigned total,
 
 } // namespace
 
-// usage: %program% ALREADY_IN TOTAL_QUERIES READ_PERCENT OUTPUT_FILE
+// usage: %program% ALREADY_IN TOTAL_QUERIES READ_PERCENT OUTPUT_FILE [MANAGER]
+// MANAGER is "file" (default) or "mmap"
 int main(const int argc, const char **argv) {
   if (argc < 5) {
-    std::cout << "Usage: %program% ALREADY_IN TOTAL_QUERIES READ_PERCENT"
+    std::cout << "Usage: %program% ALREADY_IN TOTAL_QUERIES READ_PERCENT "
+                 "OUTPUT_FILE [file|mmap]"
               << std::endl;
     return 1;
   }
@@ -119,13 +121,22 @@ int main(const int argc, const char **argv) {
     return t;
   }();
 
-  auto stat = collect_stat(ALREADY_IN, TOTAL_QUERIES, READ_PERCENT);
+  const std::string MANAGER = argc > 5 ? argv[5] : "file";
+  if (MANAGER != "file" && MANAGER != "mmap") {
+    std::cout << "Unknown manager: " << MANAGER << std::endl;
+    return 1;
+  }
+
+  auto stat = collect_stat(ALREADY_IN, TOTAL_QUERIES, READ_PERCENT,
+                           MANAGER == "mmap" ? DefaultMmapOnDisk
+                                             : DefaultOnDisk);
 
   std::ofstream out(argv[4]);
   nlohmann::json json;
   json["already_in"] = ALREADY_IN;
   json["total_queries"] = TOTAL_QUERIES;
   json["read_percent"] = READ_PERCENT;
+  json["manager"] = MANAGER;
   json["avg_per_request"] = stat.time_per_request.count();
   json["avg_per_write"] = stat.time_per_write.count();
   json["max_per_write"] = stat.max_per_write.count();
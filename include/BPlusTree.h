@@ -0,0 +1,150 @@
+#pragma once
+#include "ByteArray.h"
+#include "Core.h"
+#include "SST.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace kvaaas {
+
+// On-disk B+-tree over fixed PAGE_SIZE pages of one byte array, an
+// alternative to SkipList with the same interface. Page 0 holds the root
+// and the entry count, page 1 is the leftmost leaf. Leaves keep sorted
+// (key, offset, inline slot) records and a link to the next leaf. Inner
+// pages store the prefix shared by all of their separator keys once and
+// only the rest of every key, which raises the fanout to about 170-250,
+// so a lookup reads one page per level. Split pages are appended, an
+// insert rewrites its leaf and the inner pages on the split path in place,
+// and page 0 once per put or push_from batch.
+class BPlusTree {
+public:
+  static constexpr std::size_t PAGE_SIZE = 4096;
+
+  // pages is not owned, an empty array gets an empty tree
+  explicit BPlusTree(ByteArrayPtr pages, std::size_t inline_capacity = 0);
+
+  void put(const KeyType &key, std::uint64_t offset);
+  void put(const KeyType &key, const IndexEntry &entry);
+  std::optional<std::uint64_t> find(const KeyType &key);
+  std::optional<IndexEntry> find_entry(const KeyType &key);
+  bool has_key(const KeyType &key) { return find_entry(key).has_value(); }
+
+  template <typename It> void push_from(It begin, It end) {
+    for (It it = begin; it != end; ++it) {
+      insert(it->first, it->second);
+    }
+    store_meta();
+  }
+
+  class iterator {
+  public:
+    using value_type = SSTRecord;
+
+    const value_type operator*();
+
+    iterator &operator++();
+
+    iterator operator++(int) {
+      iterator iterator = *this;
+      ++(*this);
+      return iterator;
+    }
+
+    bool operator==(const iterator &oth) const {
+      return owner == oth.owner && leaf == oth.leaf && index == oth.index;
+    }
+
+    bool operator!=(const iterator &oth) const { return !(*this == oth); }
+
+  private:
+    iterator(BPlusTree *owner_, std::uint64_t leaf_);
+    // the first record of leaf or later, end() past the last leaf
+    void enter_leaf(std::uint64_t leaf_);
+    friend BPlusTree;
+
+    BPlusTree *owner = nullptr;
+    std::uint64_t leaf = NULL_PAGE;
+    std::uint64_t index = 0;
+    // of the current leaf
+    std::uint64_t count = 0;
+    std::uint64_t next = NULL_PAGE;
+  };
+
+  iterator begin() { return {this, FIRST_LEAF}; }
+
+  iterator end() { return {this, NULL_PAGE}; }
+
+  std::uint64_t size() const { return entries; }
+
+  // pages from the root to a leaf
+  std::uint64_t height() const { return depth; }
+
+private:
+  using Page = std::array<ByteType, PAGE_SIZE>;
+
+  static constexpr std::uint64_t NULL_PAGE = ~std::uint64_t{0};
+  static constexpr std::uint64_t META_PAGE = 0;
+  static constexpr std::uint64_t FIRST_LEAF = 1;
+
+  // page header: type (1), inner prefix length (1), count (2), padding (4),
+  // then the next leaf or the inner prefix
+  static constexpr std::size_t TYPE_POS = 0;
+  static constexpr std::size_t PREFIX_LEN_POS = 1;
+  static constexpr std::size_t COUNT_POS = 2;
+  static constexpr std::size_t NEXT_POS = 8;
+  static constexpr std::size_t LEAF_HEADER = NEXT_POS + sizeof(std::uint64_t);
+  static constexpr std::size_t PREFIX_POS = 8;
+  static constexpr std::size_t INNER_HEADER = PREFIX_POS + KEY_SIZE_BYTES;
+  static constexpr std::uint8_t LEAF = 0;
+  static constexpr std::uint8_t INNER = 1;
+
+  // an inner page decoded into full keys, keys[i] separates children i
+  // and i + 1
+  struct Inner {
+    std::vector<KeyType> keys;
+    std::vector<std::uint64_t> children;
+  };
+
+  void read_page(std::uint64_t page, Page &buf);
+  void write_page(std::uint64_t page, const Page &buf);
+  std::uint64_t append_page(const Page &buf);
+  void store_meta();
+  // put without storing the meta page
+  void insert(const KeyType &key, std::uint64_t offset) {
+    insert(key, IndexEntry{offset});
+  }
+  void insert(const KeyType &key, const IndexEntry &entry);
+
+  // the child of an inner page to look for key in
+  static std::uint64_t child_for(const ByteType *page, const KeyType &key);
+  static Inner decode_inner(const ByteType *page);
+  // false if the keys do not fit into one page
+  static bool encode_inner(const Inner &inner, Page &buf);
+
+  // first record of a leaf not below key
+  std::size_t lower_bound(const ByteType *leaf, const KeyType &key) const;
+  const ByteType *record_at(const ByteType *leaf, std::size_t i) const {
+    return leaf + LEAF_HEADER + i * record_size;
+  }
+  void store_record(ByteType *rec, const KeyType &key,
+                    const IndexEntry &entry) const;
+  SSTRecord load_record(const ByteType *rec) const;
+
+  // adds separator and the page right of it to the inner page at
+  // path[level], splitting it and going up as needed
+  void insert_into_parent(std::vector<std::uint64_t> &path, std::size_t level,
+                          const KeyType &separator, std::uint64_t right);
+
+  ByteArrayPtr pages;
+  std::size_t inline_capacity;
+  std::size_t record_size;
+  // records per leaf
+  std::size_t leaf_capacity;
+  std::uint64_t root = FIRST_LEAF;
+  std::uint64_t entries = 0;
+  std::uint64_t depth = 1;
+};
+
+} // namespace kvaaas
@@ -0,0 +1,97 @@
+#pragma once
+#include "Core.h"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kvaaas {
+
+// pread until n bytes are read, throws std::system_error mentioning `file`
+void pread_all(int fd, ByteType *ptr, std::size_t n, std::size_t offset,
+               const std::string &file);
+
+struct PositionalRead {
+  int fd;
+  std::size_t offset;
+  std::size_t n;
+  ByteType *dst;
+};
+
+// Keeps a batch of preads in flight at once. read() returns when every
+// request has been filled, I/O errors are thrown as std::system_error.
+class BatchReader {
+public:
+  virtual void read(const std::vector<PositionalRead> &reads) = 0;
+
+  virtual ~BatchReader() = default;
+
+  // io_uring ring of the calling thread, or the shared thread pool when
+  // the kernel refuses io_uring (old kernel, seccomp, ...)
+  static BatchReader &local();
+};
+
+class IoUringReader final : public BatchReader {
+public:
+  static constexpr unsigned ENTRIES = 64;
+
+  // nullptr if io_uring is not available
+  static std::unique_ptr<IoUringReader> try_create();
+
+  IoUringReader(const IoUringReader &) = delete;
+  IoUringReader &operator=(const IoUringReader &) = delete;
+
+  void read(const std::vector<PositionalRead> &reads) override;
+
+  ~IoUringReader() override;
+
+private:
+  IoUringReader() = default;
+
+  bool setup();
+  void submit_and_wait(const PositionalRead *reads, unsigned n);
+
+  int ring_fd = -1;
+  void *sq_ring = nullptr;
+  std::size_t sq_ring_size = 0;
+  void *cq_ring = nullptr;
+  std::size_t cq_ring_size = 0;
+  void *sqes = nullptr;
+  std::size_t sqes_size = 0;
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  void *cqes = nullptr;
+};
+
+class ThreadPoolReader final : public BatchReader {
+public:
+  explicit ThreadPoolReader(std::size_t threads = 4);
+
+  ThreadPoolReader(const ThreadPoolReader &) = delete;
+  ThreadPoolReader &operator=(const ThreadPoolReader &) = delete;
+
+  void read(const std::vector<PositionalRead> &reads) override;
+
+  ~ThreadPoolReader() override;
+
+  static ThreadPoolReader &shared();
+
+private:
+  void work();
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::queue<std::function<void()>> tasks;
+  bool stopped = false;
+};
+
+} // namespace kvaaas
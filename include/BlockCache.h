@@ -0,0 +1,147 @@
+#pragma once
+#include "ByteArray.h"
+#include "MemoryManager.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace kvaaas {
+
+// User-space cache of fixed-size aligned file blocks shared by several
+// CachedByteArrays. Split into independently locked shards, each evicting
+// with CLOCK, and bounded by a byte budget.
+class BlockCache {
+public:
+  static constexpr std::size_t BLOCK_SIZE = 4096;
+  static constexpr std::size_t SHARDS = 16;
+
+  struct alignas(BLOCK_SIZE) Block {
+    std::array<ByteType, BLOCK_SIZE> bytes;
+  };
+
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+  };
+
+  explicit BlockCache(std::size_t budget_bytes);
+
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  // every array using the cache gets its own id
+  std::uint64_t register_array();
+
+  // copies [from, from + n) of the block into dst if it is cached
+  bool read(std::uint64_t array_id, std::uint64_t block, std::size_t from,
+            std::size_t n, ByteType *dst, MemoryPurpose purpose);
+
+  void insert(std::uint64_t array_id, std::uint64_t block,
+              std::unique_ptr<Block> data);
+
+  // patches a cached block after a write-through rewrite
+  void update(std::uint64_t array_id, std::uint64_t block, std::size_t from,
+              const ByteType *bytes, std::size_t n);
+
+  // forgets every block of the array
+  void drop(std::uint64_t array_id);
+
+  Stats stats(MemoryPurpose purpose) const;
+
+  [[nodiscard]] std::size_t budget() const noexcept { return budget_bytes; }
+
+private:
+  struct BlockKey {
+    std::uint64_t array_id;
+    std::uint64_t block;
+    bool operator==(const BlockKey &oth) const {
+      return array_id == oth.array_id && block == oth.block;
+    }
+  };
+
+  struct BlockKeyHash {
+    std::size_t operator()(const BlockKey &key) const {
+      return std::hash<std::uint64_t>()(key.array_id * 0x9E3779B97F4A7C15ULL ^
+                                        key.block);
+    }
+  };
+
+  struct Slot {
+    BlockKey key;
+    std::unique_ptr<Block> data;
+    bool referenced = false;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    std::unordered_map<BlockKey, std::size_t, BlockKeyHash> index;
+    std::size_t hand = 0;
+  };
+
+  Shard &shard_for(const BlockKey &key) {
+    return shards[BlockKeyHash()(key) % SHARDS];
+  }
+
+  const std::size_t budget_bytes;
+  const std::size_t blocks_per_shard;
+  std::array<Shard, SHARDS> shards;
+  std::atomic<std::uint64_t> next_array_id{0};
+  std::array<std::atomic<std::uint64_t>, MemoryPurpose::END> hits{};
+  std::array<std::atomic<std::uint64_t>, MemoryPurpose::END> misses{};
+};
+
+// Decorates a file-backed array with a BlockCache. Only blocks lying
+// completely below size() are cached, so appends never touch cached data,
+// rewrites are written through and patched into the cache. Views of cached
+// blocks are copies, since eviction may free a block under a borrowed
+// view, views of the growing tail come from the inner array.
+class CachedByteArray final : public FileBackedByteArray {
+public:
+  CachedByteArray(FileBackedByteArrayPtr inner, std::shared_ptr<BlockCache> cache,
+                  MemoryPurpose purpose);
+  CachedByteArray(const CachedByteArray &) = delete;
+  CachedByteArray &operator=(const CachedByteArray &) = delete;
+
+  void append(const std::vector<ByteType> &bytes) override;
+
+  std::vector<ByteType> read(std::size_t l,
+                             std::size_t r) override; //[l, r) -- semi-interval
+
+  void rewrite(std::size_t begin, const std::vector<ByteType> &bytes) override;
+
+  void append(const ByteType *bytes, std::size_t n) override;
+
+  ByteType *read_ptr(ByteType *ptr, std::size_t l, std::size_t r) override;
+
+  void rewrite(std::size_t begin, const ByteType *bytes,
+               std::size_t n) override;
+
+  ByteView view(std::size_t l, std::size_t r) override;
+
+  // misses of all requests are read by one batch of the inner array
+  void read_batch(const std::vector<ReadRequest> &requests) override;
+
+  std::size_t size() override;
+
+  void flush() override;
+
+  void sync() override;
+
+  ~CachedByteArray() override;
+
+  std::string file_name() const noexcept override {
+    return inner->file_name();
+  }
+
+private:
+  std::unique_ptr<FileBackedByteArray> inner;
+  std::shared_ptr<BlockCache> cache;
+  const MemoryPurpose purpose;
+  const std::uint64_t id;
+};
+
+} // namespace kvaaas
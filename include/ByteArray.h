@@ -1,10 +1,63 @@
 #pragma once
 #include "Core.h"
+#include <array>
+#include <atomic>
 #include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace kvaaas {
 
+// Read-only window [l, r) returned by ByteArray::view. Backends that keep
+// their bytes addressable lend them directly and stay pinned (must not move
+// the storage) until the view dies, others copy into the view. Small copies
+// live inline, so decoding a record header never touches the heap.
+class ByteView {
+public:
+  static constexpr std::size_t INLINE_SIZE = 64;
+
+  ByteView() = default;
+  ByteView(const ByteView &) = delete;
+  ByteView &operator=(const ByteView &) = delete;
+  ByteView(ByteView &&oth) noexcept;
+  ByteView &operator=(ByteView &&oth) noexcept;
+  ~ByteView();
+
+  // view over memory owned by the array, `pins` (if any) is held while
+  // the view is alive
+  static ByteView borrowed(const ByteType *ptr, std::size_t n,
+                           std::atomic<std::size_t> *pins = nullptr);
+
+  // view owning n bytes, the backend fills them through storage()
+  static ByteView copied(std::size_t n);
+
+  ByteType *storage() noexcept { return const_cast<ByteType *>(ptr); }
+
+  [[nodiscard]] const ByteType *data() const noexcept { return ptr; }
+  [[nodiscard]] std::size_t size() const noexcept { return len; }
+  const ByteType &operator[](std::size_t i) const noexcept { return ptr[i]; }
+  [[nodiscard]] const ByteType *begin() const noexcept { return ptr; }
+  [[nodiscard]] const ByteType *end() const noexcept { return ptr + len; }
+
+private:
+  void steal(ByteView &oth) noexcept;
+
+  const ByteType *ptr = nullptr;
+  std::size_t len = 0;
+  std::atomic<std::size_t> *pins = nullptr;
+  std::array<ByteType, INLINE_SIZE> inline_buf{};
+  std::vector<ByteType> heap_buf;
+};
+
+// [l, r) into dst, see ByteArray::read_batch
+struct ReadRequest {
+  std::size_t l;
+  std::size_t r;
+  ByteType *dst;
+};
+
 class ByteArray {
 public:
   virtual void append(const std::vector<ByteType> &bytes) = 0;
@@ -24,14 +77,46 @@ public:
   virtual void rewrite(std::size_t begin, const ByteType *bytes,
                        std::size_t n) = 0;
 
+  //[l, r) without copying where the backend allows it, see ByteView
+  virtual ByteView view(std::size_t l, std::size_t r);
+
+  // Fills every request, backends may keep the reads in flight together
+  virtual void read_batch(const std::vector<ReadRequest> &requests);
+
+  // Pushes buffered appends down to the backend. Reads never need it.
+  virtual void flush() {}
+
+  // flush() and make everything written so far durable
+  virtual void sync() { flush(); }
+
   virtual ~ByteArray() = default;
 };
 
+// Fixed-size chunks indexed by a vector. Appends only ever add chunks, so
+// stored bytes never move (no realloc copies, views stay valid) and reads
+// that cross chunk borders are stitched together. Chunks can optionally
+// ask for transparent huge pages.
 class RAMByteArray : public ByteArray {
 private:
-  std::vector<ByteType> byte_array;
+  template <typename F> void for_each_piece(std::size_t l, std::size_t r, F f);
+
+  void add_chunk();
+
+  std::vector<ByteType *> chunks;
+  std::size_t used = 0;
+  const std::size_t chunk_size;
+  const bool huge_pages;
 
 public:
+  static constexpr std::size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+  // x86-64 huge page, smaller chunks can not be backed by one
+  static constexpr std::size_t HUGE_PAGE_CHUNK_SIZE = 2 << 20;
+
+  explicit RAMByteArray(std::size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                        bool huge_pages = false);
+  RAMByteArray(const RAMByteArray &) = delete;
+  RAMByteArray &operator=(const RAMByteArray &) = delete;
+
   void append(const std::vector<ByteType> &bytes) override;
 
   std::vector<ByteType> read(std::size_t l, std::size_t r) override;
@@ -45,12 +130,41 @@ public:
   void rewrite(std::size_t begin, const ByteType *bytes,
                std::size_t n) override;
 
+  ByteView view(std::size_t l, std::size_t r) override;
+
   std::size_t size() override;
+
+  ~RAMByteArray() override;
 };
 
-class FileByteArray final : public ByteArray {
+struct FileArrayOptions {
+  // disk space is reserved in steps of this many bytes, 0 -- as written
+  std::size_t grow_step = 0;
+  // size known from the manifest, bytes of the file past it are dropped
+  std::optional<std::size_t> logical_size;
+};
+
+class FileBackedByteArray : public ByteArray {
+public:
+  virtual std::string file_name() const noexcept = 0;
+};
+
+// Positional I/O over raw descriptors: reads are pread, rewrites are pwrite
+// and appends go through a separate O_APPEND descriptor (Linux ignores the
+// pwrite offset on those), so there is no shared seek cursor.
+// Appends are collected in a write-combining buffer and reach the file in
+// buffer-sized writes. Reads below the flushed prefix never lock and may run
+// concurrently with each other and with a single appender, reads touching
+// the buffered tail are served from memory under a mutex.
+class FileByteArray final : public FileBackedByteArray {
 public:
-  explicit FileByteArray(const std::string &s, bool withRAII = false);
+  static constexpr std::size_t DEFAULT_APPEND_BUFFER = 1 << 16;
+
+  explicit FileByteArray(const std::string &s, bool withRAII = false,
+                         std::size_t append_buffer = DEFAULT_APPEND_BUFFER,
+                         FileArrayOptions file_opt = {});
+  FileByteArray(const FileByteArray &) = delete;
+  FileByteArray &operator=(const FileByteArray &) = delete;
 
   void append(const std::vector<ByteType> &bytes) override;
 
@@ -66,19 +180,93 @@ public:
   void rewrite(std::size_t begin, const ByteType *bytes,
                std::size_t n) override;
 
+  // reads of the flushed prefix go through BatchReader (io_uring)
+  void read_batch(const std::vector<ReadRequest> &requests) override;
+
   std::size_t size() override;
 
+  void flush() override;
+
+  void sync() override;
+
   ~FileByteArray() override;
 
-  std::string file_name() const noexcept { return underlying_file; }
+  std::string file_name() const noexcept override { return underlying_file; }
 
 private:
-  std::fstream data;
+  void flush_locked();
+  void preallocate(std::size_t end);
+
+  int fd = -1;        // pread/pwrite
+  int append_fd = -1; // O_APPEND
+  std::atomic<std::size_t> used{0};    // logical size, buffer included
+  std::atomic<std::size_t> flushed{0}; // bytes already in the file
+  std::size_t allocated = 0;           // reserved on disk, >= flushed
+  std::size_t grow_step;
+  std::mutex buffer_mutex;
+  std::vector<ByteType> buffer;
+  const std::size_t buffer_capacity;
   std::string underlying_file;
   const bool RAII; // REMOVE THIS!!!
 };
 
+// Keeps the whole file mapped into memory, so reads and rewrites are plain
+// memcpy. The mapping grows geometrically (ftruncate + mremap), the file is
+// truncated back to the logical size on destruction. After a crash the file
+// is as long as the mapping was, only FileArrayOptions::logical_size (see
+// FileMemoryManager::checkpoint) tells the data from the slack. An append
+// that has to grow the mapping throws std::runtime_error while views are
+// alive, since the mapping may move.
+class MmapByteArray final : public FileBackedByteArray {
+public:
+  explicit MmapByteArray(const std::string &s, bool withRAII = false,
+                         FileArrayOptions file_opt = {});
+  MmapByteArray(const MmapByteArray &) = delete;
+  MmapByteArray &operator=(const MmapByteArray &) = delete;
+
+  void append(const std::vector<ByteType> &bytes) override;
+
+  std::vector<ByteType> read(std::size_t l,
+                             std::size_t r) override; //[l, r) -- semi-interval
+
+  void rewrite(std::size_t begin, const std::vector<ByteType> &bytes) override;
+
+  void append(const ByteType *bytes, std::size_t n) override;
+
+  ByteType *read_ptr(ByteType *ptr, std::size_t l, std::size_t r) override;
+
+  void rewrite(std::size_t begin, const ByteType *bytes,
+               std::size_t n) override;
+
+  ByteView view(std::size_t l, std::size_t r) override;
+
+  std::size_t size() override;
+
+  void sync() override;
+
+  ~MmapByteArray() override;
+
+  std::string file_name() const noexcept override { return underlying_file; }
+
+private:
+  static constexpr std::size_t MIN_CAPACITY = 1 << 16;
+
+  void reserve(std::size_t new_capacity);
+
+  int fd = -1;
+  std::atomic<std::size_t> active_views{0};
+  ByteType *mapped = nullptr;
+  // read by checkpoints of other threads
+  std::atomic<std::size_t> used{0};
+  std::size_t capacity = 0;
+  const std::size_t grow_step;
+  std::string underlying_file;
+  const bool RAII;
+};
+
 using ByteArrayPtr = ByteArray *;
 using FileByteArrayPtr = FileByteArray *;
+using FileBackedByteArrayPtr = FileBackedByteArray *;
+using MmapByteArrayPtr = MmapByteArray *;
 
 } // namespace kvaaas
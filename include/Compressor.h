@@ -0,0 +1,256 @@
+#pragma once
+#include "Core.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace kvaaas {
+
+enum class CompressionMode {
+  None,     // every value is stored raw
+  Fixed,    // CompressionOptions::level
+  Fast,     // FAST_LEVEL
+  High,     // HIGH_LEVEL
+  Adaptive, // see AdaptivePolicy
+};
+
+struct CompressionOptions {
+  int level = 7;
+  // values shorter than this are stored raw
+  std::size_t min_size = 1000;
+  // capacity of a trained dictionary, 0 -- no dictionaries, 16 KiB suits
+  // short values of a similar shape
+  std::size_t dict_size = 0;
+  // replaces min_size once a dictionary is loaded
+  std::size_t dict_min_size = 64;
+  // KVS records are packed into frames of about this many raw bytes,
+  // 0 -- every record is compressed on its own
+  std::size_t block_size = 0;
+  CompressionMode mode = CompressionMode::Fixed;
+  // Adaptive: compression time per KiB of input it tries to stay under
+  std::chrono::nanoseconds latency_budget{10'000};
+  // longer KVS values are split into chunks of this size compressed as
+  // separate frames, so a range of the value decodes on its own,
+  // 0 -- never split
+  std::size_t chunk_size = 64 * 1024;
+};
+
+// Decides how every value is compressed. Whatever it decides, a record
+// stores whether it is compressed, and zstd frames decode regardless of
+// their level, so policies may change between writes.
+class CompressionPolicy {
+public:
+  static constexpr int FAST_LEVEL = -1;
+  static constexpr int HIGH_LEVEL = 19;
+
+  virtual ~CompressionPolicy() = default;
+
+  // zstd level for a value of n bytes, nullopt -- store it raw
+  virtual std::optional<int> choose(std::size_t n) = 0;
+
+  // compressed is n when the value did not shrink
+  virtual void observe(std::size_t /*n*/, std::size_t /*compressed*/,
+                       std::chrono::nanoseconds /*took*/) {}
+
+  static std::unique_ptr<CompressionPolicy>
+  create(const CompressionOptions &opt);
+};
+
+class FixedLevelPolicy : public CompressionPolicy {
+public:
+  // nullopt -- never compress
+  explicit FixedLevelPolicy(std::optional<int> level) : level(level) {}
+
+  std::optional<int> choose(std::size_t) override { return level; }
+
+private:
+  std::optional<int> level;
+};
+
+// Starts at max_level. Every ADJUST_EVERY values it compares the mean
+// compression time per KiB with the budget: a level down when over it, a
+// level up when under half of it. When the values stop shrinking it
+// stores them raw and only compresses every PROBE_EVERY-th to notice when
+// they become compressible again.
+class AdaptivePolicy : public CompressionPolicy {
+public:
+  static constexpr int MIN_LEVEL = -5;
+  static constexpr std::size_t ADJUST_EVERY = 64;
+  static constexpr std::size_t PROBE_EVERY = 32;
+  // mean compressed / raw above which values are considered incompressible
+  static constexpr double INCOMPRESSIBLE = 0.95;
+
+  AdaptivePolicy(int max_level, std::chrono::nanoseconds budget_per_kib);
+
+  std::optional<int> choose(std::size_t n) override;
+  void observe(std::size_t n, std::size_t compressed,
+               std::chrono::nanoseconds took) override;
+
+  [[nodiscard]] int level() const noexcept { return cur_level; }
+  [[nodiscard]] bool skipping() const noexcept {
+    return ratio > INCOMPRESSIBLE;
+  }
+
+private:
+  int max_level;
+  std::chrono::nanoseconds budget;
+  int cur_level;
+  // exponential moving average of compressed / raw, starts optimistic
+  double ratio = 0;
+  std::size_t skipped = 0;
+  std::size_t observed = 0;
+  std::chrono::nanoseconds took_total{0};
+  std::size_t bytes_total = 0;
+};
+
+// Owns a ZSTD compression and decompression context, so every record
+// does not pay for allocating and freeing them. Not thread-safe: each
+// shard keeps its own, callers without one use local().
+//
+// Frames are compressed with the latest added dictionary. Every frame
+// carries the id of its dictionary, so older dictionaries stay usable for
+// decompression until retain_only_current().
+class Compressor {
+public:
+  explicit Compressor(CompressionOptions opt = {});
+
+  Compressor(const Compressor &) = delete;
+  Compressor &operator=(const Compressor &) = delete;
+  Compressor(Compressor &&oth) noexcept;
+  Compressor &operator=(Compressor &&oth) noexcept;
+  ~Compressor();
+
+  // the calling thread's compressor with default options
+  static Compressor &local();
+
+  [[nodiscard]] bool should_compress(std::size_t size) const noexcept {
+    return size >= (dict_id != 0 ? opt.dict_min_size : opt.min_size);
+  }
+
+  // worst-case compressed size of n bytes
+  static std::size_t bound(std::size_t n);
+
+  // returns the compressed size, or 0 if the value is too short, the
+  // policy skips it or it would not shrink -- then it should be stored raw
+  std::size_t compress(ByteType *dst, std::size_t capacity,
+                       const ByteType *src, std::size_t n);
+
+  // throws std::runtime_error on a corrupted frame, one of another size or
+  // one compressed with a dictionary this compressor does not have
+  void decompress(ByteType *dst, std::size_t n, const ByteType *src,
+                  std::size_t compressed_n);
+
+  // trains a dictionary of at most dict_size bytes, empty if zstd finds
+  // the samples insufficient
+  static std::vector<ByteType> train_dictionary(
+      const std::vector<ValueType> &samples, std::size_t dict_size);
+
+  // makes dict current for compression, returns its id (0 -- rejected)
+  unsigned add_dictionary(std::vector<ByteType> dict);
+
+  // forgets every dictionary but the current one
+  void retain_only_current();
+
+  // 0 -- compressing without a dictionary
+  [[nodiscard]] unsigned dictionary_id() const noexcept { return dict_id; }
+  [[nodiscard]] const std::vector<ByteType> &dictionary() const noexcept {
+    return dict;
+  }
+
+  void set_policy(std::unique_ptr<CompressionPolicy> new_policy) {
+    policy = std::move(new_policy);
+  }
+  CompressionPolicy &compression_policy() noexcept { return *policy; }
+
+  [[nodiscard]] const CompressionOptions &options() const noexcept {
+    return opt;
+  }
+
+private:
+  void free_cdicts() noexcept;
+  void free_dictionaries() noexcept;
+  // the current dictionary digested for level
+  void *cdict_for(int level);
+
+  CompressionOptions opt;
+  std::unique_ptr<CompressionPolicy> policy;
+  void *cctx = nullptr; // ZSTD_CCtx
+  void *dctx = nullptr; // ZSTD_DCtx
+  unsigned dict_id = 0;
+  std::vector<ByteType> dict;
+  std::map<int, void *> cdicts;      // ZSTD_CDict of dict by level
+  std::map<unsigned, void *> ddicts; // ZSTD_DDict by dictionary id
+};
+
+// Uniform reservoir sample of values to train dictionaries from
+class DictionarySampler {
+public:
+  static constexpr std::size_t MAX_SAMPLES = 1024;
+  // longer values gain little from a dictionary
+  static constexpr std::size_t MAX_SAMPLE_SIZE = 16 * 1024;
+
+  void offer(const ValueType &value);
+
+  [[nodiscard]] const std::vector<ValueType> &samples() const noexcept {
+    return reservoir;
+  }
+
+  [[nodiscard]] std::size_t sampled_bytes() const noexcept;
+
+private:
+  std::vector<ValueType> reservoir;
+  std::size_t seen = 0;
+  std::mt19937_64 rnd{std::random_device{}()};
+};
+
+// A value compressed off the writer thread, empty -- store it raw
+using CompressedValue = std::vector<ByteType>;
+
+// Worker threads with a Compressor each. A writer submits values in the
+// order it appends them and waits for the results in the same order, so
+// the next values are compressed while the previous ones are written.
+class CompressionPool {
+public:
+  CompressionPool(CompressionOptions opt, std::size_t threads);
+
+  CompressionPool(const CompressionPool &) = delete;
+  CompressionPool &operator=(const CompressionPool &) = delete;
+  ~CompressionPool();
+
+  // values submitted later are compressed with dict, the writer's
+  // Compressor must have added it before it decodes them
+  void set_dictionary(std::vector<ByteType> dict);
+
+  // value must stay alive until the future is ready
+  std::future<CompressedValue> submit(const ValueType &value);
+
+private:
+  using Dictionary = std::shared_ptr<const std::vector<ByteType>>;
+
+  struct Task {
+    const ValueType *value;
+    Dictionary dict;
+    std::promise<CompressedValue> result;
+  };
+
+  void work();
+
+  CompressionOptions opt;
+  Dictionary dict;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::queue<Task> tasks;
+  bool stopped = false;
+};
+
+} // namespace kvaaas
@@ -0,0 +1,140 @@
+#pragma once
+#include "Core.h"
+#include "SST.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace kvaaas {
+
+// Bump allocator many threads may allocate from at once. Memory is only
+// released with the arena.
+class ConcurrentArena {
+public:
+  ConcurrentArena() = default;
+  ConcurrentArena(const ConcurrentArena &) = delete;
+  ConcurrentArena &operator=(const ConcurrentArena &) = delete;
+
+  // n bytes aligned to 8
+  void *allocate(std::size_t n);
+
+  std::size_t allocated_bytes() const noexcept {
+    return allocated.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+  struct Block {
+    explicit Block(std::size_t size_)
+        : data(new ByteType[size_]), size(size_) {}
+    std::unique_ptr<ByteType[]> data;
+    std::size_t size;
+    std::atomic<std::size_t> used{0};
+  };
+
+  std::atomic<Block *> current{nullptr};
+  std::atomic<std::size_t> allocated{0};
+  // taken only to add a block
+  std::mutex grow_mutex;
+  std::vector<std::unique_ptr<Block>> blocks;
+};
+
+// Skip list in RAM that any number of threads may put to and read at
+// once, readers never take a lock. Nodes are linked bottom up, each level
+// with a CAS on the link of its predecessor, so a node is in the list as
+// soon as level 0 links it. Nodes are never removed. A put of a present
+// key swaps the pointer to its entry, the old entry stays in the arena
+// until the list dies. Same interface as SkipList, nothing is persisted.
+class ConcurrentSkipList {
+public:
+  ConcurrentSkipList();
+  ConcurrentSkipList(const ConcurrentSkipList &) = delete;
+  ConcurrentSkipList &operator=(const ConcurrentSkipList &) = delete;
+
+  void put(const KeyType &key, std::uint64_t offset);
+  void put(const KeyType &key, const IndexEntry &entry);
+  std::optional<std::uint64_t> find(const KeyType &key) const;
+  std::optional<IndexEntry> find_entry(const KeyType &key) const;
+  bool has_key(const KeyType &key) const { return find(key).has_value(); }
+
+  template <typename It> void push_from(It begin, It end) {
+    for (It it = begin; it != end; ++it) {
+      put(it->first, it->second);
+    }
+  }
+
+private:
+  static constexpr int MAX_HEIGHT = 12;
+
+  struct Node {
+    KeyType key;
+    std::atomic<const IndexEntry *> entry;
+
+    // the height links follow the node in the arena
+    std::atomic<Node *> &link(int level) {
+      return reinterpret_cast<std::atomic<Node *> *>(this + 1)[level];
+    }
+  };
+
+  Node *new_node(const KeyType &key, const IndexEntry *entry, int height);
+  const IndexEntry *new_entry(const IndexEntry &entry);
+  static int random_height();
+
+  // the last node of level with a key below key, starting at from, and
+  // the node after it
+  static std::pair<Node *, Node *> find_splice(const KeyType &key, Node *from,
+                                               int level);
+
+  ConcurrentArena arena;
+  Node *head;
+  std::atomic<int> height{1};
+  std::atomic<std::uint64_t> count{0};
+
+public:
+  // sees every node linked before it gets to its place
+  class iterator {
+  public:
+    using value_type = SSTRecord;
+
+    const value_type operator*() {
+      const IndexEntry *entry = node->entry.load(std::memory_order_acquire);
+      return {node->key, entry->offset, entry->value};
+    }
+
+    iterator &operator++() {
+      node = node->link(0).load(std::memory_order_acquire);
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator iterator = *this;
+      ++(*this);
+      return iterator;
+    }
+
+    bool operator==(const iterator &oth) const { return node == oth.node; }
+
+    bool operator!=(const iterator &oth) const { return !(*this == oth); }
+
+  private:
+    explicit iterator(Node *node_) : node(node_) {}
+    friend ConcurrentSkipList;
+
+    Node *node = nullptr;
+  };
+
+  iterator begin() const {
+    return iterator(head->link(0).load(std::memory_order_acquire));
+  }
+
+  iterator end() const { return iterator(nullptr); }
+
+  std::uint64_t size() const { return count.load(std::memory_order_relaxed); }
+};
+
+} // namespace kvaaas
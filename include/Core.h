@@ -1,8 +1,11 @@
 #pragma once
 
 #include "xxhash.h"
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
@@ -15,6 +18,70 @@ using KeyType = std::array<std::byte, KEY_SIZE_BYTES>;
 using ValueType = std::vector<std::byte>;
 using ByteType = std::byte;
 
+// Values of at most this many bytes may live in the index entries
+// themselves instead of the KVS, see ShardOption::inline_threshold
+constexpr std::size_t MAX_INLINE_VALUE_SIZE = 64;
+
+// offset of an index entry that holds its value inline
+constexpr std::uint64_t INLINE_OFFSET = std::uint64_t{1} << 62;
+// offset of an index entry whose value was removed
+constexpr std::uint64_t TOMBSTONE_OFFSET = INLINE_OFFSET | 1;
+
+// false for the tagged offsets that have no KVS record behind them
+inline bool is_kvs_offset(std::uint64_t offset) {
+  return offset != INLINE_OFFSET && offset != TOMBSTONE_OFFSET;
+}
+
+struct InlineValue {
+  std::uint8_t size = 0;
+  std::array<ByteType, MAX_INLINE_VALUE_SIZE> bytes{};
+
+  InlineValue() = default;
+  explicit InlineValue(const ValueType &value)
+      : size(static_cast<std::uint8_t>(value.size())) {
+    assert(value.size() <= MAX_INLINE_VALUE_SIZE);
+    std::copy(value.begin(), value.end(), bytes.begin());
+  }
+
+  [[nodiscard]] ValueType to_value() const {
+    return {bytes.begin(), bytes.begin() + size};
+  }
+
+  // bytes an on-disk slot for values up to capacity takes, the size byte
+  // and the value padded to capacity
+  static constexpr std::size_t slot_size(std::size_t capacity) {
+    return capacity == 0 ? 0 : 1 + capacity;
+  }
+
+  void store(ByteType *slot, std::size_t capacity) const {
+    if (capacity != 0) {
+      assert(size <= capacity);
+      slot[0] = ByteType(size);
+      std::copy(bytes.begin(), bytes.begin() + capacity, slot + 1);
+    }
+  }
+
+  static InlineValue load(const ByteType *slot, std::size_t capacity) {
+    InlineValue value;
+    if (capacity != 0) {
+      value.size = static_cast<std::uint8_t>(slot[0]);
+      std::copy(slot + 1, slot + 1 + capacity, value.bytes.begin());
+    }
+    return value;
+  }
+};
+
+inline bool operator==(const InlineValue &a, const InlineValue &b) {
+  return a.size == b.size &&
+         std::equal(a.bytes.begin(), a.bytes.begin() + a.size, b.bytes.begin());
+}
+
+// What the indexes map a key to
+struct IndexEntry {
+  std::uint64_t offset = 0; // in the KVS, or INLINE_OFFSET/TOMBSTONE_OFFSET
+  InlineValue value{};
+};
+
 } // namespace kvaaas
 
 template <> struct std::hash<kvaaas::KeyType> {
@@ -0,0 +1,32 @@
+#pragma once
+#include "ByteArray.h"
+#include <cstdint>
+#include <unordered_set>
+
+namespace kvaaas {
+
+// Addresses of removed KVS records. The KVS stays append-only: a remove
+// appends the 8-byte address to the backing array instead of rewriting
+// the record, and the array is replayed into memory on open.
+class DeletionSet {
+public:
+  DeletionSet() = delete;
+
+  // arr is not owned
+  explicit DeletionSet(ByteArrayPtr arr);
+
+  bool contains(std::uint64_t address) const {
+    return addresses.count(address) != 0;
+  }
+
+  // false if the address was already removed
+  bool insert(std::uint64_t address);
+
+  std::size_t size() const noexcept { return addresses.size(); }
+
+private:
+  ByteArrayPtr arr;
+  std::unordered_set<std::uint64_t> addresses;
+};
+
+} // namespace kvaaas
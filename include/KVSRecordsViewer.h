@@ -1,9 +1,10 @@
 #pragma once
 #include "ByteArray.h"
+#include "Compressor.h"
 #include "Error.h"
 #include <cstdint>
 #include <cstring>
-#include "../libs/zstd/zstd.h"
+#include <memory>
 
 namespace kvaaas {
 
@@ -12,27 +13,156 @@ struct KVSRecord {
   ByteType is_deleted{};
   std::uint64_t value_size{};
   std::uint64_t compressed_size = 0;
+  // the payload is a chunk table followed by the chunks
+  bool chunked = false;
   ValueType value{};
 };
 
+// Stores records one after another, each compressed on its own, or,
+// with CompressionOptions::block_size, packs them into blocks compressed
+// as one frame:
+//   count u32, raw_size u64, stored_size u64, count is_deleted flags,
+//   payload = count x (key, value_size u64, value), compressed unless
+//   stored_size == raw_size.
+// The is_deleted flags stay uncompressed so deletion is an in-place write.
+// A block record is addressed by BLOCK_FLAG | block offset << INDEX_BITS |
+// index in the block, so both kinds can live in one array.
+//
+// Values longer than CompressionOptions::chunk_size are stored on their
+// own, even with blocks, and split into chunks: the stored compressed_size
+// has CHUNKED_FLAG set and the payload is
+//   chunk_size u64, end u64 of every chunk counted from the first chunk,
+//   the chunks, each compressed unless it is as long as its raw bytes,
+// so read_range only reads and decompresses the chunks it needs.
 class KVSRecordsViewer {
 private:
+  struct DecodedBlock {
+    std::uint64_t offset = 0;
+    std::vector<ByteType> flags;
+    std::vector<ByteType> raw;
+    std::vector<std::size_t> starts; // of every record in raw
+  };
+
   ByteArrayPtr byte_arr;
-  void *comp;
+  Compressor *comp;
+  std::vector<ByteType> scratch;
+  // records not written yet, the block goes to pending.offset on flush()
+  DecodedBlock pending;
+  // most recently used first
+  std::vector<std::shared_ptr<DecodedBlock>> decoded;
+
+  std::uint64_t append_record(const KeyType &key, ByteType is_deleted,
+                              const ValueType &value);
+
+  std::uint64_t append_chunked(const KeyType &key, ByteType is_deleted,
+                               const ValueType &value);
+
+  // writes the header in front of the size bytes of payload at
+  // scratch[HEADER_SIZE] and appends the record
+  std::uint64_t append_encoded(const KeyType &key, ByteType is_deleted,
+                               std::uint64_t value_size, std::uint64_t size,
+                               bool chunked = false);
+
+  static void decode_header(const ByteType *header, KVSRecord &record);
+
+  // A record is stored raw iff its compressed size equals the value size,
+  // so the threshold and level can change between writes. A chunk table
+  // and its chunks may add up to the value size as well. Stores written
+  // before the rule compressed some values to exactly their size and are
+  // not opened, see FileMemoryManager::FORMAT_VERSION.
+  static bool is_compressed(const KVSRecord &record) {
+    return record.chunked || record.compressed_size != record.value_size;
+  }
+
+  // puts the n bytes at scratch[at], compressed if the compressor decides
+  // so, and returns how many bytes they take
+  std::uint64_t encode_payload(const ByteType *src, std::uint64_t n,
+                               std::uint64_t at);
+
+  // fills record.value from its stored payload
+  void decode_payload(const ByteType *payload, KVSRecord &record);
+
+  // puts n raw bytes stored as the stored bytes at src into dst
+  void decode_chunk(ByteType *dst, std::uint64_t n, const ByteType *src,
+                    std::uint64_t stored);
+
+  Compressor &compressor() { return comp ? *comp : Compressor::local(); }
+
+  static bool is_block_address(std::uint64_t address) {
+    return (address & BLOCK_FLAG) != 0;
+  }
+
+  std::uint64_t append_to_block(const KeyType &key, ByteType is_deleted,
+                                const ValueType &value);
+
+  // the pending block or a decoded copy of the block at offset
+  const DecodedBlock &load_block(std::uint64_t offset);
+
+  // nullptr if the block is neither pending nor decoded
+  DecodedBlock *find_block(std::uint64_t offset);
+
+  static KVSRecord block_record(const DecodedBlock &block, std::size_t index);
 
 public:
+  // key, is_deleted, value_size, compressed_size
+  static constexpr std::uint64_t HEADER_SIZE =
+      KEY_SIZE_BYTES + sizeof(KVSRecord::is_deleted) +
+      sizeof(KVSRecord::value_size) + sizeof(KVSRecord::compressed_size);
+
+  // read_record fetches the header together with the first
+  // READ_WINDOW - HEADER_SIZE payload bytes, longer payloads need one more read
+  static constexpr std::uint64_t READ_WINDOW = 512;
+
+  static constexpr std::uint64_t BLOCK_FLAG = std::uint64_t{1} << 63;
+  static constexpr std::uint64_t CHUNKED_FLAG = std::uint64_t{1} << 63;
+  static constexpr unsigned INDEX_BITS = 16;
+  // count, raw_size, stored_size
+  static constexpr std::uint64_t BLOCK_HEADER_SIZE =
+      sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+  // decoded blocks kept for neighbouring reads
+  static constexpr std::size_t DECODED_BLOCKS = 8;
+
   KVSRecordsViewer() = delete;
 
-  KVSRecordsViewer(ByteArray *arr, void *compressor);
+  // compressor is not owned, nullptr -- Compressor::local()
+  KVSRecordsViewer(ByteArray *arr, Compressor *compressor);
+
+  // a copy would write the pending block twice
+  KVSRecordsViewer(const KVSRecordsViewer &) = delete;
+  KVSRecordsViewer &operator=(const KVSRecordsViewer &) = delete;
+  KVSRecordsViewer(KVSRecordsViewer &&oth) noexcept;
+  KVSRecordsViewer &operator=(KVSRecordsViewer &&oth);
+  ~KVSRecordsViewer();
+
+  // writes the pending block, a no-op without block_size
+  void flush();
+
+  // whether a value of this size is split into chunks
+  bool is_chunked(std::uint64_t value_size) {
+    std::uint64_t chunk_size = compressor().options().chunk_size;
+    return chunk_size != 0 && value_size > chunk_size;
+  }
 
   /* Expect<offset, status>*/ std::size_t append(const KVSRecord &record);
   std::uint64_t append_not_deleted_record(const KeyType &key,
                                           const ValueType &value);
+  // same as append_not_deleted_record, with the value already compressed
+  // by a CompressionPool, blocks are compressed as a whole and ignore it
+  std::uint64_t append_compressed(const KeyType &key, const ValueType &value,
+                                  const CompressedValue &compressed);
 
   static std::uint64_t get_value_size(const KVSRecord &record);
 
   KVSRecord read_record(uint64_t offset);
 
+  // same as read_record, but the value only holds its bytes
+  // [begin, begin + len) clipped to value_size
+  KVSRecord read_range(uint64_t offset, std::uint64_t begin,
+                       std::uint64_t len);
+
+  // same as read_record for every offset, in two batched rounds of reads
+  std::vector<KVSRecord> read_records(const std::vector<uint64_t> &offsets);
+
   void mark_as_deleted(uint64_t offset);
 
   bool is_deleted(uint64_t offset);
@@ -13,11 +13,24 @@ struct KvaaasOption {
   const std::size_t sst_max_size;
   const double busy_coeff;
   const std::size_t shard_cnt;
+  // per shard, see ShardOption
+  const std::size_t block_cache_bytes = 0;
+  const std::size_t kvs_grow_step = 0;
+  const CompressionOptions compression{};
+  const std::size_t inline_threshold = 0;
+  const std::size_t compression_threads = 0;
+  const WalOptions wal{};
+  const std::size_t max_immutable_logs = 0;
+  const IndexType index = IndexType::SkipList;
+  const bool huge_pages = false;
 };
 
 inline KvaaasOption DefaultOnDisk = {
     true, ManagerType::FileMM, 1000, 26'200, 262'000, .65, 10};
 
+inline KvaaasOption DefaultMmapOnDisk = {
+    true, ManagerType::MmapMM, 1000, 26'200, 262'000, .65, 10};
+
 class ShardContainer {
 private:
   std::size_t size;
@@ -58,19 +71,24 @@ private:
 
   ShardOption get_shard_option() {
     return ShardOption{opt.force_create, opt.type,         opt.log_max_size,
-                       opt.sl_max_size,  opt.sst_max_size, opt.busy_coeff};
+                       opt.sl_max_size,  opt.sst_max_size, opt.busy_coeff,
+                       opt.block_cache_bytes, opt.kvs_grow_step,
+                       opt.compression, opt.inline_threshold,
+                       opt.compression_threads, opt.wal,
+                       opt.max_immutable_logs, opt.index,
+                       opt.huge_pages};
   }
 
 public:
   Kvaaas(std::string root_, KvaaasOption opt_)
       : shards(opt_.shard_cnt), root(std::move(root_)), opt(opt_) {
-    if (opt.type == ManagerType::FileMM) {
+    if (is_on_disk(opt.type)) {
       std::filesystem::remove_all(root);
       std::filesystem::create_directory(root);
     }
     for (std::size_t i = 0; i < opt.shard_cnt; ++i) {
       auto shard_dir = root + "/" + std::to_string(i);
-      if (opt.type == ManagerType::FileMM) {
+      if (is_on_disk(opt.type)) {
         std::filesystem::create_directory(shard_dir);
       }
       shards.emplace_back(std::move(shard_dir), get_shard_option());
@@ -81,11 +99,45 @@ public:
     get_shard(key).add(key, value);
   }
 
+  // same as add for every pair, returns once all of them are added
+  void add_batch(const std::vector<std::pair<KeyType, ValueType>> &batch) {
+    std::vector<std::vector<std::pair<KeyType, ValueType>>> by_shard(
+        opt.shard_cnt);
+    for (const auto &pair : batch) {
+      by_shard[hash_at(pair.first)].push_back(pair);
+    }
+    for (std::size_t i = 0; i < opt.shard_cnt; ++i) {
+      if (!by_shard[i].empty()) {
+        shards[i].add_batch(by_shard[i]);
+      }
+    }
+  }
+
   void remove(const KeyType &key) { get_shard(key).remove(key); }
 
+  // see Shard::commit
+  void commit() {
+    for (std::size_t i = 0; i < opt.shard_cnt; ++i) {
+      shards[i].commit();
+    }
+  }
+
+  // see Shard::close
+  void close() {
+    for (std::size_t i = 0; i < opt.shard_cnt; ++i) {
+      shards[i].close();
+    }
+  }
+
   std::optional<std::pair<KeyType, ValueType>> get(const KeyType &key) {
     return get_shard(key).get(key);
   }
+
+  // see Shard::get_range
+  std::optional<std::pair<KeyType, ValueType>>
+  get_range(const KeyType &key, std::uint64_t begin, std::uint64_t len) {
+    return get_shard(key).get_range(key, begin, len);
+  }
 };
 
 } // namespace kvaaas
@@ -1,37 +1,92 @@
 #pragma once
 
 #include "Core.h"
-#include <unordered_map>
-
-#include <iostream> // remove later
+#include <cstdint>
 #include <optional>
+#include <utility>
+#include <vector>
 
 namespace kvaaas {
+
+// Open-addressing table from keys to index entries. The entries live in
+// one contiguous slab in insertion order, so pushing the log to the skip
+// list is a linear scan. The table keeps one control byte per slot:
+// EMPTY, DELETED or the low 7 bits of the key hash. A lookup compares a
+// group of GROUP control bytes at once (SSE2 when available) and only
+// touches the slab on a 7-bit match. clear() keeps the capacity and is
+// O(1): it bumps an epoch, a group stamped with an older one reads as all
+// EMPTY and is only reset when an add lands in it.
 struct Log {
-  std::size_t size() const noexcept { return _map.size(); }
-  void add(const KeyType &key, std::uint64_t offset) { _map[key] = offset; }
+  using value_type = std::pair<KeyType, IndexEntry>;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  static constexpr std::size_t GROUP = 16;
 
-  void remove(const KeyType &key) { _map.erase(key); }
+  std::size_t size() const noexcept { return entries.size(); }
+
+  void add(const KeyType &key, std::uint64_t offset) {
+    add(key, IndexEntry{offset});
+  }
+
+  void add(const KeyType &key, const IndexEntry &entry);
+
+  void remove(const KeyType &key);
+
+  std::optional<std::uint64_t> get_offset(const KeyType &key) const {
+    std::size_t slot = find(key);
+    if (slot == NOT_FOUND) {
+      return std::nullopt;
+    }
+    return entries[slots[slot]].second.offset;
+  }
 
-  std::optional<std::uint64_t> get_offset(const KeyType &key) {
-    auto it = _map.find(key);
-    if (it == _map.end()) {
+  std::optional<IndexEntry> get_entry(const KeyType &key) const {
+    std::size_t slot = find(key);
+    if (slot == NOT_FOUND) {
       return std::nullopt;
     }
-    return it->second;
+    return entries[slots[slot]].second;
   }
 
-  void clear() { _map.clear(); }
+  void clear();
 
-  auto begin() { return _map.begin(); }
+  const_iterator begin() const { return entries.cbegin(); }
 
-  auto end() { return _map.end(); }
+  const_iterator end() const { return entries.cend(); }
 
-  auto cbegin() const { return _map.cbegin(); }
+  const_iterator cbegin() const { return entries.cbegin(); }
 
-  auto cend() const { return _map.cend(); }
+  const_iterator cend() const { return entries.cend(); }
 
 private:
-  std::unordered_map<KeyType, std::uint64_t> _map;
+  static constexpr std::int8_t EMPTY = -128; // 0x80
+  static constexpr std::int8_t DELETED = -2; // 0xFE
+  static constexpr std::size_t NOT_FOUND = ~std::size_t{0};
+  static constexpr std::size_t MIN_CAPACITY = 2 * GROUP;
+
+  static std::uint64_t hash(const KeyType &key) {
+    return XXH3_64bits(key.data(), key.size());
+  }
+
+  // slot holding key, or NOT_FOUND
+  std::size_t find(const KeyType &key) const;
+
+  // first EMPTY or DELETED slot on the probe sequence of hash
+  std::size_t find_free(std::uint64_t hash) const;
+
+  void rehash(std::size_t new_capacity);
+
+  bool stale(std::size_t group) const { return group_epochs[group] != epoch; }
+
+  // control bytes, slots and group count always have GROUP-multiple sizes
+  std::vector<std::int8_t> ctrl;
+  // index into entries of every full slot
+  std::vector<std::uint32_t> slots;
+  // epoch of the last clear() each group was reset after
+  std::vector<std::uint32_t> group_epochs;
+  std::uint32_t epoch = 0;
+  std::vector<value_type> entries;
+  // full and DELETED slots, a new one is only taken below 7/8 of capacity
+  std::size_t used = 0;
 };
 } // namespace kvaaas
@@ -2,8 +2,11 @@
 #include "ByteArray.h"
 #include "json.hpp"
 #include <cassert>
+#include <initializer_list>
 #include <iostream>
+#include <array>
 #include <map>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -16,7 +19,11 @@ enum MemoryPurpose {
   SKIP_LIST_UL = 2,
   SKIP_LIST_BL = 3,
   SKIP_LIST_UL_H = 4,
-  END = 5,
+  KVS_DICT = 5,
+  KVS_DELETED = 6,
+  LOG_WAL = 7,
+  BPLUS_TREE = 8,
+  END = 9,
 };
 
 inline std::string to_string(MemoryPurpose p) {
@@ -31,6 +38,14 @@ inline std::string to_string(MemoryPurpose p) {
     return "_skip_list_bl";
   case MemoryPurpose::SKIP_LIST_UL_H:
     return "_skip_list_ul_h";
+  case MemoryPurpose::KVS_DICT:
+    return "_kvs_dict";
+  case MemoryPurpose::KVS_DELETED:
+    return "_kvs_deleted";
+  case MemoryPurpose::LOG_WAL:
+    return "_log_wal";
+  case MemoryPurpose::BPLUS_TREE:
+    return "_bplus_tree";
   default:
     std::cerr << "Unreachable! Incorrect MemoryPurpose!";
   }
@@ -88,6 +103,27 @@ public:
 
   virtual void remove(MemoryPurpose memory_purpose) = 0;
 
+  // ends the overwrites of all purposes at once, arrays that only make sense
+  // together are never seen half switched
+  virtual void end_overwrites(std::initializer_list<MemoryPurpose> purposes) {
+    for (auto purpose : purposes) {
+      end_overwrite(purpose);
+    }
+  }
+
+  // Cuts an array opened whole (see FileMemoryOptions::owner_sized) back
+  // to size, or to its checkpointed size without one. A no-op in RAM.
+  virtual void restore_size(MemoryPurpose /*memory_purpose*/,
+                            std::optional<std::size_t> /*size*/) {}
+
+  // Records the logical size of every array, a crash cuts the arrays back
+  // to the last record. durable -- the record also survives a power loss.
+  virtual void checkpoint(bool /*durable*/) {}
+
+  // Hands the buffered appends of every array to the OS, throws what the
+  // destructors of the arrays can only drop.
+  virtual void flush() {}
+
   virtual ~MemoryManager() = default;
 };
 
@@ -97,9 +133,14 @@ private:
       cmp_memory_type};
   std::map<MemoryType, ByteArrayPtr, cmp_memory_type_type> memory_to_overwrite{
       cmp_memory_type};
+  bool huge_pages = false;
+
+  ByteArrayPtr new_byte_array() const;
 
 public:
   RAMMemoryManager() = default;
+  // huge_pages -- back the arrays with transparent huge pages
+  explicit RAMMemoryManager(bool huge_pages);
   RAMMemoryManager(const RAMMemoryManager &) = delete;
   RAMMemoryManager &operator=(const RAMMemoryManager &) = delete;
   RAMMemoryManager(RAMMemoryManager &&) = default;
@@ -136,17 +177,42 @@ public:
 
 struct Upload {};
 
+// How FileMemoryManager accesses its files
+enum class FileBackend {
+  Stream, // FileByteArray
+  Mmap,   // MmapByteArray
+};
+
+class BlockCache;
+
+struct FileMemoryOptions {
+  FileBackend backend = FileBackend::Stream;
+  // shared by all arrays of the manager, nullptr -- no user-space cache
+  std::shared_ptr<BlockCache> cache = nullptr;
+  // KVS values are read once per get and would only evict index blocks
+  bool cache_kvs = false;
+  // per MemoryPurpose, see FileArrayOptions::grow_step
+  std::array<std::size_t, MemoryPurpose::END> grow_step{};
+  // slot size of the values inlined into index records, their layout
+  // depends on it, so a manifest with another one is not opened
+  std::size_t inline_capacity = 0;
+  // per MemoryPurpose, the array is opened whole, past its checkpointed
+  // size, and its owner cuts it back with MemoryManager::restore_size
+  std::array<bool, MemoryPurpose::END> owner_sized{};
+};
+
 class FileMemoryManager : public MemoryManager {
 private:
-  std::map<MemoryType, FileByteArrayPtr, cmp_memory_type_type> memory{
+  std::map<MemoryType, FileBackedByteArrayPtr, cmp_memory_type_type> memory{
       cmp_memory_type};
-  std::map<MemoryType, FileByteArrayPtr, cmp_memory_type_type>
+  std::map<MemoryType, FileBackedByteArrayPtr, cmp_memory_type_type>
       memory_to_overwrite{cmp_memory_type};
 
 public:
-  FileMemoryManager(std::string root);
+  FileMemoryManager(std::string root, FileMemoryOptions opt = {});
   FileMemoryManager(Upload, std::string root);
-  FileMemoryManager(nlohmann::json mem_json, std::string root);
+  FileMemoryManager(nlohmann::json mem_json, std::string root,
+                    FileMemoryOptions opt = {});
   FileMemoryManager(const FileMemoryManager &) = delete;
   FileMemoryManager &operator=(const FileMemoryManager &) = delete;
   FileMemoryManager(FileMemoryManager &&) = default;
@@ -179,17 +245,47 @@ public:
 
   void remove(MemoryPurpose memory_purpose) override;
 
+  void end_overwrites(std::initializer_list<MemoryPurpose> purposes) override;
+
+  void restore_size(MemoryPurpose memory_purpose,
+                    std::optional<std::size_t> size) override;
+
+  void checkpoint(bool durable) override;
+
+  void flush() override;
+
   ~FileMemoryManager() noexcept override;
 
-  static FileMemoryManager from_dir(std::string);
+  static FileMemoryManager from_dir(std::string, FileMemoryOptions opt = {});
+
+  // Layout of the files, a manifest of another version is not opened.
+  // 1 -- no version in the manifest, its KVS may hold compressed values
+  // as long as their raw bytes, 2 -- raw KVS values are exactly those as
+  // long as their compressed size, skip-list links carry the key prefix
+  // of the next node, 3 -- WAL commit records carry the sizes of the KVS
+  // and the deletion set
+  static constexpr std::uint64_t FORMAT_VERSION = 3;
 
 private:
+  // manifest entry with the logical sizes of the arrays, rewritten by
+  // every manifest update
+  static constexpr const char *SIZES_KEY = "sizes";
+  static constexpr const char *FORMAT_VERSION_KEY = "format_version";
+  static constexpr const char *INLINE_CAPACITY_KEY = "inline_capacity";
+
   std::string generate_new_filename(MemoryPurpose);
-  inline void update_manifest() {
-    std::ofstream os(root + "/manifest.json");
-    os << manifest_json;
-  };
+  // end_overwrite without the manifest update
+  void switch_to_overwrite(MemoryPurpose memory_purpose);
+  FileBackedByteArrayPtr
+  open_byte_array(const std::string &fname, MemoryPurpose purpose,
+                  std::optional<std::size_t> logical_size = {}) const;
+  // replaces the manifest as a whole, durable -- fsync it and the directory
+  void update_manifest(bool durable = false);
   std::string root;
-  nlohmann::json manifest_json; // assume it cannot down during overwriting
+  FileMemoryOptions opt;
+  nlohmann::json manifest_json;
+  // owner-sized arrays opened whole, with their checkpointed sizes, which
+  // the manifest keeps until restore_size
+  std::map<MemoryPurpose, std::optional<std::size_t>> unrestored;
 };
 } // namespace kvaaas
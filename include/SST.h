@@ -5,6 +5,7 @@
 #include "Core.h"
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <iostream> // for debug, remove later
 #include <vector>
@@ -14,6 +15,8 @@ namespace kvaaas {
 struct SSTRecord {
   KeyType key{};
   std::uint64_t offset;
+  // stored only by viewers with an inline capacity
+  InlineValue value{};
   bool operator<(SSTRecord oth) const { return key < oth.key; }
   bool operator==(SSTRecord oth) const { return key == oth.key; }
   bool operator!=(SSTRecord oth) const { return key != oth.key; }
@@ -24,46 +27,56 @@ struct RebuildSSTRV {};
 
 // It just take an underlaying bytearrat
 // If wanna EMPTY one, than inject an empty byte array!
+// A record is key, offset and, with an inline capacity, the inline slot.
 struct SSTRecordViewer {
-  SSTRecordViewer(ByteArrayPtr data, NewSSTRV)
-      : _data(data) {} // remove later ??
+  SSTRecordViewer(ByteArrayPtr data, NewSSTRV, std::size_t inline_capacity = 0)
+      : _data(data), _inline_capacity(inline_capacity),
+        _rec_size(BASE_REC_SIZE + InlineValue::slot_size(inline_capacity)) {
+  } // remove later ??
 
   void append(const SSTRecord &rec) {
-    std::vector<ByteType> vec(rec.key.size() + sizeof(std::uint64_t));
-    std::copy(rec.key.begin(), rec.key.end(), vec.begin());
-    std::memcpy(vec.data() + rec.key.size(), &rec.offset,
+    std::array<ByteType, BASE_REC_SIZE +
+                             InlineValue::slot_size(MAX_INLINE_VALUE_SIZE)>
+        buf;
+    std::copy(rec.key.begin(), rec.key.end(), buf.begin());
+    std::memcpy(buf.data() + rec.key.size(), &rec.offset,
                 sizeof(std::uint64_t));
-    _data->append(vec);
+    rec.value.store(buf.data() + BASE_REC_SIZE, _inline_capacity);
+    _data->append(buf.data(), _rec_size);
   }
 
   SSTRecord get_record(std::size_t index) {
     SSTRecord rec;
-    const std::size_t REC_SIZE = rec.key.size() + sizeof(std::uint64_t);
-    auto vec = _data->read(index * REC_SIZE, (index + 1) * REC_SIZE);
-    std::copy(vec.begin(), std::next(vec.begin(), rec.key.size()),
-              rec.key.begin());
-    std::memcpy(&rec.offset, vec.data() + rec.key.size(),
+    auto view = _data->view(index * _rec_size, (index + 1) * _rec_size);
+    std::memcpy(rec.key.data(), view.data(), rec.key.size());
+    std::memcpy(&rec.offset, view.data() + rec.key.size(),
                 sizeof(std::uint64_t));
+    rec.value =
+        InlineValue::load(view.data() + BASE_REC_SIZE, _inline_capacity);
     return rec;
   }
 
   void change_offset(std::size_t index, std::uint64_t new_offset) {
-    const std::size_t REC_SIZE = KEY_SIZE_BYTES + sizeof(std::uint64_t);
-    std::vector<ByteType> vec(sizeof(std::uint64_t));
-    std::memcpy(vec.data(), &new_offset, sizeof(std::uint64_t));
-    _data->rewrite(REC_SIZE * index + KEY_SIZE_BYTES, vec);
+    _data->rewrite(_rec_size * index + KEY_SIZE_BYTES,
+                   reinterpret_cast<const ByteType *>(&new_offset),
+                   sizeof(std::uint64_t));
   }
 
-  SSTRecordViewer(ByteArrayPtr data, RebuildSSTRV) : _data(data) {}
+  SSTRecordViewer(ByteArrayPtr data, RebuildSSTRV,
+                  std::size_t inline_capacity = 0)
+      : SSTRecordViewer(data, NewSSTRV{}, inline_capacity) {}
 
-  std::uint64_t size() const noexcept {
-    return _data->size() / (sizeof(std::uint64_t) + KEY_SIZE_BYTES);
-  }
+  std::uint64_t size() const noexcept { return _data->size() / _rec_size; }
 
   bool same_layout(const SSTRecordViewer &oth) { return _data == oth._data; }
 
 private:
+  static constexpr std::size_t BASE_REC_SIZE =
+      KEY_SIZE_BYTES + sizeof(std::uint64_t);
+
   ByteArrayPtr _data;
+  std::size_t _inline_capacity;
+  std::size_t _rec_size;
 };
 
 struct SST {
@@ -135,6 +148,10 @@ struct SST {
   }
 
   std::uint64_t find_offset(const KeyType &key) {
+    return find_entry(key).offset;
+  }
+
+  IndexEntry find_entry(const KeyType &key) {
     // find record
     std::int64_t left = 0;                 // less or equal
     std::int64_t right = _rec_view.size(); // not valid
@@ -151,7 +168,7 @@ struct SST {
     auto rec = _rec_view.get_record(left);
     if (rec.key != key) {
     }
-    return rec.offset;
+    return {rec.offset, rec.value};
   }
 
   template <typename It1, typename It2>
@@ -1,20 +1,45 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <initializer_list>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <variant>
 
+#include "BPlusTree.h"
+#include "BlockCache.h"
+#include "ConcurrentSkipList.h"
+#include "DeletionSet.h"
 #include "KVSRecordsViewer.h"
 #include "Log.h"
 #include "MemoryManager.h"
 #include "SST.h"
 #include "SkipList.h"
+#include "WriteAheadLog.h"
 
 namespace kvaaas {
 
 enum class ManagerType {
   FileMM,
   RAMMM,
+  MmapMM,
+};
+
+inline bool is_on_disk(ManagerType type) { return type != ManagerType::RAMMM; }
+
+// what keeps the pushed logs sorted until they are merged into the SST
+enum class IndexType {
+  SkipList,
+  BPlusTree,
+  // RAMMM shards only
+  ConcurrentSkipList,
 };
 
 // TODO read from config
@@ -25,6 +50,26 @@ struct ShardOption {
   const std::size_t sl_max_size;
   const std::size_t sst_max_size;
   const double busy_coeff;
+  // user-space block cache for SST and skip-list files, 0 -- disabled
+  const std::size_t block_cache_bytes = 0;
+  // the KVS file reserves disk space in steps of this size, 0 -- disabled
+  const std::size_t kvs_grow_step = 0;
+  const CompressionOptions compression{};
+  // values up to this size (at most MAX_INLINE_VALUE_SIZE) are kept in the
+  // index entries instead of the KVS, 0 -- disabled
+  const std::size_t inline_threshold = 0;
+  // threads compressing the values of add_batch, 0 -- the caller's thread
+  const std::size_t compression_threads = 0;
+  // durability of the entries in the log, see WalMode, with
+  // compression.block_size only GroupCommit
+  const WalOptions wal{};
+  // full logs waiting for the background flush before writes stall,
+  // 0 -- the writing thread flushes a full log itself
+  const std::size_t max_immutable_logs = 0;
+  // sl_max_size bounds either index
+  const IndexType index = IndexType::SkipList;
+  // RAMMM arrays ask for transparent huge pages, see RAMByteArray
+  const bool huge_pages = false;
 };
 
 // TODO
@@ -34,46 +79,148 @@ struct ShardOption {
 
 struct Shard {
   explicit Shard(std::string root_, ShardOption opt)
-      : opt(std::move(opt)), root(std::move(root_)) {
-    if (opt.type == ManagerType::FileMM) {
+      : opt(std::move(opt)), root(std::move(root_)),
+        inline_capacity(std::min(opt.inline_threshold, MAX_INLINE_VALUE_SIZE)),
+        compressor(std::make_unique<Compressor>(opt.compression)) {
+    if (opt.compression.block_size != 0 &&
+        (opt.wal.mode == WalMode::NoSync || opt.wal.mode == WalMode::Sync)) {
+      // the WAL points into the KVS, so every write would flush the block
+      throw std::invalid_argument(
+          "value blocks need the group commit of the WAL");
+    }
+    if (is_on_disk(opt.type)) {
+      FileMemoryOptions file_opt;
+      file_opt.backend = opt.type == ManagerType::MmapMM ? FileBackend::Mmap
+                                                         : FileBackend::Stream;
+      file_opt.grow_step[MemoryPurpose::KVS] = opt.kvs_grow_step;
+      file_opt.inline_capacity = inline_capacity;
+      if (opt.wal.mode != WalMode::Disabled) {
+        // the last WAL commit knows how far these got, see commit_wal
+        for (auto purpose : {MemoryPurpose::KVS, MemoryPurpose::KVS_DELETED,
+                             MemoryPurpose::LOG_WAL}) {
+          file_opt.owner_sized[purpose] = true;
+        }
+      }
+      if (opt.block_cache_bytes != 0) {
+        cache = std::make_shared<BlockCache>(opt.block_cache_bytes);
+        file_opt.cache = cache;
+      }
       if (opt.force_create) {
         // it creates empty manifest
-        manager = std::make_unique<FileMemoryManager>(root);
+        manager = std::make_unique<FileMemoryManager>(root, file_opt);
       } else {
         manager = std::make_unique<FileMemoryManager>(
-            FileMemoryManager::from_dir(this->root));
+            FileMemoryManager::from_dir(this->root, file_opt));
       }
     } else {
       // TODO maybe process somehow better ?
-      manager = std::make_unique<RAMMemoryManager>();
+      manager = std::make_unique<RAMMemoryManager>(opt.huge_pages);
+    }
+    load_dictionaries();
+    // blocks are compressed as a whole when they fill up
+    if (opt.compression_threads != 0 && opt.compression.block_size == 0 &&
+        opt.compression.mode != CompressionMode::None) {
+      pool = std::make_unique<CompressionPool>(opt.compression,
+                                               opt.compression_threads);
+    }
+    if (opt.wal.mode != WalMode::Disabled) {
+      wal.emplace(manager->get_or_create_byte_array(MemoryPurpose::LOG_WAL),
+                  opt.wal);
+      wal->replay(log);
+      // records appended behind a torn tail would never be replayed
+      manager->restore_size(MemoryPurpose::LOG_WAL, wal->intact_size());
+      wal->reset(manager->get_byte_array(MemoryPurpose::LOG_WAL));
+      std::optional<WalSizes> sizes = wal->committed();
+      manager->restore_size(MemoryPurpose::KVS,
+                            sizes ? std::optional(sizes->kvs) : std::nullopt);
+      manager->restore_size(MemoryPurpose::KVS_DELETED,
+                            sizes ? std::optional(sizes->deleted)
+                                  : std::nullopt);
+    }
+    deleted_bytes =
+        manager->get_or_create_byte_array(MemoryPurpose::KVS_DELETED);
+    deleted.emplace(deleted_bytes);
+    kvs_bytes = manager->get_or_create_byte_array(MemoryPurpose::KVS);
+    kvs_viewer = KVSRecordsViewer(kvs_bytes, compressor.get());
+    if (opt.index == IndexType::ConcurrentSkipList) {
+      if (is_on_disk(opt.type)) {
+        throw std::invalid_argument(
+            "the concurrent skip list is only kept in RAM");
+      }
+      sorted_index.emplace(std::in_place_type<ConcurrentSkipList>);
+    } else if (opt.index == IndexType::BPlusTree) {
+      sorted_index.emplace(
+          std::in_place_type<BPlusTree>,
+          manager->get_or_create_byte_array(MemoryPurpose::BPLUS_TREE),
+          inline_capacity);
+    } else {
+      SLBottomLevelRecordViewer sl_bottom_viewer(
+          manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_BL),
+          inline_capacity);
+      SLUpperLevelRecordViewer sl_upper_viewer(
+          manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_UL),
+          manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_UL_H));
+      sorted_index.emplace(std::in_place_type<SkipList>, sl_bottom_viewer,
+                           sl_upper_viewer, opt.sl_max_size);
+    }
+    sst.emplace(
+        SSTRecordViewer(manager->get_or_create_byte_array(MemoryPurpose::SST),
+                        RebuildSSTRV{}, inline_capacity));
+    if (opt.max_immutable_logs != 0) {
+      flusher = std::thread([this] { flush_in_background(); });
     }
-    kvs_viewer = KVSRecordsViewer(
-        manager->get_or_create_byte_array(MemoryPurpose::KVS), nullptr);
-    SLBottomLevelRecordViewer sl_bottom_viewer(
-        manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_BL));
-    SLUpperLevelRecordViewer sl_upper_viewer(
-        manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_UL),
-        manager->get_or_create_byte_array(MemoryPurpose::SKIP_LIST_UL_H));
-    skip_list.emplace(sl_bottom_viewer, sl_upper_viewer, opt.sl_max_size);
-    sst.emplace(SSTRecordViewer(
-        manager->get_or_create_byte_array(MemoryPurpose::SST), RebuildSSTRV{}));
   }
 
   void add(const KeyType &key, const ValueType &value) {
-    ++operations_since_last_rebuild;
-    ++stat.bad;
-    ++stat.total;
-
-    // Step 1 -- write into KVS
-    auto offset = kvs_viewer->append_not_deleted_record(key, value);
-
-    // Step 2 -- into log
-    log.add(key, offset);
+    put(key, value, nullptr);
 
-    if (log.size() > opt.log_max_size) {
-      launch_push_process();
+    if (is_time_to_rebuild()) {
+      do_rebuild();
     }
+  }
 
+  // Same as add for every pair in order, returns once all of them are
+  // added. With compression_threads the values are compressed in parallel
+  // while the earlier ones are appended.
+  void add_batch(const std::vector<std::pair<KeyType, ValueType>> &batch) {
+    if (!pool) {
+      for (const auto &[key, value] : batch) {
+        add(key, value);
+      }
+      return;
+    }
+    if (pool_dictionary_id != compressor->dictionary_id()) {
+      pool->set_dictionary(compressor->dictionary());
+      pool_dictionary_id = compressor->dictionary_id();
+    }
+    std::vector<std::future<CompressedValue>> compressed(batch.size());
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      // chunked values are compressed chunk by chunk on append
+      if (!is_inline(batch[i].second) &&
+          !kvs_viewer->is_chunked(batch[i].second.size())) {
+        compressed[i] = pool->submit(batch[i].second);
+      }
+    }
+    try {
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        if (compressed[i].valid()) {
+          CompressedValue value = compressed[i].get();
+          put(batch[i].first, batch[i].second, &value);
+        } else {
+          put(batch[i].first, batch[i].second, nullptr);
+        }
+      }
+    } catch (...) {
+      // the workers still read the values of the batch
+      for (auto &future : compressed) {
+        if (future.valid()) {
+          future.wait();
+        }
+      }
+      throw;
+    }
+    // a rebuild may retrain the dictionary, which must not happen while
+    // values compressed with the previous one are waiting to be appended
     if (is_time_to_rebuild()) {
       do_rebuild();
     }
@@ -81,17 +228,29 @@ struct Shard {
 
   void remove(const KeyType &key) {
     ++operations_since_last_rebuild;
-    std::optional<std::uint64_t> offset = get_offset(key);
-    if (offset && !kvs_viewer->is_deleted(*offset)) {
+    std::optional<IndexEntry> entry = get_entry(key);
+    if (entry && entry->offset == INLINE_OFFSET) {
+      log_add(key, IndexEntry{TOMBSTONE_OFFSET});
+      after_write();
+      if (log.size() > opt.log_max_size) {
+        launch_push_process();
+      }
+    } else if (entry && is_kvs_offset(entry->offset) &&
+               deleted->insert(entry->offset)) {
       ++stat.bad;
-      kvs_viewer->mark_as_deleted(*offset);
+      after_write();
     }
   }
 
   std::optional<std::pair<KeyType, ValueType>> get(const KeyType &key) {
-    std::optional<std::uint64_t> offset = get_offset(key);
-    if (offset) {
-      auto rec = kvs_viewer->read_record(*offset);
+    std::optional<IndexEntry> entry = get_entry(key);
+    if (entry && entry->offset == INLINE_OFFSET) {
+      return std::pair{key, entry->value.to_value()};
+    }
+    if (entry && is_kvs_offset(entry->offset) &&
+        !deleted->contains(entry->offset)) {
+      auto rec = kvs_viewer->read_record(entry->offset);
+      // older shards flagged removed records in place
       if (rec.is_deleted == std::byte(0))
         return std::pair{rec.key, rec.value};
     } else {
@@ -99,90 +258,525 @@ struct Shard {
     return std::nullopt;
   }
 
+  // bytes [begin, begin + len) of the value, clipped to its size, only the
+  // chunks of a long value covering them are read and decompressed
+  std::optional<std::pair<KeyType, ValueType>>
+  get_range(const KeyType &key, std::uint64_t begin, std::uint64_t len) {
+    std::optional<IndexEntry> entry = get_entry(key);
+    if (entry && entry->offset == INLINE_OFFSET) {
+      ValueType value = entry->value.to_value();
+      begin = std::min<std::uint64_t>(begin, value.size());
+      len = std::min<std::uint64_t>(len, value.size() - begin);
+      return std::pair{key, ValueType(value.begin() + begin,
+                                      value.begin() + begin + len)};
+    }
+    if (entry && is_kvs_offset(entry->offset) &&
+        !deleted->contains(entry->offset)) {
+      auto rec = kvs_viewer->read_range(entry->offset, begin, len);
+      if (rec.is_deleted == std::byte(0))
+        return std::pair{rec.key, rec.value};
+    }
+    return std::nullopt;
+  }
+
+  // makes the writes so far as durable as the WAL mode promises, a group
+  // commit only checks its interval on the next write
+  void commit() {
+    if (wal) {
+      commit_wal();
+    }
+  }
+
   std::size_t get_rebuild_cnt() { return rebuild_cnt; }
 
-  ~Shard() { launch_push_process(); }
+  // blocks until the flusher has pushed every full log into the index
+  void wait_for_background_flush() { wait_for_flusher(); }
+
+  // nullptr when the shard runs without a block cache
+  const BlockCache *block_cache() const { return cache.get(); }
+
+  // id of the dictionary new values are compressed with, 0 -- none
+  unsigned dictionary_id() const { return compressor->dictionary_id(); }
+
+  // Pushes the log into the index and hands every buffered write to the
+  // OS, throws what the destructor can only drop. The shard must not be
+  // used afterwards.
+  void close() {
+    if (std::exchange(closed, true)) {
+      return;
+    }
+    if (flusher.joinable()) {
+      {
+        std::lock_guard lock(immutables_mutex);
+        stopping = true;
+      }
+      immutables_cv.notify_all();
+      // the flusher drains the pending logs before it exits
+      flusher.join();
+    }
+    {
+      std::lock_guard lock(immutables_mutex);
+      rethrow_flush_error();
+    }
+    std::lock_guard lock(index_mutex);
+    push_to_index();
+    kvs_viewer->flush();
+    manager->flush();
+  }
+
+  ~Shard() {
+    try {
+      close();
+    } catch (...) {
+      // the arrays keep their last checkpointed sizes, as after a crash
+    }
+  }
 
 private:
+  bool is_inline(const ValueType &value) const {
+    return inline_capacity != 0 && value.size() <= inline_capacity;
+  }
+
+  // adds to the log without rebuilding, compressed -- the value compressed
+  // by the pool, nullptr -- compress it here
+  void put(const KeyType &key, const ValueType &value,
+           const CompressedValue *compressed) {
+    ++operations_since_last_rebuild;
+    ++stat.bad;
+    ++stat.total;
+
+    if (is_inline(value)) {
+      // the index entry is the whole record
+      log_add(key, IndexEntry{INLINE_OFFSET, InlineValue(value)});
+    } else {
+      if (opt.compression.dict_size != 0) {
+        sampler.offer(value);
+      }
+
+      // Step 1 -- write into KVS
+      auto offset =
+          compressed ? kvs_viewer->append_compressed(key, value, *compressed)
+                     : kvs_viewer->append_not_deleted_record(key, value);
+
+      // Step 2 -- into log
+      log_add(key, IndexEntry{offset});
+    }
+    after_write();
+
+    if (log.size() > opt.log_max_size) {
+      launch_push_process();
+    }
+  }
+
   void launch_push_process() {
-    push_to_skip_list();
-    if (skip_list->size() > opt.sl_max_size) {
-      push_to_sst_from_skip_list();
+    if (!flusher.joinable()) {
+      std::lock_guard lock(index_mutex);
+      push_to_index();
+      return;
+    }
+    std::unique_lock lock(immutables_mutex);
+    // writes stall only while too many full logs wait for the flusher
+    immutables_cv.wait(lock, [this] {
+      return flush_error || immutables.size() < opt.max_immutable_logs;
+    });
+    rethrow_flush_error();
+    immutables.push_back(std::make_shared<const Log>(std::exchange(log, {})));
+    lock.unlock();
+    immutables_cv.notify_all();
+  }
+
+  // Runs on the flusher thread. A log leaves the queue only once the
+  // sorted index holds its entries, so a reader finds them in one or the
+  // other.
+  void flush_in_background() {
+    std::unique_lock lock(immutables_mutex);
+    while (true) {
+      immutables_cv.wait(lock,
+                         [this] { return stopping || !immutables.empty(); });
+      if (immutables.empty()) {
+        return;
+      }
+      std::shared_ptr<const Log> oldest = immutables.front();
+      lock.unlock();
+      try {
+        std::lock_guard index_lock(index_mutex);
+        push_to_sorted_index(*oldest);
+        if (sorted_index_size() > opt.sl_max_size) {
+          push_to_sst_from_sorted_index();
+        }
+      } catch (...) {
+        lock.lock();
+        flush_error = std::current_exception();
+        immutables_cv.notify_all();
+        return;
+      }
+      lock.lock();
+      immutables.pop_front();
+      ++flushed_logs;
+      immutables_cv.notify_all();
+    }
+  }
+
+  // blocks until the flusher has emptied the queue
+  void wait_for_flusher() {
+    if (!flusher.joinable()) {
+      return;
+    }
+    std::unique_lock lock(immutables_mutex);
+    immutables_cv.wait(lock,
+                       [this] { return flush_error || immutables.empty(); });
+    rethrow_flush_error();
+  }
+
+  // immutables_mutex must be held
+  void rethrow_flush_error() {
+    if (flush_error) {
+      std::rethrow_exception(flush_error);
+    }
+  }
+
+  // the active log into the sorted index and the index into the SST once
+  // it is full, index_mutex must be held and no log may be pending
+  void push_to_index() {
+    push_to_sorted_index(log);
+    log.clear();
+    reset_wal();
+    if (sorted_index_size() > opt.sl_max_size) {
+      push_to_sst_from_sorted_index();
     }
   }
 
   void do_rebuild() {
     ++rebuild_cnt;
-    push_to_skip_list();
-    push_to_sst_from_skip_list();
+    wait_for_flusher();
+    std::lock_guard lock(index_mutex);
+    push_to_sorted_index(log);
+    log.clear();
+    reset_wal();
+    push_to_sst_from_sorted_index();
+    bool retrained = retrain_dictionary();
     auto new_kvs_bytes = manager->start_overwrite(MemoryPurpose::KVS);
 
     stat.total = sst.value().size();
     stat.bad = 0;
-    KVSRecordsViewer new_kvs(new_kvs_bytes, nullptr);
+    KVSRecordsViewer new_kvs(new_kvs_bytes, compressor.get());
     std::size_t cur_pos = 0;
+    std::vector<std::size_t> positions;
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(REBUILD_BATCH_SIZE);
+    auto move_batch = [&] {
+      auto records = kvs_viewer->read_records(offsets);
+      for (std::size_t i = 0; i < records.size(); ++i) {
+        if (records[i].is_deleted != ByteType{0}) {
+          sst.value().change_offset(positions[i], TOMBSTONE_OFFSET);
+          continue;
+        }
+        if (opt.compression.dict_size != 0) {
+          sampler.offer(records[i].value);
+        }
+        std::uint64_t new_offset = new_kvs.append(records[i]);
+        sst.value().change_offset(positions[i], new_offset);
+      }
+      positions.clear();
+      offsets.clear();
+    };
     for (auto it = sst->begin(); it != sst->end(); ++it, ++cur_pos) {
-      const SSTRecord &cur_record = *it;
-      ValueType cur_value = kvs_viewer->read_record(cur_record.offset).value;
-      std::uint64_t new_offset =
-          new_kvs.append_not_deleted_record((*it).key, cur_value);
-      sst.value().change_offset(cur_pos, new_offset);
+      std::uint64_t offset = (*it).offset;
+      // inline entries have nothing in the KVS
+      if (!is_kvs_offset(offset)) {
+        continue;
+      }
+      // removed keys stay in the SST and must stay removed, but their
+      // records are not copied
+      if (deleted->contains(offset)) {
+        sst.value().change_offset(cur_pos, TOMBSTONE_OFFSET);
+        continue;
+      }
+      positions.push_back(cur_pos);
+      offsets.push_back(offset);
+      if (offsets.size() == REBUILD_BATCH_SIZE) {
+        move_batch();
+      }
     }
+    move_batch();
 
-    kvs_viewer.emplace(new_kvs_bytes, nullptr);
-    manager->end_overwrite(MemoryPurpose::KVS);
+    // keeps the decoded blocks of the rewrite warm
+    new_kvs.flush();
+    kvs_viewer.emplace(std::move(new_kvs));
+    kvs_bytes = new_kvs_bytes;
+    // the new KVS has no removed records, and the offsets of the old
+    // deletion set would mark live records of the new one
+    deleted_bytes = manager->start_overwrite(MemoryPurpose::KVS_DELETED);
+    deleted.emplace(deleted_bytes);
+    if (wal) {
+      // the commits of the old WAL hold the sizes of the old arrays
+      sync_array(kvs_bytes);
+      wal->reset(manager->start_overwrite(MemoryPurpose::LOG_WAL));
+      wal->commit({kvs_bytes->size(), deleted_bytes->size()});
+      manager->end_overwrites({MemoryPurpose::KVS, MemoryPurpose::KVS_DELETED,
+                               MemoryPurpose::LOG_WAL});
+      manager->checkpoint(opt.wal.mode != WalMode::NoSync);
+    } else {
+      manager->end_overwrites(
+          {MemoryPurpose::KVS, MemoryPurpose::KVS_DELETED});
+    }
+    if (retrained) {
+      // every record now uses the current dictionary
+      auto dict_bytes = manager->start_overwrite(MemoryPurpose::KVS_DICT);
+      store_dictionary(dict_bytes, compressor->dictionary());
+      manager->end_overwrite(MemoryPurpose::KVS_DICT);
+      compressor->retain_only_current();
+    }
     operations_since_last_rebuild = 0;
   }
 
-  void push_to_skip_list() {
-    skip_list->push_from(log.begin(), log.end());
-    log.clear(); // TODO write to json
+  // The KVS_DICT array holds (size, bytes) per dictionary, the last one is
+  // current. A new dictionary is appended before any record uses it, and
+  // the array is cut down to it once the KVS has been rewritten, so every
+  // record on disk can be decompressed at any moment.
+  void load_dictionaries() {
+    auto dict_bytes =
+        manager->get_or_create_byte_array(MemoryPurpose::KVS_DICT);
+    std::size_t pos = 0;
+    while (pos < dict_bytes->size()) {
+      std::uint64_t size;
+      dict_bytes->read_ptr(reinterpret_cast<ByteType *>(&size), pos,
+                           pos + sizeof(size));
+      pos += sizeof(size);
+      compressor->add_dictionary(dict_bytes->read(pos, pos + size));
+      pos += size;
+    }
+  }
+
+  static void store_dictionary(ByteArrayPtr dict_bytes,
+                               const std::vector<ByteType> &dict) {
+    std::uint64_t size = dict.size();
+    dict_bytes->append(reinterpret_cast<const ByteType *>(&size), sizeof(size));
+    dict_bytes->append(dict);
+    dict_bytes->flush();
+  }
+
+  // trains a dictionary on the sampled values and makes it current
+  bool retrain_dictionary() {
+    std::size_t dict_size = opt.compression.dict_size;
+    if (dict_size == 0 ||
+        sampler.sampled_bytes() < DICT_SAMPLES_PER_BYTE * dict_size) {
+      return false;
+    }
+    auto dict = Compressor::train_dictionary(sampler.samples(), dict_size);
+    if (dict.empty()) {
+      return false;
+    }
+    store_dictionary(manager->get_byte_array(MemoryPurpose::KVS_DICT), dict);
+    return compressor->add_dictionary(std::move(dict)) != 0;
+  }
+
+  void log_add(const KeyType &key, const IndexEntry &entry) {
+    if (wal) {
+      wal->append(key, entry);
+    }
+    log.add(key, entry);
   }
 
-  void push_to_sst_from_skip_list() {
+  // commits the WAL when its mode asks for it, after the KVS records and
+  // removes the entries rely on
+  void after_write() {
+    if (!wal) {
+      return;
+    }
+    if (flusher.joinable()) {
+      std::lock_guard lock(immutables_mutex);
+      rethrow_flush_error();
+      // the WAL holds the entries of every pending log, it can only be cut
+      // down to the active one once the flusher is idle
+      if (immutables.empty() && checkpointed_logs != flushed_logs) {
+        checkpointed_logs = flushed_logs;
+        std::lock_guard index_lock(index_mutex);
+        reset_wal();
+        return;
+      }
+    }
+    if (wal->due()) {
+      commit_wal();
+    }
+  }
+
+  // The commit record carries the sizes of the KVS and the deletion set,
+  // a reopen cuts them back to those and not to the checkpointed ones, so
+  // a write only syncs the arrays it grew and the WAL.
+  void commit_wal() {
+    kvs_viewer->flush();
+    WalSizes sizes{kvs_bytes->size(), deleted_bytes->size()};
+    WalSizes last = wal->committed().value_or(WalSizes{});
+    if (sizes.kvs != last.kvs) {
+      sync_array(kvs_bytes);
+    }
+    if (sizes.deleted != last.deleted) {
+      sync_array(deleted_bytes);
+    }
+    wal->commit(sizes);
+  }
+
+  // as durable as the WAL mode promises
+  void sync_array(ByteArrayPtr arr) {
+    if (opt.wal.mode == WalMode::NoSync) {
+      arr->flush();
+    } else {
+      arr->sync();
+    }
+  }
+
+  // index_mutex must be held
+  void sync_arrays(std::initializer_list<MemoryPurpose> purposes) {
+    for (auto purpose : purposes) {
+      sync_array(manager->get_byte_array(purpose));
+    }
+  }
+
+  // index_mutex must be held
+  std::uint64_t sorted_index_size() {
+    return std::visit([](auto &index) { return index.size(); },
+                      *sorted_index);
+  }
+
+  // index_mutex must be held
+  void push_to_sorted_index(const Log &from) {
+    std::visit([&](auto &index) { index.push_from(from.begin(), from.end()); },
+               *sorted_index);
+    if (!wal || opt.index == IndexType::ConcurrentSkipList) {
+      return;
+    }
+    if (opt.index == IndexType::BPlusTree) {
+      sync_arrays({MemoryPurpose::BPLUS_TREE});
+    } else {
+      sync_arrays({MemoryPurpose::SKIP_LIST_BL, MemoryPurpose::SKIP_LIST_UL,
+                   MemoryPurpose::SKIP_LIST_UL_H});
+    }
+    // the synced links may point past the sizes of the last checkpoint,
+    // which a reopen would cut them back to
+    manager->checkpoint(opt.wal.mode != WalMode::NoSync);
+  }
+
+  // The WAL forgets the entries the sorted index holds and keeps those of the
+  // active log. Runs on the writing thread with no log pending and
+  // index_mutex held.
+  void reset_wal() {
+    if (!wal) {
+      return;
+    }
+    wal->reset(manager->start_overwrite(MemoryPurpose::LOG_WAL));
+    for (const auto &[key, entry] : log) {
+      wal->append(key, entry);
+    }
+    commit_wal();
+    // the manifest moves on only to a WAL that holds the active log
+    manager->end_overwrite(MemoryPurpose::LOG_WAL);
+    manager->checkpoint(opt.wal.mode != WalMode::NoSync);
+  }
+
+  void push_to_sst_from_sorted_index() {
     auto bytes_for_new_sst = manager->start_overwrite(MemoryPurpose::SST);
-    auto view_for_new_sst = SSTRecordViewer{bytes_for_new_sst, NewSSTRV{}};
-    auto new_sst =
-        SST::merge_into_sst(skip_list->begin(), skip_list->end(), sst->begin(),
-                            sst->end(), view_for_new_sst);
+    auto view_for_new_sst =
+        SSTRecordViewer{bytes_for_new_sst, NewSSTRV{}, inline_capacity};
+    auto new_sst = std::visit(
+        [&](auto &index) {
+          return SST::merge_into_sst(index.begin(), index.end(), sst->begin(),
+                                     sst->end(), view_for_new_sst);
+        },
+        *sorted_index);
     manager->end_overwrite(MemoryPurpose::SST);
     sst.emplace(new_sst);
+    if (opt.index == IndexType::ConcurrentSkipList) {
+      sorted_index.emplace(std::in_place_type<ConcurrentSkipList>);
+      return;
+    }
+    if (opt.index == IndexType::BPlusTree) {
+      auto tree = manager->start_overwrite(MemoryPurpose::BPLUS_TREE);
+      sorted_index.emplace(std::in_place_type<BPlusTree>, tree,
+                           inline_capacity);
+      manager->end_overwrite(MemoryPurpose::BPLUS_TREE);
+      return;
+    }
     auto sl_u = manager->start_overwrite(MemoryPurpose::SKIP_LIST_UL);
     auto sl_u_h = manager->start_overwrite(MemoryPurpose::SKIP_LIST_UL_H);
     auto sl_b = manager->start_overwrite(MemoryPurpose::SKIP_LIST_BL);
 
     auto sl_upper_viewer = SLUpperLevelRecordViewer(sl_u, sl_u_h);
-    auto sl_bottom_viewer = SLBottomLevelRecordViewer(sl_b);
+    auto sl_bottom_viewer = SLBottomLevelRecordViewer(sl_b, inline_capacity);
 
-    skip_list.emplace(sl_bottom_viewer, sl_upper_viewer, opt.sl_max_size);
+    sorted_index.emplace(std::in_place_type<SkipList>, sl_bottom_viewer,
+                         sl_upper_viewer, opt.sl_max_size);
 
     manager->end_overwrite(MemoryPurpose::SKIP_LIST_UL);
     manager->end_overwrite(MemoryPurpose::SKIP_LIST_UL_H);
     manager->end_overwrite(MemoryPurpose::SKIP_LIST_BL);
   }
 
-  std::optional<std::uint64_t> get_offset(const KeyType &key) {
-    std::optional<std::uint64_t> offset = log.get_offset(key);
-    if (offset) {
-      return offset;
+  std::optional<IndexEntry> get_entry(const KeyType &key) {
+    std::optional<IndexEntry> entry = log.get_entry(key);
+    if (entry) {
+      return entry;
+    }
+    if (flusher.joinable()) {
+      std::lock_guard lock(immutables_mutex);
+      // the newest pending log shadows the older ones
+      for (auto it = immutables.rbegin(); it != immutables.rend(); ++it) {
+        entry = (*it)->get_entry(key);
+        if (entry) {
+          return entry;
+        }
+      }
     }
-    offset = skip_list->find(key);
-    if (offset) {
-      return offset;
+    std::lock_guard lock(index_mutex);
+    entry = std::visit([&](auto &index) { return index.find_entry(key); },
+                       *sorted_index);
+    if (entry) {
+      return entry;
     }
     if (sst->contains(key)) {
-      return sst->find_offset(key);
+      return sst->find_entry(key);
     }
     return std::nullopt;
   }
 
   ShardOption opt;
   std::string root;
+  std::size_t inline_capacity;
+  std::shared_ptr<BlockCache> cache;
   std::unique_ptr<MemoryManager> manager;
   Log log{};
+  // shared by every KVS viewer of the shard
+  std::unique_ptr<Compressor> compressor;
+  // nullptr -- add_batch compresses on the caller's thread
+  std::unique_ptr<CompressionPool> pool;
+  unsigned pool_dictionary_id = 0;
+  DictionarySampler sampler;
   std::optional<KVSRecordsViewer> kvs_viewer;
-  std::optional<SkipList> skip_list;
+  // removed KVS records, the KVS itself is only appended to
+  std::optional<DeletionSet> deleted;
+  // the arrays of kvs_viewer and deleted, synced without the manager
+  ByteArrayPtr kvs_bytes = nullptr;
+  ByteArrayPtr deleted_bytes = nullptr;
+  // nullopt -- WalMode::Disabled
+  std::optional<WriteAheadLog> wal;
+  // guards sorted_index, sst and manager, which the flusher shares
+  std::mutex index_mutex;
+  // between the log and the SST, see IndexType
+  std::optional<std::variant<SkipList, BPlusTree, ConcurrentSkipList>>
+      sorted_index;
   std::optional<struct SST> sst;
+  // full logs the flusher has not pushed yet, oldest first
+  std::deque<std::shared_ptr<const Log>> immutables;
+  // guards immutables, stopping, flush_error and flushed_logs
+  std::mutex immutables_mutex;
+  std::condition_variable immutables_cv;
+  bool stopping = false;
+  std::exception_ptr flush_error;
+  std::size_t flushed_logs = 0;
+  // flushed_logs when the WAL was last cut down to the active log
+  std::size_t checkpointed_logs = 0;
+  // not started with max_immutable_logs == 0
+  std::thread flusher;
   struct RebuildStat {
     unsigned total = 0;
     unsigned bad = 0;
@@ -190,7 +784,12 @@ private:
   RebuildStat stat{};
   std::size_t operations_since_last_rebuild = 0;
   std::size_t rebuild_cnt = 0;
+  bool closed = false;
   static const std::size_t MIN_NUMBER_OF_OP_TO_REBUILD = 200;
+  // KVS records read in one batch while rebuilding
+  static const std::size_t REBUILD_BATCH_SIZE = 64;
+  // sampled bytes needed per byte of a trained dictionary
+  static const std::size_t DICT_SAMPLES_PER_BYTE = 10;
 
   bool is_time_to_rebuild() const {
     return stat.total > 0 &&
@@ -5,6 +5,8 @@
 #include "SkipListRecords.h"
 #include <optional>
 #include <random>
+#include <utility>
+#include <vector>
 
 namespace kvaaas {
 
@@ -23,10 +25,10 @@ private:
   std::uint64_t insert_as_head_bottom_level(SLBottomLevelRecord &new_node);
 
   void insert_after_parents(const std::vector<std::uint64_t> &parents,
-                            const KeyType &key, std::uint64_t offset);
+                            const KeyType &key, const IndexEntry &entry);
 
   std::uint64_t insert(std::uint64_t level, std::uint64_t after_pos,
-                       std::uint64_t down, std::uint64_t offset,
+                       std::uint64_t down, const IndexEntry &entry,
                        const KeyType &key);
 
   std::random_device rd;
@@ -35,18 +37,37 @@ private:
 
   BloomFilter filter;
 
+  static constexpr std::size_t RADIX_SORT_MIN_SIZE = 64;
+
+  static IndexEntry to_entry(std::uint64_t offset) { return {offset}; }
+  static IndexEntry to_entry(const IndexEntry &entry) { return entry; }
+
+  // stable LSD radix sort on the key bytes
+  static std::vector<std::pair<KeyType, IndexEntry>>
+  sort_by_key(std::vector<std::pair<KeyType, IndexEntry>> entries);
+
+  void push_sorted(const std::vector<std::pair<KeyType, IndexEntry>> &entries);
+
 public:
   SkipList(const SLBottomLevelRecordViewer &bottom_,
            const SLUpperLevelRecordViewer &upper_,
            std::uint64_t estimated_size);
   void put(const KeyType &key, std::uint64_t offset);
+  void put(const KeyType &key, const IndexEntry &entry);
   std::optional<std::uint64_t> find(const KeyType &key);
+  std::optional<IndexEntry> find_entry(const KeyType &key);
   bool has_key(const KeyType &key);
 
+  // Adds every (key, offset or entry) pair, a later pair wins over an
+  // earlier one with its key. The pairs are sorted and merged into the
+  // list in one forward pass, so it takes time linear in their number
+  // plus the size of the list instead of a search per pair.
   template <typename It> void push_from(It begin, It end) {
+    std::vector<std::pair<KeyType, IndexEntry>> entries;
     for (It it = begin; it != end; ++it) {
-      put(it->first, it->second);
+      entries.emplace_back(it->first, to_entry(it->second));
     }
+    push_sorted(sort_by_key(std::move(entries)));
   }
 
   class iterator {
@@ -63,7 +84,7 @@ public:
 
     const value_type operator*() {
       auto record = owner->bottom.get_record(cur_node);
-      return {record.key, record.offset};
+      return {record.key, record.offset, record.value};
     }
 
     iterator &operator++() {
@@ -3,23 +3,45 @@
 #include "Core.h"
 #include <cstdint>
 #include <limits>
+#include <vector>
 
 namespace kvaaas {
 
 static constexpr std::uint64_t NULL_NODE =
     std::numeric_limits<std::uint64_t>::max();
 
+// The first 8 key bytes read as a big-endian number. Prefixes order like
+// their keys, only keys with equal prefixes need a full comparison.
+std::uint64_t key_prefix(const KeyType &key);
+
+// Every link keeps the prefix of the node it points to next to it, so a
+// search decides whether to step on from the node it is at. Links to
+// NULL_NODE have a zero prefix.
+struct SLLink {
+  std::uint64_t next = NULL_NODE;
+  std::uint64_t next_prefix = 0;
+};
+
 struct SLBottomLevelRecord {
   SLBottomLevelRecord() = default;
   SLBottomLevelRecord(const KeyType &key_, std::uint64_t offset_);
   std::uint64_t next = 0;
+  std::uint64_t next_prefix = 0;
   std::uint64_t offset = 0;
   KeyType key{};
+  // stored only by viewers with an inline capacity
+  InlineValue value{};
+  // without the inline slot, which follows the key
   static constexpr std::uint64_t SIZE =
-      sizeof(next) + sizeof(offset) + KEY_SIZE_BYTES;
+      sizeof(next) + sizeof(next_prefix) + sizeof(offset) + KEY_SIZE_BYTES;
   static constexpr std::uint64_t NEXT_BEGIN = 0;
-  static constexpr std::uint64_t OFFSET_BEGIN = sizeof(next);
-  static constexpr std::uint64_t KEY_BEGIN = sizeof(next) + sizeof(offset);
+  // big-endian, the first bytes of the next key as they are
+  static constexpr std::uint64_t NEXT_PREFIX_BEGIN = sizeof(next);
+  static constexpr std::uint64_t OFFSET_BEGIN =
+      sizeof(next) + sizeof(next_prefix);
+  static constexpr std::uint64_t KEY_BEGIN =
+      sizeof(next) + sizeof(next_prefix) + sizeof(offset);
+  static constexpr std::uint64_t VALUE_BEGIN = SIZE;
 };
 
 bool operator==(const SLBottomLevelRecord &record1,
@@ -28,15 +50,23 @@ bool operator==(const SLBottomLevelRecord &record1,
 class SLBottomLevelRecordViewer {
 private:
   ByteArrayPtr byte_arr;
+  std::size_t inline_capacity;
+  std::uint64_t record_size;
   static constexpr std::uint64_t HEAD_SIZE = sizeof(SLBottomLevelRecord::next);
-  static std::uint64_t get_begin(std::uint64_t ind);
+  [[nodiscard]] std::uint64_t get_begin(std::uint64_t ind) const;
 
 public:
-  explicit SLBottomLevelRecordViewer(ByteArrayPtr byte_arr_);
+  // inline_capacity -- room for inline values in every record, 0 -- none
+  explicit SLBottomLevelRecordViewer(ByteArrayPtr byte_arr_,
+                                     std::size_t inline_capacity = 0);
   SLBottomLevelRecord get_record(std::uint64_t ind);
+  KeyType get_key(std::uint64_t ind);
   std::uint64_t get_next(std::uint64_t ind);
+  SLLink get_link(std::uint64_t ind);
   void set_offset(std::uint64_t ind, std::uint64_t new_offset);
-  void set_next(std::uint64_t ind, std::uint64_t new_next);
+  // offset and inline value
+  void set_entry(std::uint64_t ind, const IndexEntry &entry);
+  void set_next(std::uint64_t ind, const SLLink &link);
   SLBottomLevelRecord operator[](std::uint64_t ind);
   bool has_head();
   std::uint64_t get_head();
@@ -50,38 +80,58 @@ struct SLUpperLevelRecord {
   SLUpperLevelRecord() = default;
   SLUpperLevelRecord(const KeyType &key_, std::uint64_t down_);
   std::uint64_t next = 0;
+  std::uint64_t next_prefix = 0;
   std::uint64_t down = 0;
   KeyType key{};
   static constexpr std::uint64_t SIZE =
-      sizeof(next) + sizeof(down) + KEY_SIZE_BYTES;
+      sizeof(next) + sizeof(next_prefix) + sizeof(down) + KEY_SIZE_BYTES;
   static constexpr std::uint64_t NEXT_BEGIN = 0;
-  static constexpr std::uint64_t DOWN_BEGIN = sizeof(down);
-  static constexpr std::uint64_t OFFSET_BEGIN = sizeof(down) + sizeof(next);
-  static constexpr std::uint64_t KEY_BEGIN = sizeof(down) + sizeof(next);
+  // big-endian, the first bytes of the next key as they are
+  static constexpr std::uint64_t NEXT_PREFIX_BEGIN = sizeof(next);
+  static constexpr std::uint64_t DOWN_BEGIN =
+      sizeof(next) + sizeof(next_prefix);
+  static constexpr std::uint64_t KEY_BEGIN =
+      sizeof(next) + sizeof(next_prefix) + sizeof(down);
 };
 
 bool operator==(const SLUpperLevelRecord &record1,
                 const SLUpperLevelRecord &record2);
 
+// Upper levels are a small part of the nodes but take almost every hop
+// of a search, so the viewer mirrors them and the level heads in memory.
+// Writes go to both, reads never touch the byte arrays. Only one viewer
+// may write to the arrays at a time.
 class SLUpperLevelRecordViewer {
 private:
   ByteArrayPtr byte_arr;
   ByteArrayPtr heads;
+  std::vector<SLUpperLevelRecord> records;
+  std::vector<std::uint64_t> level_heads;
   static constexpr std::uint64_t HEAD_SIZE = sizeof(SLUpperLevelRecord::next);
   static_assert(sizeof(SLUpperLevelRecord::next) ==
                 sizeof(SLUpperLevelRecord::down));
   static std::uint64_t get_begin(std::uint64_t ind);
 
 public:
+  // reads the stored levels into memory
   explicit SLUpperLevelRecordViewer(ByteArrayPtr byte_arr_,
                                     ByteArrayPtr heads_);
-  std::uint64_t get_levels();
-  SLUpperLevelRecord get_record(std::uint64_t ind);
-  std::uint64_t get_next(std::uint64_t ind);
-  void set_next(std::uint64_t ind, std::uint64_t new_next);
-  SLUpperLevelRecord operator[](std::uint64_t ind);
+  std::uint64_t get_levels() const { return level_heads.size(); }
+  const SLUpperLevelRecord &get_record(std::uint64_t ind) const {
+    return records[ind];
+  }
+  std::uint64_t get_next(std::uint64_t ind) const { return records[ind].next; }
+  SLLink get_link(std::uint64_t ind) const {
+    return {records[ind].next, records[ind].next_prefix};
+  }
+  void set_next(std::uint64_t ind, const SLLink &link);
+  const SLUpperLevelRecord &operator[](std::uint64_t ind) const {
+    return records[ind];
+  }
   std::uint64_t append_record(const SLUpperLevelRecord &record);
-  std::uint64_t get_head(std::uint64_t list_ind);
+  std::uint64_t get_head(std::uint64_t list_ind) const {
+    return level_heads[list_ind];
+  }
   void set_head(std::uint64_t list_ind, std::uint64_t head);
   void append_head(std::uint64_t head);
 };
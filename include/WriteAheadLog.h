@@ -0,0 +1,92 @@
+#pragma once
+#include "ByteArray.h"
+#include "Core.h"
+#include "Log.h"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace kvaaas {
+
+enum class WalMode {
+  Disabled,    // the log lives in memory only
+  NoSync,      // every write reaches the OS, survives a process crash
+  GroupCommit, // synced every group_ops writes, or by the first write
+               // group_interval after the last commit, no timer commits
+               // the last writes before an idle period, see Shard::commit
+  Sync,        // synced on every write
+};
+
+// A commit flushes the pending block of the KVS, since records only hold
+// offsets into it, so NoSync and Sync do not combine with value blocks.
+struct WalOptions {
+  WalMode mode = WalMode::Disabled;
+  std::size_t group_ops = 64;
+  std::chrono::microseconds group_interval{1000};
+};
+
+// Sizes of the arrays the entries point into, as of a commit
+struct WalSizes {
+  std::uint64_t kvs = 0;
+  std::uint64_t deleted = 0;
+};
+
+// Binary redo log of the entries added to a Shard's Log since its last
+// push to the skip list. An entry record is
+//   checksum u32 of the rest, inline size u8, key, offset u64,
+//   inline value bytes
+// and a commit record is
+//   checksum u32 of the rest, COMMIT_MARKER u8, WalSizes
+// Replay stops at the first torn or corrupted record, which is where a
+// crash in the middle of an append leaves the log, and drops the entries
+// no commit record follows.
+class WriteAheadLog {
+public:
+  static constexpr std::size_t MIN_RECORD_SIZE =
+      sizeof(std::uint32_t) + sizeof(std::uint8_t) + KEY_SIZE_BYTES +
+      sizeof(std::uint64_t);
+  // inline size of a commit record, above MAX_INLINE_VALUE_SIZE
+  static constexpr std::uint8_t COMMIT_MARKER = 0xFF;
+  static constexpr std::size_t COMMIT_RECORD_SIZE =
+      sizeof(std::uint32_t) + sizeof(std::uint8_t) + sizeof(WalSizes);
+
+  // arr is not owned
+  WriteAheadLog(ByteArrayPtr arr, WalOptions opt);
+
+  // adds every committed entry to log, returns how many there were
+  std::size_t replay(Log &log);
+
+  // bytes up to the last commit record the last replay read, torn or
+  // uncommitted records follow them
+  [[nodiscard]] std::size_t intact_size() const noexcept { return intact; }
+
+  // sizes of the last commit, none before the first one
+  [[nodiscard]] const std::optional<WalSizes> &committed() const noexcept {
+    return last_sizes;
+  }
+
+  void append(const KeyType &key, const IndexEntry &entry);
+
+  // counts a write of the shard, true when the writes so far have to be
+  // committed now according to the mode
+  bool due();
+
+  // appends a commit record and makes every appended record durable as
+  // far as the mode asks, sizes -- of the arrays, already that durable
+  void commit(const WalSizes &sizes);
+
+  // continues in an empty array once the entries are in the skip list
+  void reset(ByteArrayPtr new_arr);
+
+  [[nodiscard]] const WalOptions &options() const noexcept { return opt; }
+
+private:
+  ByteArrayPtr arr;
+  WalOptions opt;
+  std::size_t pending_ops = 0;
+  std::size_t intact = 0;
+  std::optional<WalSizes> last_sizes;
+  std::chrono::steady_clock::time_point last_commit;
+};
+
+} // namespace kvaaas
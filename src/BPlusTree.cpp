@@ -0,0 +1,344 @@
+#include "BPlusTree.h"
+#include <algorithm>
+#include <cstring>
+
+namespace kvaaas {
+
+namespace {
+template <typename T> T load(const ByteType *pos) {
+  T value;
+  std::memcpy(&value, pos, sizeof(T));
+  return value;
+}
+
+template <typename T> void store(ByteType *pos, T value) {
+  std::memcpy(pos, &value, sizeof(T));
+}
+
+std::size_t common_prefix(const KeyType &a, const KeyType &b) {
+  std::size_t len = 0;
+  while (len < a.size() && a[len] == b[len]) {
+    ++len;
+  }
+  return len;
+}
+} // namespace
+
+BPlusTree::BPlusTree(ByteArrayPtr pages_, std::size_t inline_capacity_)
+    : pages(pages_), inline_capacity(inline_capacity_),
+      record_size(KEY_SIZE_BYTES + sizeof(std::uint64_t) +
+                  InlineValue::slot_size(inline_capacity)),
+      leaf_capacity((PAGE_SIZE - LEAF_HEADER) / record_size) {
+  Page buf{};
+  if (pages->size() == 0) {
+    append_page(buf);
+    buf[TYPE_POS] = ByteType{LEAF};
+    store<std::uint64_t>(buf.data() + NEXT_POS, NULL_PAGE);
+    append_page(buf);
+    store_meta();
+    return;
+  }
+  read_page(META_PAGE, buf);
+  root = load<std::uint64_t>(buf.data());
+  entries = load<std::uint64_t>(buf.data() + sizeof(std::uint64_t));
+  depth = load<std::uint64_t>(buf.data() + 2 * sizeof(std::uint64_t));
+}
+
+void BPlusTree::read_page(std::uint64_t page, Page &buf) {
+  pages->read_ptr(buf.data(), page * PAGE_SIZE, (page + 1) * PAGE_SIZE);
+}
+
+void BPlusTree::write_page(std::uint64_t page, const Page &buf) {
+  pages->rewrite(page * PAGE_SIZE, buf.data(), PAGE_SIZE);
+}
+
+std::uint64_t BPlusTree::append_page(const Page &buf) {
+  pages->append(buf.data(), PAGE_SIZE);
+  return pages->size() / PAGE_SIZE - 1;
+}
+
+void BPlusTree::store_meta() {
+  std::array<std::uint64_t, 3> meta{root, entries, depth};
+  pages->rewrite(META_PAGE * PAGE_SIZE,
+                 reinterpret_cast<const ByteType *>(meta.data()),
+                 sizeof(meta));
+}
+
+// The children i of keys[i - 1] <= key < keys[i]. A key outside the
+// common prefix goes to the first or the last child without a search.
+std::uint64_t BPlusTree::child_for(const ByteType *page, const KeyType &key) {
+  std::size_t count = load<std::uint16_t>(page + COUNT_POS);
+  std::size_t prefix = static_cast<std::size_t>(page[PREFIX_LEN_POS]);
+  const ByteType *children = page + INNER_HEADER;
+  int cmp = std::memcmp(key.data(), page + PREFIX_POS, prefix);
+  if (cmp != 0) {
+    std::size_t child = cmp < 0 ? 0 : count;
+    return load<std::uint64_t>(children + child * sizeof(std::uint64_t));
+  }
+  std::size_t suffix = KEY_SIZE_BYTES - prefix;
+  const ByteType *suffixes = children + (count + 1) * sizeof(std::uint64_t);
+  std::size_t left = 0;
+  std::size_t right = count;
+  while (left < right) {
+    std::size_t mid = left + (right - left) / 2;
+    if (std::memcmp(suffixes + mid * suffix, key.data() + prefix, suffix) <=
+        0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return load<std::uint64_t>(children + left * sizeof(std::uint64_t));
+}
+
+BPlusTree::Inner BPlusTree::decode_inner(const ByteType *page) {
+  std::size_t count = load<std::uint16_t>(page + COUNT_POS);
+  std::size_t prefix = static_cast<std::size_t>(page[PREFIX_LEN_POS]);
+  std::size_t suffix = KEY_SIZE_BYTES - prefix;
+  const ByteType *children = page + INNER_HEADER;
+  const ByteType *suffixes = children + (count + 1) * sizeof(std::uint64_t);
+  Inner inner;
+  inner.keys.resize(count);
+  inner.children.resize(count + 1);
+  for (std::size_t i = 0; i <= count; ++i) {
+    inner.children[i] =
+        load<std::uint64_t>(children + i * sizeof(std::uint64_t));
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    std::memcpy(inner.keys[i].data(), page + PREFIX_POS, prefix);
+    std::memcpy(inner.keys[i].data() + prefix, suffixes + i * suffix, suffix);
+  }
+  return inner;
+}
+
+bool BPlusTree::encode_inner(const Inner &inner, Page &buf) {
+  // the keys are sorted, so the first and the last share the least
+  std::size_t prefix = common_prefix(inner.keys.front(), inner.keys.back());
+  std::size_t suffix = KEY_SIZE_BYTES - prefix;
+  std::size_t count = inner.keys.size();
+  if (INNER_HEADER + (count + 1) * sizeof(std::uint64_t) + count * suffix >
+      PAGE_SIZE) {
+    return false;
+  }
+  buf.fill(ByteType{0});
+  buf[TYPE_POS] = ByteType{INNER};
+  buf[PREFIX_LEN_POS] = ByteType(prefix);
+  store<std::uint16_t>(buf.data() + COUNT_POS,
+                       static_cast<std::uint16_t>(count));
+  std::memcpy(buf.data() + PREFIX_POS, inner.keys.front().data(), prefix);
+  ByteType *children = buf.data() + INNER_HEADER;
+  ByteType *suffixes = children + (count + 1) * sizeof(std::uint64_t);
+  for (std::size_t i = 0; i <= count; ++i) {
+    store<std::uint64_t>(children + i * sizeof(std::uint64_t),
+                         inner.children[i]);
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    std::memcpy(suffixes + i * suffix, inner.keys[i].data() + prefix, suffix);
+  }
+  return true;
+}
+
+std::size_t BPlusTree::lower_bound(const ByteType *leaf,
+                                   const KeyType &key) const {
+  std::size_t left = 0;
+  std::size_t right = load<std::uint16_t>(leaf + COUNT_POS);
+  while (left < right) {
+    std::size_t mid = left + (right - left) / 2;
+    if (std::memcmp(record_at(leaf, mid), key.data(), KEY_SIZE_BYTES) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+void BPlusTree::store_record(ByteType *rec, const KeyType &key,
+                             const IndexEntry &entry) const {
+  std::memcpy(rec, key.data(), KEY_SIZE_BYTES);
+  store<std::uint64_t>(rec + KEY_SIZE_BYTES, entry.offset);
+  entry.value.store(rec + KEY_SIZE_BYTES + sizeof(std::uint64_t),
+                    inline_capacity);
+}
+
+SSTRecord BPlusTree::load_record(const ByteType *rec) const {
+  SSTRecord record;
+  std::memcpy(record.key.data(), rec, KEY_SIZE_BYTES);
+  record.offset = load<std::uint64_t>(rec + KEY_SIZE_BYTES);
+  record.value = InlineValue::load(rec + KEY_SIZE_BYTES + sizeof(std::uint64_t),
+                                   inline_capacity);
+  return record;
+}
+
+void BPlusTree::put(const KeyType &key, std::uint64_t offset) {
+  put(key, IndexEntry{offset});
+}
+
+void BPlusTree::put(const KeyType &key, const IndexEntry &entry) {
+  insert(key, entry);
+  store_meta();
+}
+
+void BPlusTree::insert(const KeyType &key, const IndexEntry &entry) {
+  Page buf;
+  std::vector<std::uint64_t> path;
+  std::uint64_t page = root;
+  for (std::uint64_t level = 1; level < depth; ++level) {
+    read_page(page, buf);
+    path.push_back(page);
+    page = child_for(buf.data(), key);
+  }
+  read_page(page, buf);
+  std::size_t count = load<std::uint16_t>(buf.data() + COUNT_POS);
+  std::size_t pos = lower_bound(buf.data(), key);
+  ByteType *rec = buf.data() + LEAF_HEADER + pos * record_size;
+  if (pos < count && std::memcmp(rec, key.data(), KEY_SIZE_BYTES) == 0) {
+    store_record(rec, key, entry);
+    pages->rewrite(page * PAGE_SIZE + (rec - buf.data()), rec, record_size);
+    return;
+  }
+  ++entries;
+  if (count < leaf_capacity) {
+    std::memmove(rec + record_size, rec, (count - pos) * record_size);
+    store_record(rec, key, entry);
+    store<std::uint16_t>(buf.data() + COUNT_POS,
+                         static_cast<std::uint16_t>(count + 1));
+    write_page(page, buf);
+    return;
+  }
+
+  std::vector<ByteType> all((count + 1) * record_size);
+  ByteType *records = buf.data() + LEAF_HEADER;
+  std::memcpy(all.data(), records, pos * record_size);
+  store_record(all.data() + pos * record_size, key, entry);
+  std::memcpy(all.data() + (pos + 1) * record_size, rec,
+              (count - pos) * record_size);
+  std::uint64_t next = load<std::uint64_t>(buf.data() + NEXT_POS);
+  // appending to the last leaf leaves it full, sorted pushes fill pages
+  std::size_t left_count =
+      pos == count && next == NULL_PAGE ? count : (count + 1) / 2;
+  std::size_t right_count = count + 1 - left_count;
+
+  Page right{};
+  right[TYPE_POS] = ByteType{LEAF};
+  store<std::uint16_t>(right.data() + COUNT_POS,
+                       static_cast<std::uint16_t>(right_count));
+  store<std::uint64_t>(right.data() + NEXT_POS, next);
+  std::memcpy(right.data() + LEAF_HEADER, all.data() + left_count * record_size,
+              right_count * record_size);
+  std::uint64_t right_page = append_page(right);
+
+  store<std::uint16_t>(buf.data() + COUNT_POS,
+                       static_cast<std::uint16_t>(left_count));
+  store<std::uint64_t>(buf.data() + NEXT_POS, right_page);
+  std::memcpy(records, all.data(), left_count * record_size);
+  write_page(page, buf);
+
+  KeyType separator;
+  std::memcpy(separator.data(), right.data() + LEAF_HEADER, KEY_SIZE_BYTES);
+  insert_into_parent(path, path.size(), separator, right_page);
+}
+
+void BPlusTree::insert_into_parent(std::vector<std::uint64_t> &path,
+                                   std::size_t level,
+                                   const KeyType &separator,
+                                   std::uint64_t right) {
+  Page buf;
+  if (level == 0) {
+    // the root was split
+    Inner inner{{separator}, {root, right}};
+    encode_inner(inner, buf);
+    root = append_page(buf);
+    ++depth;
+    return;
+  }
+  std::uint64_t page = path[level - 1];
+  read_page(page, buf);
+  Inner inner = decode_inner(buf.data());
+  auto pos = std::upper_bound(inner.keys.begin(), inner.keys.end(), separator);
+  std::size_t index = pos - inner.keys.begin();
+  inner.keys.insert(pos, separator);
+  inner.children.insert(inner.children.begin() + index + 1, right);
+  if (encode_inner(inner, buf)) {
+    write_page(page, buf);
+    return;
+  }
+  // the middle key moves up, each half has a longer common prefix
+  std::size_t mid = inner.keys.size() / 2;
+  Inner left_half{{inner.keys.begin(), inner.keys.begin() + mid},
+                  {inner.children.begin(), inner.children.begin() + mid + 1}};
+  Inner right_half{{inner.keys.begin() + mid + 1, inner.keys.end()},
+                   {inner.children.begin() + mid + 1, inner.children.end()}};
+  encode_inner(left_half, buf);
+  write_page(page, buf);
+  encode_inner(right_half, buf);
+  std::uint64_t right_page = append_page(buf);
+  insert_into_parent(path, level - 1, inner.keys[mid], right_page);
+}
+
+std::optional<std::uint64_t> BPlusTree::find(const KeyType &key) {
+  auto entry = find_entry(key);
+  if (!entry) {
+    return {};
+  }
+  return entry->offset;
+}
+
+std::optional<IndexEntry> BPlusTree::find_entry(const KeyType &key) {
+  Page buf;
+  std::uint64_t page = root;
+  for (std::uint64_t level = 1; level < depth; ++level) {
+    read_page(page, buf);
+    page = child_for(buf.data(), key);
+  }
+  read_page(page, buf);
+  std::size_t count = load<std::uint16_t>(buf.data() + COUNT_POS);
+  std::size_t pos = lower_bound(buf.data(), key);
+  const ByteType *rec = record_at(buf.data(), pos);
+  if (pos == count || std::memcmp(rec, key.data(), KEY_SIZE_BYTES) != 0) {
+    return {};
+  }
+  SSTRecord record = load_record(rec);
+  return IndexEntry{record.offset, record.value};
+}
+
+BPlusTree::iterator::iterator(BPlusTree *owner_, std::uint64_t leaf_)
+    : owner(owner_) {
+  enter_leaf(leaf_);
+}
+
+void BPlusTree::iterator::enter_leaf(std::uint64_t leaf_) {
+  index = 0;
+  while (leaf_ != NULL_PAGE) {
+    std::array<ByteType, LEAF_HEADER> header;
+    owner->pages->read_ptr(header.data(), leaf_ * PAGE_SIZE,
+                           leaf_ * PAGE_SIZE + LEAF_HEADER);
+    count = load<std::uint16_t>(header.data() + COUNT_POS);
+    next = load<std::uint64_t>(header.data() + NEXT_POS);
+    if (count != 0) {
+      leaf = leaf_;
+      return;
+    }
+    leaf_ = next;
+  }
+  leaf = NULL_PAGE;
+}
+
+const BPlusTree::iterator::value_type BPlusTree::iterator::operator*() {
+  std::array<ByteType, KEY_SIZE_BYTES + sizeof(std::uint64_t) +
+                           InlineValue::slot_size(MAX_INLINE_VALUE_SIZE)>
+      rec;
+  std::size_t begin =
+      leaf * PAGE_SIZE + LEAF_HEADER + index * owner->record_size;
+  owner->pages->read_ptr(rec.data(), begin, begin + owner->record_size);
+  return owner->load_record(rec.data());
+}
+
+BPlusTree::iterator &BPlusTree::iterator::operator++() {
+  if (++index == count) {
+    enter_leaf(next);
+  }
+  return *this;
+}
+
+} // namespace kvaaas
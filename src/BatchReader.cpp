@@ -0,0 +1,278 @@
+#include "BatchReader.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <exception>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace kvaaas {
+
+void pread_all(int fd, ByteType *ptr, std::size_t n, std::size_t offset,
+               const std::string &file) {
+  while (n > 0) {
+    ssize_t res = ::pread(fd, ptr, n, static_cast<off_t>(offset));
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      throw std::system_error(res == 0 ? EIO : errno, std::generic_category(),
+                              "pread " + file);
+    }
+    ptr += res;
+    offset += static_cast<std::size_t>(res);
+    n -= static_cast<std::size_t>(res);
+  }
+}
+
+BatchReader &BatchReader::local() {
+  thread_local std::unique_ptr<IoUringReader> ring = IoUringReader::try_create();
+  if (ring) {
+    return *ring;
+  }
+  return ThreadPoolReader::shared();
+}
+
+// IoUringReader
+// liburing is not a dependency, so the rings are set up by hand as described
+// in io_uring_setup(2)
+
+std::unique_ptr<IoUringReader> IoUringReader::try_create() {
+  std::unique_ptr<IoUringReader> reader(new IoUringReader());
+  if (!reader->setup()) {
+    return nullptr;
+  }
+  return reader;
+}
+
+bool IoUringReader::setup() {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+  io_uring_params params{};
+  ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, ENTRIES, &params));
+  if (ring_fd < 0) {
+    return false;
+  }
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+  }
+  sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    sq_ring = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring = sq_ring;
+  } else {
+    cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      cq_ring = nullptr;
+      return false;
+    }
+  }
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    sqes = nullptr;
+    return false;
+  }
+
+  auto *sq = static_cast<char *>(sq_ring);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  auto *cq = static_cast<char *>(cq_ring);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = cq + params.cq_off.cqes;
+
+  // IORING_OP_READ appeared in 5.6, older kernels accept the ring but
+  // fail the request, so probe once with an empty read
+  int probe[2];
+  if (::pipe(probe) == -1) {
+    return false;
+  }
+  ByteType byte{};
+  ::close(probe[1]);
+  bool supported = true;
+  try {
+    PositionalRead empty{probe[0], 0, 0, &byte};
+    submit_and_wait(&empty, 1);
+  } catch (const std::system_error &) {
+    supported = false;
+  }
+  ::close(probe[0]);
+  return supported;
+#else
+  return false;
+#endif
+}
+
+void IoUringReader::read(const std::vector<PositionalRead> &reads) {
+  for (std::size_t done = 0; done < reads.size(); done += ENTRIES) {
+    auto n = static_cast<unsigned>(
+        std::min<std::size_t>(ENTRIES, reads.size() - done));
+    submit_and_wait(reads.data() + done, n);
+  }
+}
+
+void IoUringReader::submit_and_wait(const PositionalRead *reads, unsigned n) {
+  unsigned tail = __atomic_load_n(sq_tail, __ATOMIC_ACQUIRE);
+  for (unsigned i = 0; i < n; ++i) {
+    unsigned index = (tail + i) & *sq_mask;
+    auto *sqe = static_cast<io_uring_sqe *>(sqes) + index;
+    *sqe = io_uring_sqe{};
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = reads[i].fd;
+    sqe->off = reads[i].offset;
+    sqe->addr = reinterpret_cast<std::uint64_t>(reads[i].dst);
+    sqe->len = static_cast<std::uint32_t>(reads[i].n);
+    sqe->user_data = i;
+    sq_array[index] = index;
+  }
+  __atomic_store_n(sq_tail, tail + n, __ATOMIC_RELEASE);
+
+  unsigned submitted = 0;
+  unsigned completed = 0;
+  std::vector<std::size_t> got(n, 0);
+  int first_error = 0;
+  while (completed < n) {
+    long res = ::syscall(__NR_io_uring_enter, ring_fd, n - submitted,
+                         n - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(),
+                              "io_uring_enter");
+    }
+    submitted += static_cast<unsigned>(res);
+
+    unsigned head = __atomic_load_n(cq_head, __ATOMIC_ACQUIRE);
+    unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != ready; ++head, ++completed) {
+      const auto &cqe = static_cast<io_uring_cqe *>(cqes)[head & *cq_mask];
+      if (cqe.res < 0) {
+        first_error = first_error == 0 ? -cqe.res : first_error;
+      } else {
+        got[cqe.user_data] = static_cast<std::size_t>(cqe.res);
+      }
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+  if (first_error != 0) {
+    throw std::system_error(first_error, std::generic_category(),
+                            "io_uring read");
+  }
+
+  // short reads are rare (signals, EOF races), finish them synchronously
+  for (unsigned i = 0; i < n; ++i) {
+    if (got[i] < reads[i].n) {
+      pread_all(reads[i].fd, reads[i].dst + got[i], reads[i].n - got[i],
+                reads[i].offset + got[i], "io_uring short read");
+    }
+  }
+}
+
+IoUringReader::~IoUringReader() {
+  if (sqes != nullptr) {
+    ::munmap(sqes, sqes_size);
+  }
+  if (cq_ring != nullptr && cq_ring != sq_ring) {
+    ::munmap(cq_ring, cq_ring_size);
+  }
+  if (sq_ring != nullptr) {
+    ::munmap(sq_ring, sq_ring_size);
+  }
+  if (ring_fd >= 0) {
+    ::close(ring_fd);
+  }
+}
+
+// ThreadPoolReader
+
+ThreadPoolReader::ThreadPoolReader(std::size_t threads) {
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this] { work(); });
+  }
+}
+
+ThreadPoolReader &ThreadPoolReader::shared() {
+  static ThreadPoolReader pool;
+  return pool;
+}
+
+void ThreadPoolReader::work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mutex);
+      cv.wait(lock, [this] { return stopped || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+void ThreadPoolReader::read(const std::vector<PositionalRead> &reads) {
+  if (reads.empty()) {
+    return;
+  }
+  std::mutex done_mutex;
+  std::condition_variable done_cv;
+  std::size_t remaining = reads.size();
+  std::exception_ptr error;
+  {
+    std::lock_guard lock(mutex);
+    for (const auto &read : reads) {
+      tasks.emplace([&, read] {
+        std::exception_ptr cur;
+        try {
+          pread_all(read.fd, read.dst, read.n, read.offset, "pool read");
+        } catch (...) {
+          cur = std::current_exception();
+        }
+        std::lock_guard done_lock(done_mutex);
+        if (cur && !error) {
+          error = cur;
+        }
+        if (--remaining == 0) {
+          done_cv.notify_one();
+        }
+      });
+    }
+  }
+  cv.notify_all();
+  std::unique_lock done_lock(done_mutex);
+  done_cv.wait(done_lock, [&] { return remaining == 0; });
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ThreadPoolReader::~ThreadPoolReader() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+} // namespace kvaaas
@@ -0,0 +1,227 @@
+#include "BlockCache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace kvaaas {
+
+BlockCache::BlockCache(std::size_t budget_bytes)
+    : budget_bytes(budget_bytes),
+      blocks_per_shard(std::max<std::size_t>(
+          1, budget_bytes / BLOCK_SIZE / SHARDS)) {}
+
+std::uint64_t BlockCache::register_array() { return next_array_id++; }
+
+bool BlockCache::read(std::uint64_t array_id, std::uint64_t block,
+                      std::size_t from, std::size_t n, ByteType *dst,
+                      MemoryPurpose purpose) {
+  BlockKey key{array_id, block};
+  Shard &shard = shard_for(key);
+  {
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      Slot &slot = shard.slots[it->second];
+      slot.referenced = true;
+      std::memcpy(dst, slot.data->bytes.data() + from, n);
+      hits[purpose].fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  misses[purpose].fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void BlockCache::insert(std::uint64_t array_id, std::uint64_t block,
+                        std::unique_ptr<Block> data) {
+  BlockKey key{array_id, block};
+  Shard &shard = shard_for(key);
+  std::lock_guard lock(shard.mutex);
+  if (shard.index.count(key) != 0) {
+    return; // someone was faster
+  }
+  if (shard.slots.size() < blocks_per_shard) {
+    shard.index[key] = shard.slots.size();
+    shard.slots.push_back({key, std::move(data), false});
+    return;
+  }
+  // CLOCK: give referenced blocks a second chance
+  while (shard.slots[shard.hand].referenced) {
+    shard.slots[shard.hand].referenced = false;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+  }
+  Slot &victim = shard.slots[shard.hand];
+  shard.index.erase(victim.key);
+  victim = {key, std::move(data), false};
+  shard.index[key] = shard.hand;
+  shard.hand = (shard.hand + 1) % shard.slots.size();
+}
+
+void BlockCache::update(std::uint64_t array_id, std::uint64_t block,
+                        std::size_t from, const ByteType *bytes,
+                        std::size_t n) {
+  BlockKey key{array_id, block};
+  Shard &shard = shard_for(key);
+  std::lock_guard lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    std::memcpy(shard.slots[it->second].data->bytes.data() + from, bytes, n);
+  }
+}
+
+void BlockCache::drop(std::uint64_t array_id) {
+  for (Shard &shard : shards) {
+    std::lock_guard lock(shard.mutex);
+    auto removed = std::remove_if(
+        shard.slots.begin(), shard.slots.end(),
+        [array_id](const Slot &slot) { return slot.key.array_id == array_id; });
+    if (removed == shard.slots.end()) {
+      continue;
+    }
+    shard.slots.erase(removed, shard.slots.end());
+    shard.index.clear();
+    for (std::size_t i = 0; i < shard.slots.size(); ++i) {
+      shard.index[shard.slots[i].key] = i;
+    }
+    shard.hand = 0;
+  }
+}
+
+BlockCache::Stats BlockCache::stats(MemoryPurpose purpose) const {
+  return {hits[purpose].load(std::memory_order_relaxed),
+          misses[purpose].load(std::memory_order_relaxed)};
+}
+
+// CachedByteArray
+
+CachedByteArray::CachedByteArray(FileBackedByteArrayPtr inner,
+                                 std::shared_ptr<BlockCache> cache,
+                                 MemoryPurpose purpose)
+    : inner(inner), cache(std::move(cache)), purpose(purpose),
+      id(this->cache->register_array()) {}
+
+void CachedByteArray::append(const std::vector<ByteType> &bytes) {
+  inner->append(bytes);
+}
+
+std::vector<ByteType> CachedByteArray::read(std::size_t l, std::size_t r) {
+  std::vector<ByteType> res(r - l);
+  read_ptr(res.data(), l, r);
+  return res;
+}
+
+void CachedByteArray::rewrite(std::size_t begin,
+                              const std::vector<ByteType> &bytes) {
+  rewrite(begin, bytes.data(), bytes.size());
+}
+
+void CachedByteArray::append(const ByteType *bytes, std::size_t n) {
+  inner->append(bytes, n);
+}
+
+ByteType *CachedByteArray::read_ptr(ByteType *ptr, std::size_t l,
+                                    std::size_t r) {
+  constexpr std::size_t BS = BlockCache::BLOCK_SIZE;
+  const std::size_t full_blocks_end = inner->size() / BS * BS;
+  ByteType *dst = ptr;
+  while (l < r) {
+    std::uint64_t block = l / BS;
+    std::size_t from = l % BS;
+    std::size_t n = std::min(r - l, BS - from);
+    if ((block + 1) * BS > full_blocks_end) {
+      // the partial tail block is still growing
+      inner->read_ptr(dst, l, r);
+      break;
+    }
+    if (!cache->read(id, block, from, n, dst, purpose)) {
+      auto data = std::make_unique<BlockCache::Block>();
+      inner->read_ptr(data->bytes.data(), block * BS, (block + 1) * BS);
+      std::memcpy(dst, data->bytes.data() + from, n);
+      cache->insert(id, block, std::move(data));
+    }
+    dst += n;
+    l += n;
+  }
+  return ptr;
+}
+
+void CachedByteArray::rewrite(std::size_t begin, const ByteType *bytes,
+                              std::size_t n) {
+  constexpr std::size_t BS = BlockCache::BLOCK_SIZE;
+  inner->rewrite(begin, bytes, n);
+  std::size_t end = begin + n;
+  while (begin < end) {
+    std::size_t from = begin % BS;
+    std::size_t len = std::min(end - begin, BS - from);
+    cache->update(id, begin / BS, from, bytes, len);
+    bytes += len;
+    begin += len;
+  }
+}
+
+ByteView CachedByteArray::view(std::size_t l, std::size_t r) {
+  if (l >= inner->size() / BlockCache::BLOCK_SIZE * BlockCache::BLOCK_SIZE) {
+    return inner->view(l, r);
+  }
+  return ByteArray::view(l, r);
+}
+
+void CachedByteArray::read_batch(const std::vector<ReadRequest> &requests) {
+  constexpr std::size_t BS = BlockCache::BLOCK_SIZE;
+  const std::size_t full_blocks_end = inner->size() / BS * BS;
+  // a piece of a request waiting for loaded[index]
+  struct Miss {
+    std::size_t index;
+    std::size_t from;
+    std::size_t n;
+    ByteType *dst;
+  };
+  std::vector<Miss> misses;
+  std::vector<std::uint64_t> blocks;
+  std::vector<std::unique_ptr<BlockCache::Block>> loaded;
+  std::unordered_map<std::uint64_t, std::size_t> index_of;
+  std::vector<ReadRequest> reads;
+  for (const auto &req : requests) {
+    std::size_t l = req.l;
+    ByteType *dst = req.dst;
+    while (l < req.r) {
+      std::uint64_t block = l / BS;
+      std::size_t from = l % BS;
+      std::size_t n = std::min(req.r - l, BS - from);
+      if ((block + 1) * BS > full_blocks_end) {
+        // the partial tail block is still growing
+        reads.push_back({l, req.r, dst});
+        break;
+      }
+      if (!cache->read(id, block, from, n, dst, purpose)) {
+        auto [it, fresh] = index_of.try_emplace(block, loaded.size());
+        if (fresh) {
+          blocks.push_back(block);
+          loaded.push_back(std::make_unique<BlockCache::Block>());
+          reads.push_back(
+              {block * BS, (block + 1) * BS, loaded.back()->bytes.data()});
+        }
+        misses.push_back({it->second, from, n, dst});
+      }
+      dst += n;
+      l += n;
+    }
+  }
+  inner->read_batch(reads);
+  for (const auto &miss : misses) {
+    std::memcpy(miss.dst, loaded[miss.index]->bytes.data() + miss.from,
+                miss.n);
+  }
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    cache->insert(id, blocks[i], std::move(loaded[i]));
+  }
+}
+
+std::size_t CachedByteArray::size() { return inner->size(); }
+
+void CachedByteArray::flush() { inner->flush(); }
+
+void CachedByteArray::sync() { inner->sync(); }
+
+CachedByteArray::~CachedByteArray() { cache->drop(id); }
+
+} // namespace kvaaas
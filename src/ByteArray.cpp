@@ -1,98 +1,546 @@
 #include "ByteArray.h"
+#include "BatchReader.h"
 #include "Core.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
+#include <fcntl.h>
 #include <filesystem>
-#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
 
 namespace kvaaas {
 
+void ByteView::steal(ByteView &oth) noexcept {
+  len = oth.len;
+  pins = oth.pins;
+  if (oth.ptr == oth.inline_buf.data()) {
+    inline_buf = oth.inline_buf;
+    ptr = inline_buf.data();
+  } else {
+    heap_buf = std::move(oth.heap_buf);
+    ptr = oth.ptr;
+  }
+  oth.ptr = nullptr;
+  oth.len = 0;
+  oth.pins = nullptr;
+}
+
+ByteView::ByteView(ByteView &&oth) noexcept { steal(oth); }
+
+ByteView &ByteView::operator=(ByteView &&oth) noexcept {
+  if (this != &oth) {
+    if (pins != nullptr) {
+      pins->fetch_sub(1, std::memory_order_release);
+    }
+    steal(oth);
+  }
+  return *this;
+}
+
+ByteView::~ByteView() {
+  if (pins != nullptr) {
+    pins->fetch_sub(1, std::memory_order_release);
+  }
+}
+
+ByteView ByteView::borrowed(const ByteType *ptr, std::size_t n,
+                            std::atomic<std::size_t> *pins) {
+  ByteView res;
+  res.ptr = ptr;
+  res.len = n;
+  res.pins = pins;
+  if (pins != nullptr) {
+    pins->fetch_add(1, std::memory_order_acquire);
+  }
+  return res;
+}
+
+ByteView ByteView::copied(std::size_t n) {
+  ByteView res;
+  if (n <= INLINE_SIZE) {
+    res.ptr = res.inline_buf.data();
+  } else {
+    res.heap_buf.resize(n);
+    res.ptr = res.heap_buf.data();
+  }
+  res.len = n;
+  return res;
+}
+
+ByteView ByteArray::view(std::size_t l, std::size_t r) {
+  ByteView res = ByteView::copied(r - l);
+  read_ptr(res.storage(), l, r);
+  return res;
+}
+
+void ByteArray::read_batch(const std::vector<ReadRequest> &requests) {
+  for (const auto &req : requests) {
+    read_ptr(req.dst, req.l, req.r);
+  }
+}
+
+RAMByteArray::RAMByteArray(std::size_t chunk_size, bool huge_pages)
+    : chunk_size(chunk_size), huge_pages(huge_pages) {}
+
+void RAMByteArray::add_chunk() {
+  if (huge_pages) {
+    // THP only backs huge-page-aligned ranges and mmap aligns to a page,
+    // so the chunk is cut out of a larger mapping
+    constexpr std::size_t ALIGN = HUGE_PAGE_CHUNK_SIZE;
+    std::size_t mapped_size = chunk_size + ALIGN;
+    void *addr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    auto begin = reinterpret_cast<std::uintptr_t>(addr);
+    std::uintptr_t aligned = (begin + ALIGN - 1) & ~(ALIGN - 1);
+    if (aligned != begin) {
+      ::munmap(addr, aligned - begin);
+    }
+    std::size_t tail = begin + mapped_size - (aligned + chunk_size);
+    if (tail != 0) {
+      ::munmap(reinterpret_cast<void *>(aligned + chunk_size), tail);
+    }
+    auto *chunk = reinterpret_cast<ByteType *>(aligned);
+#ifdef MADV_HUGEPAGE
+    // only a hint, chunks smaller than a huge page simply stay small
+    ::madvise(chunk, chunk_size, MADV_HUGEPAGE);
+#endif
+    chunks.push_back(chunk);
+  } else {
+    chunks.push_back(new ByteType[chunk_size]);
+  }
+}
+
+// calls f(chunk data, position in [l, r), piece length) chunk by chunk
+template <typename F>
+void RAMByteArray::for_each_piece(std::size_t l, std::size_t r, F f) {
+  std::size_t done = 0;
+  while (l < r) {
+    std::size_t in_chunk = l % chunk_size;
+    std::size_t n = std::min(r - l, chunk_size - in_chunk);
+    f(chunks[l / chunk_size] + in_chunk, done, n);
+    done += n;
+    l += n;
+  }
+}
+
 void RAMByteArray::append(const std::vector<ByteType> &bytes) {
-  byte_array.insert(byte_array.end(), bytes.begin(), bytes.end());
+  append(bytes.data(), bytes.size());
 }
 
 void RAMByteArray::rewrite(std::size_t begin,
                            const std::vector<ByteType> &bytes) {
-  for (std::size_t i = 0; i < bytes.size(); ++i) {
-    byte_array[begin + i] = bytes[i];
-  }
+  rewrite(begin, bytes.data(), bytes.size());
 }
 
 std::vector<ByteType> RAMByteArray::read(std::size_t l, std::size_t r) {
-  return {byte_array.begin() + l, byte_array.begin() + r};
+  std::vector<ByteType> res(r - l);
+  read_ptr(res.data(), l, r);
+  return res;
 }
 
 void RAMByteArray::append(const ByteType *bytes, std::size_t n) {
-  byte_array.insert(byte_array.end(), bytes, bytes + n);
+  while (chunks.size() * chunk_size < used + n) {
+    add_chunk();
+  }
+  for_each_piece(used, used + n,
+                 [bytes](ByteType *chunk, std::size_t pos, std::size_t len) {
+                   std::memcpy(chunk, bytes + pos, len);
+                 });
+  used += n;
 }
 
 ByteType *RAMByteArray::read_ptr(ByteType *ptr, std::size_t l, std::size_t r) {
-  std::memcpy(ptr, byte_array.data() + l, r - l);
+  for_each_piece(l, r,
+                 [ptr](ByteType *chunk, std::size_t pos, std::size_t len) {
+                   std::memcpy(ptr + pos, chunk, len);
+                 });
   return ptr;
 }
 
 void RAMByteArray::rewrite(std::size_t begin, const ByteType *bytes,
                            std::size_t n) {
-  for (std::size_t i = 0; i < n; ++i) {
-    byte_array[begin + i] = bytes[i];
+  for_each_piece(begin, begin + n,
+                 [bytes](ByteType *chunk, std::size_t pos, std::size_t len) {
+                   std::memcpy(chunk, bytes + pos, len);
+                 });
+}
+
+ByteView RAMByteArray::view(std::size_t l, std::size_t r) {
+  if (l == r || l / chunk_size == (r - 1) / chunk_size) {
+    return ByteView::borrowed(
+        l == r ? nullptr : chunks[l / chunk_size] + l % chunk_size, r - l);
   }
+  return ByteArray::view(l, r);
 }
 
-std::size_t RAMByteArray::size() { return byte_array.size(); }
+std::size_t RAMByteArray::size() { return used; }
 
-FileByteArray::FileByteArray(const std::string &s, bool withRAII)
-    : underlying_file(s), RAII(withRAII) {
-  if (std::filesystem::exists(s) && !RAII) {
-    data.open(s, std::fstream::ate | std::fstream::binary | std::fstream ::in |
-                     std::fstream::out);
-  } else {
-    data.open(s, std::fstream::trunc | std::fstream::binary |
-                     std::fstream ::in | std::fstream::out);
+RAMByteArray::~RAMByteArray() {
+  for (ByteType *chunk : chunks) {
+    if (huge_pages) {
+      ::munmap(chunk, chunk_size);
+    } else {
+      delete[] chunk;
+    }
+  }
+}
+
+namespace {
+
+void pwrite_all(int fd, const ByteType *ptr, std::size_t n, std::size_t offset,
+                const std::string &file) {
+  while (n > 0) {
+    ssize_t res = ::pwrite(fd, ptr, n, static_cast<off_t>(offset));
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res == -1) {
+      throw std::system_error(errno, std::generic_category(),
+                              "pwrite " + file);
+    }
+    ptr += res;
+    offset += static_cast<std::size_t>(res);
+    n -= static_cast<std::size_t>(res);
+  }
+}
+
+void write_all(int fd, const ByteType *ptr, std::size_t n,
+               const std::string &file) {
+  while (n > 0) {
+    ssize_t res = ::write(fd, ptr, n);
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res == -1) {
+      throw std::system_error(errno, std::generic_category(), "write " + file);
+    }
+    ptr += res;
+    n -= static_cast<std::size_t>(res);
   }
 }
 
+} // namespace
+
+FileByteArray::FileByteArray(const std::string &s, bool withRAII,
+                             std::size_t append_buffer,
+                             FileArrayOptions file_opt)
+    : grow_step(file_opt.grow_step), buffer_capacity(append_buffer),
+      underlying_file(s), RAII(withRAII) {
+  int flags = O_RDWR | O_CREAT;
+  if (RAII) {
+    flags |= O_TRUNC;
+  }
+  fd = ::open(s.c_str(), flags, 0644);
+  if (fd == -1) {
+    throw std::system_error(errno, std::generic_category(), "open " + s);
+  }
+  append_fd = ::open(s.c_str(), O_WRONLY | O_APPEND);
+  struct stat st {};
+  if (append_fd == -1 || ::fstat(fd, &st) == -1) {
+    int err = errno;
+    ::close(fd);
+    if (append_fd != -1) {
+      ::close(append_fd);
+    }
+    throw std::system_error(err, std::generic_category(), "open " + s);
+  }
+  auto file_size = static_cast<std::size_t>(st.st_size);
+  if (file_opt.logical_size && *file_opt.logical_size < file_size) {
+    // appends go to the end of the file, so the garbage tail has to go
+    file_size = *file_opt.logical_size;
+    if (::ftruncate(fd, static_cast<off_t>(file_size)) == -1) {
+      int err = errno;
+      ::close(fd);
+      ::close(append_fd);
+      throw std::system_error(err, std::generic_category(), "ftruncate " + s);
+    }
+  }
+  used.store(file_size, std::memory_order_release);
+  flushed.store(file_size, std::memory_order_release);
+  allocated = file_size;
+  buffer.reserve(buffer_capacity);
+}
+
+// Reserves whole grow steps past EOF. FALLOC_FL_KEEP_SIZE leaves st_size
+// equal to the logical size, so O_APPEND keeps working and a reopen needs
+// no extra bookkeeping.
+void FileByteArray::preallocate(std::size_t end) {
+  if (grow_step == 0 || end <= allocated) {
+    return;
+  }
+  std::size_t new_allocated = (end + grow_step - 1) / grow_step * grow_step;
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(allocated),
+                  static_cast<off_t>(new_allocated - allocated)) == 0) {
+    allocated = new_allocated;
+    return;
+  }
+#endif
+  grow_step = 0; // the filesystem can not do it, grow as written
+}
+
 void FileByteArray::append(const std::vector<ByteType> &bytes) {
-  data.write(
-      reinterpret_cast<const char *>(bytes.data()),
-      bytes.size()); /// TODO Где-то здесь потенциально много ошибок вылетает
+  append(bytes.data(), bytes.size());
 }
 
 std::vector<ByteType> FileByteArray::read(std::size_t l, std::size_t r) {
-  data.seekp(l); /// -_-
   std::vector<ByteType> byte_array(r - l);
-  data.read(reinterpret_cast<char *>(byte_array.data()), r - l);
-  data.seekp(0, std::fstream::end);
+  read_ptr(byte_array.data(), l, r);
   return byte_array;
 }
 
 void FileByteArray::rewrite(std::size_t begin,
                             const std::vector<ByteType> &bytes) {
-  data.seekp(begin);
-  data.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
-  data.seekp(0, std::fstream::end);
+  rewrite(begin, bytes.data(), bytes.size());
 }
 
 void FileByteArray::append(const ByteType *bytes, std::size_t n) {
-  data.write(reinterpret_cast<const char *>(bytes), n);
+  std::lock_guard lock(buffer_mutex);
+  if (buffer.size() + n > buffer_capacity) {
+    flush_locked();
+  }
+  if (n >= buffer_capacity) {
+    preallocate(flushed.load(std::memory_order_relaxed) + n);
+    write_all(append_fd, bytes, n, underlying_file);
+    flushed.fetch_add(n, std::memory_order_release);
+  } else {
+    buffer.insert(buffer.end(), bytes, bytes + n);
+  }
+  used.fetch_add(n, std::memory_order_release);
 }
 
 ByteType *FileByteArray::read_ptr(ByteType *ptr, std::size_t l, std::size_t r) {
-  data.seekp(l);
-  data.read(reinterpret_cast<char *>(ptr), r - l);
-  data.seekp(0, std::fstream::end);
+  if (r <= flushed.load(std::memory_order_acquire)) {
+    pread_all(fd, ptr, r - l, l, underlying_file);
+    return ptr;
+  }
+  std::lock_guard lock(buffer_mutex);
+  // a flush may have moved the whole range to disk since the check above
+  std::size_t on_disk = flushed.load(std::memory_order_relaxed);
+  if (l < on_disk) {
+    pread_all(fd, ptr, std::min(r, on_disk) - l, l, underlying_file);
+  }
+  std::size_t from = std::max(l, on_disk);
+  if (from < r) {
+    std::memcpy(ptr + (from - l), buffer.data() + (from - on_disk), r - from);
+  }
   return ptr;
 }
 
 void FileByteArray::rewrite(std::size_t begin, const ByteType *bytes,
                             std::size_t n) {
-  data.seekp(begin);
-  data.write(reinterpret_cast<const char *>(bytes), n);
-  data.seekp(0, std::fstream::end);
+  if (begin + n <= flushed.load(std::memory_order_acquire)) {
+    pwrite_all(fd, bytes, n, begin, underlying_file);
+    return;
+  }
+  std::lock_guard lock(buffer_mutex);
+  std::size_t on_disk = flushed.load(std::memory_order_relaxed);
+  if (begin < on_disk) {
+    pwrite_all(fd, bytes, std::min(begin + n, on_disk) - begin, begin,
+               underlying_file);
+  }
+  std::size_t from = std::max(begin, on_disk);
+  if (from < begin + n) {
+    std::memcpy(buffer.data() + (from - on_disk), bytes + (from - begin),
+                begin + n - from);
+  }
+}
+
+void FileByteArray::read_batch(const std::vector<ReadRequest> &requests) {
+  std::size_t on_disk = flushed.load(std::memory_order_acquire);
+  std::vector<PositionalRead> reads;
+  reads.reserve(requests.size());
+  for (const auto &req : requests) {
+    if (req.r <= on_disk) {
+      reads.push_back({fd, req.l, req.r - req.l, req.dst});
+    } else {
+      read_ptr(req.dst, req.l, req.r);
+    }
+  }
+  BatchReader::local().read(reads);
+}
+
+std::size_t FileByteArray::size() {
+  return used.load(std::memory_order_acquire);
+}
+
+void FileByteArray::flush_locked() {
+  if (buffer.empty()) {
+    return;
+  }
+  preallocate(flushed.load(std::memory_order_relaxed) + buffer.size());
+  write_all(append_fd, buffer.data(), buffer.size(), underlying_file);
+  flushed.fetch_add(buffer.size(), std::memory_order_release);
+  buffer.clear();
+}
+
+void FileByteArray::flush() {
+  std::lock_guard lock(buffer_mutex);
+  flush_locked();
 }
 
-std::size_t FileByteArray::size() { return data.tellp(); }
+void FileByteArray::sync() {
+  flush();
+  if (::fdatasync(fd) == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "fdatasync " + underlying_file);
+  }
+}
 
 FileByteArray::~FileByteArray() {
-  data.close();
+  try {
+    flush_locked();
+  } catch (const std::system_error &) {
+    // lost as in a crash, owners that care flush first (see
+    // MemoryManager::flush)
+  }
+#ifdef FALLOC_FL_PUNCH_HOLE
+  std::size_t end = flushed.load(std::memory_order_relaxed);
+  if (allocated > end && !RAII) {
+    // give the unused reservation back
+    ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                static_cast<off_t>(end), static_cast<off_t>(allocated - end));
+  }
+#endif
+  ::close(append_fd);
+  ::close(fd);
+  if (RAII) {
+    std::remove(underlying_file.c_str());
+  }
+}
+
+MmapByteArray::MmapByteArray(const std::string &s, bool withRAII,
+                             FileArrayOptions file_opt)
+    : grow_step(file_opt.grow_step), underlying_file(s), RAII(withRAII) {
+  int flags = O_RDWR | O_CREAT;
+  if (RAII) {
+    flags |= O_TRUNC;
+  }
+  fd = ::open(s.c_str(), flags, 0644);
+  if (fd == -1) {
+    throw std::system_error(errno, std::generic_category(), "open " + s);
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) == -1) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "fstat " + s);
+  }
+  auto file_size = static_cast<std::size_t>(st.st_size);
+  if (file_opt.logical_size) {
+    // the tail past it is mapping slack of an unclean close
+    file_size = std::min(file_size, *file_opt.logical_size);
+  }
+  used.store(file_size, std::memory_order_relaxed);
+  reserve(std::max(file_size, MIN_CAPACITY));
+}
+
+void MmapByteArray::reserve(std::size_t new_capacity) {
+  if (new_capacity <= capacity) {
+    return;
+  }
+  // a remap would leave borrowed views dangling
+  if (active_views.load() != 0) {
+    throw std::runtime_error("cannot grow " + underlying_file +
+                             " while views of it are alive");
+  }
+  // Writes into a sparse hole of a mapping raise SIGBUS on ENOSPC, real
+  // extents turn that into an exception here
+  bool allocated = false;
+#ifdef __linux__
+  if (grow_step != 0) {
+    allocated = ::fallocate(fd, 0, static_cast<off_t>(capacity),
+                            static_cast<off_t>(new_capacity - capacity)) == 0;
+  }
+#endif
+  if (!allocated && ::ftruncate(fd, static_cast<off_t>(new_capacity)) == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "ftruncate " + underlying_file);
+  }
+  void *addr = MAP_FAILED;
+#ifdef __linux__
+  if (mapped != nullptr) {
+    addr = ::mremap(mapped, capacity, new_capacity, MREMAP_MAYMOVE);
+  } else {
+    addr = ::mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  }
+#else
+  if (mapped != nullptr) {
+    ::munmap(mapped, capacity);
+  }
+  addr =
+      ::mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+  if (addr == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(),
+                            "mmap " + underlying_file);
+  }
+  mapped = static_cast<ByteType *>(addr);
+  capacity = new_capacity;
+}
+
+void MmapByteArray::append(const std::vector<ByteType> &bytes) {
+  append(bytes.data(), bytes.size());
+}
+
+std::vector<ByteType> MmapByteArray::read(std::size_t l, std::size_t r) {
+  return {mapped + l, mapped + r};
+}
+
+void MmapByteArray::rewrite(std::size_t begin,
+                            const std::vector<ByteType> &bytes) {
+  rewrite(begin, bytes.data(), bytes.size());
+}
+
+void MmapByteArray::append(const ByteType *bytes, std::size_t n) {
+  std::size_t end = used.load(std::memory_order_relaxed);
+  if (end + n > capacity) {
+    reserve(std::max({end + n, capacity * 2, capacity + grow_step}));
+  }
+  std::memcpy(mapped + end, bytes, n);
+  used.store(end + n, std::memory_order_release);
+}
+
+ByteType *MmapByteArray::read_ptr(ByteType *ptr, std::size_t l, std::size_t r) {
+  std::memcpy(ptr, mapped + l, r - l);
+  return ptr;
+}
+
+void MmapByteArray::rewrite(std::size_t begin, const ByteType *bytes,
+                            std::size_t n) {
+  std::memcpy(mapped + begin, bytes, n);
+}
+
+ByteView MmapByteArray::view(std::size_t l, std::size_t r) {
+  return ByteView::borrowed(mapped + l, r - l, &active_views);
+}
+
+std::size_t MmapByteArray::size() {
+  return used.load(std::memory_order_acquire);
+}
+
+void MmapByteArray::sync() {
+  if (::msync(mapped, capacity, MS_SYNC) == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "msync " + underlying_file);
+  }
+}
+
+MmapByteArray::~MmapByteArray() {
+  ::munmap(mapped, capacity);
+  // drop the preallocated tail, so the file size is the logical size again
+  [[maybe_unused]] int res = ::ftruncate(fd, static_cast<off_t>(used.load()));
+  ::close(fd);
   if (RAII) {
     std::remove(underlying_file.c_str());
   }
@@ -0,0 +1,316 @@
+#include "Compressor.h"
+#include "../libs/zstd/zdict.h"
+#include "../libs/zstd/zstd.h"
+#include <cassert>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace kvaaas {
+
+namespace {
+ZSTD_CCtx *as_cctx(void *p) { return static_cast<ZSTD_CCtx *>(p); }
+ZSTD_DCtx *as_dctx(void *p) { return static_cast<ZSTD_DCtx *>(p); }
+ZSTD_CDict *as_cdict(void *p) { return static_cast<ZSTD_CDict *>(p); }
+ZSTD_DDict *as_ddict(void *p) { return static_cast<ZSTD_DDict *>(p); }
+} // namespace
+
+std::unique_ptr<CompressionPolicy>
+CompressionPolicy::create(const CompressionOptions &opt) {
+  switch (opt.mode) {
+  case CompressionMode::None:
+    return std::make_unique<FixedLevelPolicy>(std::nullopt);
+  case CompressionMode::Fixed:
+    return std::make_unique<FixedLevelPolicy>(opt.level);
+  case CompressionMode::Fast:
+    return std::make_unique<FixedLevelPolicy>(FAST_LEVEL);
+  case CompressionMode::High:
+    return std::make_unique<FixedLevelPolicy>(HIGH_LEVEL);
+  case CompressionMode::Adaptive:
+    return std::make_unique<AdaptivePolicy>(opt.level, opt.latency_budget);
+  }
+  assert(false);
+  return nullptr;
+}
+
+AdaptivePolicy::AdaptivePolicy(int max_level_,
+                               std::chrono::nanoseconds budget_per_kib)
+    : max_level(max_level_), budget(budget_per_kib), cur_level(max_level_) {}
+
+std::optional<int> AdaptivePolicy::choose(std::size_t) {
+  if (skipping() && ++skipped % PROBE_EVERY != 0) {
+    return std::nullopt;
+  }
+  return cur_level;
+}
+
+void AdaptivePolicy::observe(std::size_t n, std::size_t compressed,
+                             std::chrono::nanoseconds took) {
+  if (n == 0) {
+    return;
+  }
+  double sample = static_cast<double>(compressed) / static_cast<double>(n);
+  ratio += (sample - ratio) / 16;
+  took_total += took;
+  bytes_total += n;
+  if (++observed < ADJUST_EVERY) {
+    return;
+  }
+  auto per_kib = took_total * 1024 / bytes_total;
+  // zstd has no level 0, it means the default one
+  if (per_kib > budget && cur_level > MIN_LEVEL) {
+    cur_level = cur_level == 1 ? -1 : cur_level - 1;
+  } else if (per_kib < budget / 2 && cur_level < max_level) {
+    cur_level = cur_level == -1 ? 1 : cur_level + 1;
+  }
+  observed = 0;
+  took_total = std::chrono::nanoseconds{0};
+  bytes_total = 0;
+}
+
+Compressor::Compressor(CompressionOptions opt_)
+    : opt(opt_), policy(CompressionPolicy::create(opt_)),
+      cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {
+  assert(cctx != nullptr && dctx != nullptr);
+}
+
+Compressor::Compressor(Compressor &&oth) noexcept
+    : opt(oth.opt), policy(std::move(oth.policy)),
+      cctx(std::exchange(oth.cctx, nullptr)),
+      dctx(std::exchange(oth.dctx, nullptr)),
+      dict_id(std::exchange(oth.dict_id, 0)), dict(std::move(oth.dict)),
+      cdicts(std::move(oth.cdicts)), ddicts(std::move(oth.ddicts)) {
+  oth.cdicts.clear();
+  oth.ddicts.clear();
+}
+
+Compressor &Compressor::operator=(Compressor &&oth) noexcept {
+  std::swap(opt, oth.opt);
+  std::swap(policy, oth.policy);
+  std::swap(cctx, oth.cctx);
+  std::swap(dctx, oth.dctx);
+  std::swap(dict_id, oth.dict_id);
+  std::swap(dict, oth.dict);
+  std::swap(cdicts, oth.cdicts);
+  std::swap(ddicts, oth.ddicts);
+  return *this;
+}
+
+Compressor::~Compressor() {
+  free_dictionaries();
+  ZSTD_freeCCtx(as_cctx(cctx));
+  ZSTD_freeDCtx(as_dctx(dctx));
+}
+
+void Compressor::free_cdicts() noexcept {
+  for (auto [level, cdict] : cdicts) {
+    ZSTD_freeCDict(as_cdict(cdict));
+  }
+  cdicts.clear();
+}
+
+void Compressor::free_dictionaries() noexcept {
+  free_cdicts();
+  for (auto [id, ddict] : ddicts) {
+    ZSTD_freeDDict(as_ddict(ddict));
+  }
+  ddicts.clear();
+}
+
+void *Compressor::cdict_for(int level) {
+  auto &cdict = cdicts[level];
+  if (cdict == nullptr) {
+    cdict = ZSTD_createCDict(dict.data(), dict.size(), level);
+  }
+  return cdict;
+}
+
+Compressor &Compressor::local() {
+  thread_local Compressor compressor;
+  return compressor;
+}
+
+std::size_t Compressor::bound(std::size_t n) { return ZSTD_compressBound(n); }
+
+std::size_t Compressor::compress(ByteType *dst, std::size_t capacity,
+                                 const ByteType *src, std::size_t n) {
+  if (!should_compress(n)) {
+    return 0;
+  }
+  std::optional<int> level = policy->choose(n);
+  if (!level) {
+    return 0;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::size_t size =
+      dict_id != 0
+          ? ZSTD_compress_usingCDict(as_cctx(cctx), dst, capacity, src, n,
+                                     as_cdict(cdict_for(*level)))
+          : ZSTD_compressCCtx(as_cctx(cctx), dst, capacity, src, n, *level);
+  bool shrunk = !ZSTD_isError(size) && size < n;
+  policy->observe(n, shrunk ? size : n,
+                  std::chrono::steady_clock::now() - start);
+  return shrunk ? size : 0;
+}
+
+void Compressor::decompress(ByteType *dst, std::size_t n, const ByteType *src,
+                            std::size_t compressed_n) {
+  unsigned id = ZSTD_getDictID_fromFrame(src, compressed_n);
+  std::size_t size;
+  if (id == 0) {
+    size = ZSTD_decompressDCtx(as_dctx(dctx), dst, n, src, compressed_n);
+  } else {
+    auto it = ddicts.find(id);
+    if (it == ddicts.end()) {
+      throw std::runtime_error("record needs unknown dictionary " +
+                               std::to_string(id));
+    }
+    size = ZSTD_decompress_usingDDict(as_dctx(dctx), dst, n, src,
+                                      compressed_n, as_ddict(it->second));
+  }
+  if (ZSTD_isError(size)) {
+    throw std::runtime_error(std::string("cannot decompress record: ") +
+                             ZSTD_getErrorName(size));
+  }
+  if (size != n) {
+    throw std::runtime_error("record decompressed to " +
+                             std::to_string(size) + " bytes instead of " +
+                             std::to_string(n));
+  }
+}
+
+std::vector<ByteType>
+Compressor::train_dictionary(const std::vector<ValueType> &samples,
+                             std::size_t dict_size) {
+  std::vector<ByteType> joined;
+  std::vector<std::size_t> sizes;
+  sizes.reserve(samples.size());
+  for (const auto &sample : samples) {
+    joined.insert(joined.end(), sample.begin(), sample.end());
+    sizes.push_back(sample.size());
+  }
+  std::vector<ByteType> trained(dict_size);
+  std::size_t size =
+      ZDICT_trainFromBuffer(trained.data(), trained.size(), joined.data(),
+                            sizes.data(), static_cast<unsigned>(sizes.size()));
+  if (ZDICT_isError(size)) {
+    return {};
+  }
+  trained.resize(size);
+  return trained;
+}
+
+unsigned Compressor::add_dictionary(std::vector<ByteType> new_dict) {
+  unsigned id = ZDICT_getDictID(new_dict.data(), new_dict.size());
+  if (id == 0) {
+    return 0;
+  }
+  if (ddicts.count(id) == 0) {
+    ddicts[id] = ZSTD_createDDict(new_dict.data(), new_dict.size());
+  }
+  free_cdicts();
+  dict_id = id;
+  dict = std::move(new_dict);
+  return id;
+}
+
+void Compressor::retain_only_current() {
+  for (auto it = ddicts.begin(); it != ddicts.end();) {
+    if (it->first == dict_id) {
+      ++it;
+    } else {
+      ZSTD_freeDDict(as_ddict(it->second));
+      it = ddicts.erase(it);
+    }
+  }
+}
+
+void DictionarySampler::offer(const ValueType &value) {
+  if (value.size() > MAX_SAMPLE_SIZE) {
+    return;
+  }
+  ++seen;
+  if (reservoir.size() < MAX_SAMPLES) {
+    reservoir.push_back(value);
+    return;
+  }
+  std::size_t pos = rnd() % seen;
+  if (pos < MAX_SAMPLES) {
+    reservoir[pos] = value;
+  }
+}
+
+std::size_t DictionarySampler::sampled_bytes() const noexcept {
+  return std::accumulate(
+      reservoir.begin(), reservoir.end(), std::size_t{0},
+      [](std::size_t sum, const ValueType &v) { return sum + v.size(); });
+}
+
+CompressionPool::CompressionPool(CompressionOptions opt_, std::size_t threads)
+    : opt(opt_) {
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([this] { work(); });
+  }
+}
+
+void CompressionPool::set_dictionary(std::vector<ByteType> new_dict) {
+  std::lock_guard lock(mutex);
+  dict = std::make_shared<const std::vector<ByteType>>(std::move(new_dict));
+}
+
+std::future<CompressedValue> CompressionPool::submit(const ValueType &value) {
+  std::future<CompressedValue> res;
+  {
+    std::lock_guard lock(mutex);
+    tasks.push(Task{&value, dict, {}});
+    res = tasks.back().result.get_future();
+  }
+  cv.notify_one();
+  return res;
+}
+
+void CompressionPool::work() {
+  // the policy and dictionaries of every worker are its own
+  Compressor comp(opt);
+  Dictionary held;
+  while (true) {
+    Task task{};
+    {
+      std::unique_lock lock(mutex);
+      cv.wait(lock, [this] { return stopped || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    try {
+      if (task.dict != held) {
+        comp.add_dictionary(*task.dict);
+        comp.retain_only_current();
+        held = task.dict;
+      }
+      const ValueType &value = *task.value;
+      CompressedValue out(Compressor::bound(value.size()));
+      out.resize(
+          comp.compress(out.data(), out.size(), value.data(), value.size()));
+      task.result.set_value(std::move(out));
+    } catch (...) {
+      task.result.set_exception(std::current_exception());
+    }
+  }
+}
+
+CompressionPool::~CompressionPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+} // namespace kvaaas
@@ -0,0 +1,153 @@
+#include "ConcurrentSkipList.h"
+#include <cstring>
+#include <new>
+#include <random>
+#include <tuple>
+
+namespace kvaaas {
+
+void *ConcurrentArena::allocate(std::size_t n) {
+  n = (n + 7) & ~std::size_t{7};
+  allocated.fetch_add(n, std::memory_order_relaxed);
+  if (n > BLOCK_SIZE / 4) {
+    // a block of its own, the current one keeps serving small allocations
+    std::lock_guard lock(grow_mutex);
+    blocks.push_back(std::make_unique<Block>(n));
+    return blocks.back()->data.get();
+  }
+  while (true) {
+    Block *block = current.load(std::memory_order_acquire);
+    if (block != nullptr) {
+      std::size_t begin = block->used.fetch_add(n, std::memory_order_relaxed);
+      if (begin + n <= block->size) {
+        return block->data.get() + begin;
+      }
+    }
+    std::lock_guard lock(grow_mutex);
+    // only the first thread to see the block full replaces it
+    if (current.load(std::memory_order_relaxed) == block) {
+      blocks.push_back(std::make_unique<Block>(BLOCK_SIZE));
+      current.store(blocks.back().get(), std::memory_order_release);
+    }
+  }
+}
+
+ConcurrentSkipList::ConcurrentSkipList()
+    : head(new_node(KeyType{}, nullptr, MAX_HEIGHT)) {}
+
+ConcurrentSkipList::Node *ConcurrentSkipList::new_node(const KeyType &key,
+                                                       const IndexEntry *entry,
+                                                       int height) {
+  void *mem =
+      arena.allocate(sizeof(Node) + height * sizeof(std::atomic<Node *>));
+  Node *node = ::new (mem) Node{key, {entry}};
+  for (int level = 0; level < height; ++level) {
+    ::new (&node->link(level)) std::atomic<Node *>(nullptr);
+  }
+  return node;
+}
+
+const IndexEntry *ConcurrentSkipList::new_entry(const IndexEntry &entry) {
+  return ::new (arena.allocate(sizeof(IndexEntry))) IndexEntry(entry);
+}
+
+// level h is reached with probability 4^-h
+int ConcurrentSkipList::random_height() {
+  thread_local std::minstd_rand rng{std::random_device{}()};
+  int height = 1;
+  while (height < MAX_HEIGHT && rng() % 4 == 0) {
+    ++height;
+  }
+  return height;
+}
+
+std::pair<ConcurrentSkipList::Node *, ConcurrentSkipList::Node *>
+ConcurrentSkipList::find_splice(const KeyType &key, Node *from, int level) {
+  while (true) {
+    Node *next = from->link(level).load(std::memory_order_acquire);
+    if (next == nullptr ||
+        std::memcmp(next->key.data(), key.data(), KEY_SIZE_BYTES) >= 0) {
+      return {from, next};
+    }
+    from = next;
+  }
+}
+
+void ConcurrentSkipList::put(const KeyType &key, std::uint64_t offset) {
+  put(key, IndexEntry{offset});
+}
+
+void ConcurrentSkipList::put(const KeyType &key, const IndexEntry &entry) {
+  const IndexEntry *stored = new_entry(entry);
+  Node *preds[MAX_HEIGHT];
+  Node *succs[MAX_HEIGHT];
+  int list_height = height.load(std::memory_order_relaxed);
+  Node *from = head;
+  for (int level = MAX_HEIGHT - 1; level >= 0; --level) {
+    if (level >= list_height) {
+      preds[level] = head;
+      succs[level] = nullptr;
+      continue;
+    }
+    std::tie(preds[level], succs[level]) = find_splice(key, from, level);
+    from = preds[level];
+  }
+  if (succs[0] != nullptr && succs[0]->key == key) {
+    succs[0]->entry.store(stored, std::memory_order_release);
+    return;
+  }
+
+  int node_height = random_height();
+  while (node_height > list_height &&
+         !height.compare_exchange_weak(list_height, node_height,
+                                       std::memory_order_relaxed)) {
+  }
+  Node *node = new_node(key, stored, node_height);
+  for (int level = 0; level < node_height; ++level) {
+    while (true) {
+      node->link(level).store(succs[level], std::memory_order_relaxed);
+      if (preds[level]->link(level).compare_exchange_strong(
+              succs[level], node, std::memory_order_release,
+              std::memory_order_relaxed)) {
+        break;
+      }
+      // another put linked a node in between, keys only ever get added
+      // so the splice is still ahead of the old predecessor
+      std::tie(preds[level], succs[level]) =
+          find_splice(key, preds[level], level);
+      if (level == 0 && succs[0] != nullptr && succs[0]->key == key) {
+        // the other put had the same key, the unlinked node is dropped
+        succs[0]->entry.store(stored, std::memory_order_release);
+        return;
+      }
+    }
+  }
+  count.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::optional<std::uint64_t>
+ConcurrentSkipList::find(const KeyType &key) const {
+  auto entry = find_entry(key);
+  if (!entry) {
+    return {};
+  }
+  return entry->offset;
+}
+
+std::optional<IndexEntry>
+ConcurrentSkipList::find_entry(const KeyType &key) const {
+  Node *node = head;
+  Node *next = nullptr;
+  for (int level = height.load(std::memory_order_relaxed) - 1; level >= 0;
+       --level) {
+    // the successor is the one compared with the key, a second load could
+    // see a node linked since, with a key below it
+    std::tie(node, next) = find_splice(key, node, level);
+  }
+  if (next == nullptr || next->key != key) {
+    return {};
+  }
+  return *next->entry.load(std::memory_order_acquire);
+}
+
+} // namespace kvaaas
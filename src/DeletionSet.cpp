@@ -0,0 +1,24 @@
+#include "DeletionSet.h"
+#include <vector>
+
+namespace kvaaas {
+
+DeletionSet::DeletionSet(ByteArrayPtr arr_) : arr(arr_) {
+  std::size_t count = arr->size() / sizeof(std::uint64_t);
+  std::vector<std::uint64_t> stored(count);
+  if (count != 0) {
+    arr->read_ptr(reinterpret_cast<ByteType *>(stored.data()), 0,
+                  count * sizeof(std::uint64_t));
+  }
+  addresses.insert(stored.begin(), stored.end());
+}
+
+bool DeletionSet::insert(std::uint64_t address) {
+  if (!addresses.insert(address).second) {
+    return false;
+  }
+  arr->append(reinterpret_cast<const ByteType *>(&address), sizeof(address));
+  return true;
+}
+
+} // namespace kvaaas
@@ -1,106 +1,501 @@
 #include <KVSRecordsViewer.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <utility>
 
 namespace kvaaas {
 
-KVSRecordsViewer::KVSRecordsViewer(ByteArray *arr, void *compressor)
+KVSRecordsViewer::KVSRecordsViewer(ByteArray *arr, Compressor *compressor)
     : byte_arr(arr), comp(compressor) {}
 
-std::size_t KVSRecordsViewer::append(const KVSRecord &record) {
-  std::vector<ByteType> compressed(record.value_size * 3 / 2);
-  std::uint64_t size;
-  if (record.value_size < 1000) {
-    size = record.value_size;
-    compressed = record.value;
-  } else {
-    size = ZSTD_compress(compressed.data(), record.value_size * 3 / 2,
-                         record.value.data(), record.value_size, 7);
+KVSRecordsViewer::KVSRecordsViewer(KVSRecordsViewer &&oth) noexcept
+    : byte_arr(oth.byte_arr), comp(oth.comp), scratch(std::move(oth.scratch)),
+      pending(std::move(oth.pending)), decoded(std::move(oth.decoded)) {
+  oth.pending = {};
+}
+
+KVSRecordsViewer &KVSRecordsViewer::operator=(KVSRecordsViewer &&oth) {
+  if (this != &oth) {
+    flush();
+    byte_arr = oth.byte_arr;
+    comp = oth.comp;
+    scratch = std::move(oth.scratch);
+    pending = std::exchange(oth.pending, {});
+    decoded = std::move(oth.decoded);
+  }
+  return *this;
+}
+
+KVSRecordsViewer::~KVSRecordsViewer() { flush(); }
+
+std::uint64_t KVSRecordsViewer::encode_payload(const ByteType *src,
+                                               std::uint64_t n,
+                                               std::uint64_t at) {
+  scratch.resize(at + Compressor::bound(n));
+  std::uint64_t size =
+      compressor().compress(scratch.data() + at, scratch.size() - at, src, n);
+  if (size == 0) {
+    std::copy(src, src + n, scratch.begin() + at);
+    size = n;
+  }
+  return size;
+}
+
+// The whole record is encoded into one buffer and appended at once
+std::uint64_t KVSRecordsViewer::append_record(const KeyType &key,
+                                              ByteType is_deleted,
+                                              const ValueType &value) {
+  if (is_chunked(value.size())) {
+    // the pending block has to start where the array ends
+    flush();
+    return append_chunked(key, is_deleted, value);
   }
+  if (compressor().options().block_size != 0) {
+    return append_to_block(key, is_deleted, value);
+  }
+  std::uint64_t size = encode_payload(value.data(), value.size(), HEADER_SIZE);
+  return append_encoded(key, is_deleted, value.size(), size);
+}
+
+std::uint64_t KVSRecordsViewer::append_chunked(const KeyType &key,
+                                               ByteType is_deleted,
+                                               const ValueType &value) {
+  std::uint64_t chunk_size = compressor().options().chunk_size;
+  std::uint64_t count = (value.size() + chunk_size - 1) / chunk_size;
+  std::uint64_t table = HEADER_SIZE + sizeof(chunk_size);
+  std::uint64_t chunks = table + count * sizeof(std::uint64_t);
+  std::vector<std::uint64_t> ends(count);
+  std::uint64_t at = chunks;
+  for (std::uint64_t i = 0; i < count; ++i) {
+    std::uint64_t begin = i * chunk_size;
+    std::uint64_t n = std::min<std::uint64_t>(chunk_size, value.size() - begin);
+    at += encode_payload(value.data() + begin, n, at);
+    ends[i] = at - chunks;
+  }
+  std::memcpy(scratch.data() + HEADER_SIZE, &chunk_size, sizeof(chunk_size));
+  std::memcpy(scratch.data() + table, ends.data(),
+              count * sizeof(std::uint64_t));
+  return append_encoded(key, is_deleted, value.size(), at - HEADER_SIZE,
+                        true);
+}
+
+std::uint64_t KVSRecordsViewer::append_encoded(const KeyType &key,
+                                               ByteType is_deleted,
+                                               std::uint64_t value_size,
+                                               std::uint64_t size,
+                                               bool chunked) {
+  std::uint64_t stored_size = chunked ? size | CHUNKED_FLAG : size;
+  ByteType *buf = scratch.data();
+  std::uint64_t pos = 0;
+  std::memcpy(buf + pos, key.data(), KEY_SIZE_BYTES);
+  pos += KEY_SIZE_BYTES;
+  buf[pos] = is_deleted;
+  pos += sizeof(is_deleted);
+  std::memcpy(buf + pos, &value_size, sizeof(value_size));
+  pos += sizeof(value_size);
+  std::memcpy(buf + pos, &stored_size, sizeof(stored_size));
+
+  auto res = byte_arr->size();
+  byte_arr->append(buf, HEADER_SIZE + size);
+  return res;
+}
+
+std::size_t KVSRecordsViewer::append(const KVSRecord &record) {
+  return append_record(record.key, record.is_deleted, record.value);
+}
 
-  auto rec = byte_arr->size();
-  byte_arr->append(record.key.data(), record.key.size());
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.is_deleted),
-                   sizeof(record.is_deleted));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.value_size),
-                   sizeof(record.value_size));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&size), sizeof(size));
-  byte_arr->append(compressed.data(), size);
-  return rec;
+std::uint64_t
+KVSRecordsViewer::append_compressed(const KeyType &key, const ValueType &value,
+                                    const CompressedValue &compressed) {
+  if (compressor().options().block_size != 0 || is_chunked(value.size())) {
+    return append_record(key, ByteType{0}, value);
+  }
+  const auto &payload = compressed.empty() ? value : compressed;
+  scratch.resize(HEADER_SIZE + payload.size());
+  std::copy(payload.begin(), payload.end(), scratch.begin() + HEADER_SIZE);
+  return append_encoded(key, ByteType{0}, value.size(), payload.size());
 }
 
 std::uint64_t
 KVSRecordsViewer::append_not_deleted_record(const KeyType &key,
                                             const ValueType &value) {
+  return append_record(key, ByteType{0}, value);
+}
 
-  static const ByteType not_deleted{0};
+void KVSRecordsViewer::decode_header(const ByteType *header,
+                                     KVSRecord &record) {
+  std::uint64_t pos = 0;
+  std::memcpy(record.key.data(), header + pos, KEY_SIZE_BYTES);
+  pos += KEY_SIZE_BYTES;
+  record.is_deleted = header[pos];
+  pos += sizeof(record.is_deleted);
+  std::memcpy(&record.value_size, header + pos, sizeof(record.value_size));
+  pos += sizeof(record.value_size);
+  std::memcpy(&record.compressed_size, header + pos,
+              sizeof(record.compressed_size));
+  record.chunked = (record.compressed_size & CHUNKED_FLAG) != 0;
+  record.compressed_size &= ~CHUNKED_FLAG;
+}
+
+std::uint64_t KVSRecordsViewer::append_to_block(const KeyType &key,
+                                                ByteType is_deleted,
+                                                const ValueType &value) {
+  if (pending.starts.empty()) {
+    pending.offset = byte_arr->size();
+  }
+  std::uint64_t index = pending.starts.size();
   std::uint64_t value_size = value.size();
+  pending.flags.push_back(is_deleted);
+  pending.starts.push_back(pending.raw.size());
+  auto *key_ptr = key.data();
+  auto *size_ptr = reinterpret_cast<const ByteType *>(&value_size);
+  pending.raw.insert(pending.raw.end(), key_ptr, key_ptr + KEY_SIZE_BYTES);
+  pending.raw.insert(pending.raw.end(), size_ptr,
+                     size_ptr + sizeof(value_size));
+  pending.raw.insert(pending.raw.end(), value.begin(), value.end());
+
+  std::uint64_t address = BLOCK_FLAG | pending.offset << INDEX_BITS | index;
+  if (pending.raw.size() >= compressor().options().block_size ||
+      pending.starts.size() == std::size_t{1} << INDEX_BITS) {
+    flush();
+  }
+  return address;
+}
+
+void KVSRecordsViewer::flush() {
+  if (pending.starts.empty()) {
+    return;
+  }
+  assert(byte_arr->size() == pending.offset);
+  std::uint32_t count = pending.starts.size();
+  std::uint64_t raw_size = pending.raw.size();
+  std::uint64_t body = BLOCK_HEADER_SIZE + count;
+  std::uint64_t stored_size =
+      encode_payload(pending.raw.data(), raw_size, body);
+  std::memcpy(scratch.data(), &count, sizeof(count));
+  std::memcpy(scratch.data() + sizeof(count), &raw_size, sizeof(raw_size));
+  std::memcpy(scratch.data() + sizeof(count) + sizeof(raw_size), &stored_size,
+              sizeof(stored_size));
+  std::copy(pending.flags.begin(), pending.flags.end(),
+            scratch.begin() + BLOCK_HEADER_SIZE);
+  byte_arr->append(scratch.data(), body + stored_size);
+
+  // the block was just written, its neighbours are likely read next
+  decoded.insert(decoded.begin(),
+                 std::make_shared<DecodedBlock>(std::move(pending)));
+  if (decoded.size() > DECODED_BLOCKS) {
+    decoded.pop_back();
+  }
+  pending = {};
+}
 
-  std::vector<ByteType> compressed(value_size * 3 / 2);
-  std::uint64_t size;
-  if (value_size < 1000) {
-    size = value_size;
-    compressed = value;
+KVSRecordsViewer::DecodedBlock *
+KVSRecordsViewer::find_block(std::uint64_t offset) {
+  if (!pending.starts.empty() && pending.offset == offset) {
+    return &pending;
+  }
+  for (auto it = decoded.begin(); it != decoded.end(); ++it) {
+    if ((*it)->offset == offset) {
+      std::rotate(decoded.begin(), it, it + 1);
+      return decoded.front().get();
+    }
+  }
+  return nullptr;
+}
+
+const KVSRecordsViewer::DecodedBlock &
+KVSRecordsViewer::load_block(std::uint64_t offset) {
+  if (auto *block = find_block(offset)) {
+    return *block;
+  }
+  std::array<ByteType, BLOCK_HEADER_SIZE> header;
+  byte_arr->read_ptr(header.data(), offset, offset + BLOCK_HEADER_SIZE);
+  std::uint32_t count;
+  std::uint64_t raw_size;
+  std::uint64_t stored_size;
+  std::memcpy(&count, header.data(), sizeof(count));
+  std::memcpy(&raw_size, header.data() + sizeof(count), sizeof(raw_size));
+  std::memcpy(&stored_size, header.data() + sizeof(count) + sizeof(raw_size),
+              sizeof(stored_size));
+
+  auto block = std::make_shared<DecodedBlock>();
+  block->offset = offset;
+  std::uint64_t begin = offset + BLOCK_HEADER_SIZE;
+  auto body = byte_arr->view(begin, begin + count + stored_size);
+  block->flags.assign(body.begin(), body.begin() + count);
+  block->raw.resize(raw_size);
+  if (stored_size == raw_size) {
+    std::copy(body.begin() + count, body.end(), block->raw.begin());
   } else {
-    size = ZSTD_compress(compressed.data(), value_size * 3 / 2, value.data(),
-                         value_size, 7);
+    compressor().decompress(block->raw.data(), raw_size, body.data() + count,
+                            stored_size);
+  }
+  block->starts.reserve(count);
+  for (std::size_t pos = 0; block->starts.size() < count;) {
+    block->starts.push_back(pos);
+    std::uint64_t value_size;
+    std::memcpy(&value_size, block->raw.data() + pos + KEY_SIZE_BYTES,
+                sizeof(value_size));
+    pos += KEY_SIZE_BYTES + sizeof(value_size) + value_size;
   }
 
-  auto res = byte_arr->size();
+  decoded.insert(decoded.begin(), std::move(block));
+  if (decoded.size() > DECODED_BLOCKS) {
+    decoded.pop_back();
+  }
+  return *decoded.front();
+}
 
-  byte_arr->append(key.data(), KEY_SIZE_BYTES);
-  byte_arr->append(reinterpret_cast<const ByteType *>(&not_deleted),
-                   sizeof(not_deleted));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&value_size),
-                   sizeof(value_size));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&size), sizeof(size));
-  byte_arr->append(compressed.data(), size);
-  return res;
+KVSRecord KVSRecordsViewer::block_record(const DecodedBlock &block,
+                                         std::size_t index) {
+  KVSRecord record{};
+  const ByteType *pos = block.raw.data() + block.starts[index];
+  std::memcpy(record.key.data(), pos, KEY_SIZE_BYTES);
+  pos += KEY_SIZE_BYTES;
+  std::memcpy(&record.value_size, pos, sizeof(record.value_size));
+  pos += sizeof(record.value_size);
+  record.is_deleted = block.flags[index];
+  record.compressed_size = record.value_size;
+  record.value.assign(pos, pos + record.value_size);
+  return record;
 }
 
 KVSRecord KVSRecordsViewer::read_record(uint64_t offset) {
+  if (is_block_address(offset)) {
+    std::uint64_t index = offset & ((std::uint64_t{1} << INDEX_BITS) - 1);
+    return block_record(load_block((offset & ~BLOCK_FLAG) >> INDEX_BITS),
+                        index);
+  }
+  std::array<ByteType, READ_WINDOW> window;
+  std::uint64_t window_size =
+      std::min<std::uint64_t>(READ_WINDOW, byte_arr->size() - offset);
+  byte_arr->read_ptr(window.data(), offset, offset + window_size);
+
   KVSRecord record{};
-  std::vector<ByteType> key_array =
-      byte_arr->read(offset, offset + KEY_SIZE_BYTES);
-  std::memcpy(&record.key, key_array.data(), key_array.size());
-  offset += KEY_SIZE_BYTES;
-
-  std::vector<ByteType> isDeleted_array =
-      byte_arr->read(offset, offset + sizeof(record.is_deleted));
-  std::memcpy(&record.is_deleted, isDeleted_array.data(),
-              sizeof(record.is_deleted));
-  offset += sizeof(record.is_deleted);
-
-  std::vector<ByteType> value_size_array =
-      byte_arr->read(offset, offset + sizeof(record.value_size));
-  std::memcpy(&record.value_size, value_size_array.data(),
-              sizeof(record.value_size));
-  offset += sizeof(record.value_size);
-
-  std::vector<ByteType> size_array =
-      byte_arr->read(offset, offset + sizeof(record.compressed_size));
-  std::memcpy(&record.compressed_size, size_array.data(),
-              sizeof(record.compressed_size));
-  offset += sizeof(record.compressed_size);
+  decode_header(window.data(), record);
+  const ByteType *prefix = window.data() + HEADER_SIZE;
+  std::uint64_t prefix_size =
+      std::min(window_size - HEADER_SIZE, record.compressed_size);
+  offset += HEADER_SIZE;
 
-  std::vector<ByteType> in(record.compressed_size);
-  std::vector<ByteType> out(record.value_size);
-  byte_arr->read_ptr(in.data(), offset, offset + record.compressed_size);
-  if (record.value_size < 1000) {
-    out = in;
+  record.value.resize(record.value_size);
+  if (!is_compressed(record)) {
+    std::copy(prefix, prefix + prefix_size, record.value.begin());
+    if (prefix_size < record.compressed_size) {
+      byte_arr->read_ptr(record.value.data() + prefix_size,
+                         offset + prefix_size,
+                         offset + record.compressed_size);
+    }
+  } else if (prefix_size == record.compressed_size) {
+    decode_payload(prefix, record);
   } else {
-    ZSTD_decompress(out.data(), record.value_size, in.data(),
-                    record.compressed_size);
+    auto payload = byte_arr->view(offset, offset + record.compressed_size);
+    decode_payload(payload.data(), record);
   }
-  record.value = std::move(out);
   return record;
 }
 
+std::vector<KVSRecord>
+KVSRecordsViewer::read_records(const std::vector<uint64_t> &all_offsets) {
+  // block records come from decoded blocks, the rest is read in batches
+  std::vector<KVSRecord> all_records(all_offsets.size());
+  std::vector<std::size_t> positions;
+  std::vector<uint64_t> offsets;
+  for (std::size_t i = 0; i < all_offsets.size(); ++i) {
+    if (is_block_address(all_offsets[i])) {
+      all_records[i] = read_record(all_offsets[i]);
+    } else {
+      positions.push_back(i);
+      offsets.push_back(all_offsets[i]);
+    }
+  }
+  if (offsets.empty()) {
+    return all_records;
+  }
+
+  std::vector<KVSRecord> records(offsets.size());
+  std::vector<ByteType> headers(offsets.size() * HEADER_SIZE);
+  std::vector<ReadRequest> requests(offsets.size());
+  for (std::size_t i = 0; i < offsets.size(); ++i) {
+    requests[i] = {offsets[i], offsets[i] + HEADER_SIZE,
+                   headers.data() + i * HEADER_SIZE};
+  }
+  byte_arr->read_batch(requests);
+
+  // small values land in place, compressed ones in a shared scratch buffer
+  std::uint64_t compressed_total = 0;
+  for (std::size_t i = 0; i < offsets.size(); ++i) {
+    decode_header(headers.data() + i * HEADER_SIZE, records[i]);
+    records[i].value.resize(records[i].value_size);
+    if (is_compressed(records[i])) {
+      compressed_total += records[i].compressed_size;
+    }
+  }
+  std::vector<ByteType> compressed(compressed_total);
+  std::uint64_t compressed_pos = 0;
+  for (std::size_t i = 0; i < offsets.size(); ++i) {
+    std::uint64_t begin = offsets[i] + HEADER_SIZE;
+    std::uint64_t end = begin + records[i].compressed_size;
+    if (!is_compressed(records[i])) {
+      requests[i] = {begin, end, records[i].value.data()};
+    } else {
+      requests[i] = {begin, end, compressed.data() + compressed_pos};
+      compressed_pos += records[i].compressed_size;
+    }
+  }
+  byte_arr->read_batch(requests);
+
+  compressed_pos = 0;
+  for (auto &record : records) {
+    if (is_compressed(record)) {
+      decode_payload(compressed.data() + compressed_pos, record);
+      compressed_pos += record.compressed_size;
+    }
+  }
+  for (std::size_t i = 0; i < positions.size(); ++i) {
+    all_records[positions[i]] = std::move(records[i]);
+  }
+  return all_records;
+}
+
+KVSRecord KVSRecordsViewer::read_range(uint64_t offset, std::uint64_t begin,
+                                       std::uint64_t len) {
+  auto slice = [&](KVSRecord &record) {
+    begin = std::min(begin, record.value_size);
+    len = std::min(len, record.value_size - begin);
+  };
+  if (is_block_address(offset)) {
+    // blocks are decoded whole anyway
+    KVSRecord record = read_record(offset);
+    slice(record);
+    record.value.erase(record.value.begin() + begin + len, record.value.end());
+    record.value.erase(record.value.begin(), record.value.begin() + begin);
+    return record;
+  }
+  // the header and, for a chunked record, its chunk size
+  std::array<ByteType, HEADER_SIZE + sizeof(std::uint64_t)> header;
+  std::uint64_t header_size =
+      std::min<std::uint64_t>(header.size(), byte_arr->size() - offset);
+  byte_arr->read_ptr(header.data(), offset, offset + header_size);
+  KVSRecord record{};
+  decode_header(header.data(), record);
+  slice(record);
+  std::uint64_t payload = offset + HEADER_SIZE;
+  if (len == 0) {
+    return record;
+  }
+  if (!record.chunked) {
+    if (!is_compressed(record)) {
+      record.value.resize(len);
+      byte_arr->read_ptr(record.value.data(), payload + begin,
+                         payload + begin + len);
+      return record;
+    }
+    auto stored = byte_arr->view(payload, payload + record.compressed_size);
+    ValueType value(record.value_size);
+    decode_chunk(value.data(), value.size(), stored.data(),
+                 record.compressed_size);
+    record.value.assign(value.begin() + begin, value.begin() + begin + len);
+    return record;
+  }
+
+  std::uint64_t chunk_size;
+  std::memcpy(&chunk_size, header.data() + HEADER_SIZE, sizeof(chunk_size));
+  std::uint64_t count = (record.value_size + chunk_size - 1) / chunk_size;
+  std::uint64_t first = begin / chunk_size;
+  std::uint64_t last = (begin + len - 1) / chunk_size;
+  // ends of the chunk before the first one and of the needed ones
+  std::uint64_t table = payload + sizeof(chunk_size);
+  std::vector<std::uint64_t> ends(last - first + 2, 0);
+  std::uint64_t from = first == 0 ? first : first - 1;
+  byte_arr->read_ptr(reinterpret_cast<ByteType *>(ends.data()) +
+                         (first == 0 ? sizeof(std::uint64_t) : 0),
+                     table + from * sizeof(std::uint64_t),
+                     table + (last + 1) * sizeof(std::uint64_t));
+  std::uint64_t chunks = table + count * sizeof(std::uint64_t);
+  auto stored = byte_arr->view(chunks + ends.front(), chunks + ends.back());
+
+  record.value.resize(len);
+  ValueType chunk(chunk_size);
+  for (std::uint64_t i = first; i <= last; ++i) {
+    std::uint64_t raw_begin = i * chunk_size;
+    std::uint64_t n = std::min(chunk_size, record.value_size - raw_begin);
+    std::uint64_t stored_begin = ends[i - first] - ends.front();
+    decode_chunk(chunk.data(), n, stored.data() + stored_begin,
+                 ends[i - first + 1] - ends[i - first]);
+    std::uint64_t copy_begin = std::max(begin, raw_begin);
+    std::uint64_t copy_end = std::min(begin + len, raw_begin + n);
+    std::copy(chunk.begin() + (copy_begin - raw_begin),
+              chunk.begin() + (copy_end - raw_begin),
+              record.value.begin() + (copy_begin - begin));
+  }
+  return record;
+}
+
+void KVSRecordsViewer::decode_chunk(ByteType *dst, std::uint64_t n,
+                                    const ByteType *src, std::uint64_t stored) {
+  if (stored == n) {
+    std::copy(src, src + n, dst);
+  } else {
+    compressor().decompress(dst, n, src, stored);
+  }
+}
+
+void KVSRecordsViewer::decode_payload(const ByteType *payload,
+                                      KVSRecord &record) {
+  if (record.chunked) {
+    std::uint64_t chunk_size;
+    std::memcpy(&chunk_size, payload, sizeof(chunk_size));
+    std::uint64_t count = (record.value_size + chunk_size - 1) / chunk_size;
+    const ByteType *table = payload + sizeof(chunk_size);
+    const ByteType *chunks = table + count * sizeof(std::uint64_t);
+    std::uint64_t start = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+      std::uint64_t end;
+      std::memcpy(&end, table + i * sizeof(end), sizeof(end));
+      std::uint64_t raw_begin = i * chunk_size;
+      decode_chunk(record.value.data() + raw_begin,
+                   std::min(chunk_size, record.value_size - raw_begin),
+                   chunks + start, end - start);
+      start = end;
+    }
+  } else if (is_compressed(record)) {
+    compressor().decompress(record.value.data(), record.value_size, payload,
+                            record.compressed_size);
+  } else {
+    std::copy(payload, payload + record.compressed_size, record.value.begin());
+  }
+}
+
 void KVSRecordsViewer::mark_as_deleted(uint64_t offset) {
-  byte_arr->rewrite(offset + KEY_SIZE_BYTES,
-                    std::vector<ByteType>(1, ByteType{1}));
+  static const ByteType deleted{1};
+  if (is_block_address(offset)) {
+    std::uint64_t index = offset & ((std::uint64_t{1} << INDEX_BITS) - 1);
+    std::uint64_t block_offset = (offset & ~BLOCK_FLAG) >> INDEX_BITS;
+    auto *block = find_block(block_offset);
+    if (block) {
+      block->flags[index] = deleted;
+    }
+    if (block != &pending) {
+      byte_arr->rewrite(block_offset + BLOCK_HEADER_SIZE + index, &deleted,
+                        sizeof(deleted));
+    }
+    return;
+  }
+  byte_arr->rewrite(offset + KEY_SIZE_BYTES, &deleted, sizeof(deleted));
 }
 
 bool KVSRecordsViewer::is_deleted(uint64_t offset) {
-  return byte_arr->read(offset + KEY_SIZE_BYTES,
+  if (is_block_address(offset)) {
+    std::uint64_t index = offset & ((std::uint64_t{1} << INDEX_BITS) - 1);
+    std::uint64_t block_offset = (offset & ~BLOCK_FLAG) >> INDEX_BITS;
+    if (auto *block = find_block(block_offset)) {
+      return block->flags[index] == ByteType{1};
+    }
+    offset = block_offset + BLOCK_HEADER_SIZE + index - KEY_SIZE_BYTES;
+  }
+  return byte_arr->view(offset + KEY_SIZE_BYTES,
                         offset + KEY_SIZE_BYTES + 1)[0] == ByteType{1};
 }
 
@@ -0,0 +1,155 @@
+#include "Log.h"
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace kvaaas {
+
+namespace {
+// bit i is set iff ctrl[i] == byte
+std::uint32_t match_byte(const std::int8_t *ctrl, std::int8_t byte) {
+#if defined(__SSE2__)
+  __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+  return static_cast<std::uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte))));
+#else
+  std::uint32_t mask = 0;
+  for (std::size_t i = 0; i < Log::GROUP; ++i) {
+    mask |= static_cast<std::uint32_t>(ctrl[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i is set iff ctrl[i] is EMPTY or DELETED, the only negative bytes
+std::uint32_t match_free(const std::int8_t *ctrl) {
+#if defined(__SSE2__)
+  __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+  return static_cast<std::uint32_t>(_mm_movemask_epi8(group));
+#else
+  std::uint32_t mask = 0;
+  for (std::size_t i = 0; i < Log::GROUP; ++i) {
+    mask |= static_cast<std::uint32_t>(ctrl[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+unsigned lowest_bit(std::uint32_t mask) { return __builtin_ctz(mask); }
+
+std::int8_t h2(std::uint64_t hash) {
+  return static_cast<std::int8_t>(hash & 0x7F);
+}
+} // namespace
+
+// Groups are probed triangularly, which visits every group of a power of
+// two count. The sequence ends at a group with an EMPTY slot.
+std::size_t Log::find(const KeyType &key) const {
+  if (entries.empty()) {
+    return NOT_FOUND;
+  }
+  std::uint64_t h = hash(key);
+  std::size_t group_mask = ctrl.size() / GROUP - 1;
+  std::size_t group = (h >> 7) & group_mask;
+  for (std::size_t step = 1;; ++step) {
+    if (stale(group)) {
+      return NOT_FOUND;
+    }
+    const std::int8_t *base = ctrl.data() + group * GROUP;
+    for (std::uint32_t m = match_byte(base, h2(h)); m != 0; m &= m - 1) {
+      std::size_t slot = group * GROUP + lowest_bit(m);
+      if (entries[slots[slot]].first == key) {
+        return slot;
+      }
+    }
+    if (match_byte(base, EMPTY) != 0) {
+      return NOT_FOUND;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+std::size_t Log::find_free(std::uint64_t h) const {
+  std::size_t group_mask = ctrl.size() / GROUP - 1;
+  std::size_t group = (h >> 7) & group_mask;
+  for (std::size_t step = 1;; ++step) {
+    if (stale(group)) {
+      return group * GROUP;
+    }
+    std::uint32_t m = match_free(ctrl.data() + group * GROUP);
+    if (m != 0) {
+      return group * GROUP + lowest_bit(m);
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+void Log::add(const KeyType &key, const IndexEntry &entry) {
+  std::size_t slot = find(key);
+  if (slot != NOT_FOUND) {
+    entries[slots[slot]].second = entry;
+    return;
+  }
+  if ((used + 1) * 8 > ctrl.size() * 7) {
+    // only DELETED slots are dropped when the entries still fit
+    rehash(std::max(MIN_CAPACITY, (entries.size() + 1) * 8 > ctrl.size() * 7
+                                      ? 2 * ctrl.size()
+                                      : ctrl.size()));
+  }
+  std::uint64_t h = hash(key);
+  slot = find_free(h);
+  std::size_t group = slot / GROUP;
+  if (stale(group)) {
+    std::fill_n(ctrl.begin() + group * GROUP, GROUP, EMPTY);
+    group_epochs[group] = epoch;
+  }
+  if (ctrl[slot] == EMPTY) {
+    ++used;
+  }
+  ctrl[slot] = h2(h);
+  slots[slot] = static_cast<std::uint32_t>(entries.size());
+  entries.emplace_back(key, entry);
+}
+
+void Log::remove(const KeyType &key) {
+  std::size_t slot = find(key);
+  if (slot == NOT_FOUND) {
+    return;
+  }
+  std::uint32_t index = slots[slot];
+  ctrl[slot] = DELETED;
+  // the last entry takes the freed place in the slab
+  if (index + 1 != entries.size()) {
+    std::size_t moved = find(entries.back().first);
+    slots[moved] = index;
+    entries[index] = entries.back();
+  }
+  entries.pop_back();
+}
+
+void Log::clear() {
+  if (++epoch == 0) {
+    // the epochs wrapped, a stamp could match again
+    std::fill(ctrl.begin(), ctrl.end(), EMPTY);
+    std::fill(group_epochs.begin(), group_epochs.end(), epoch);
+  }
+  entries.clear();
+  used = 0;
+}
+
+void Log::rehash(std::size_t new_capacity) {
+  ctrl.assign(new_capacity, EMPTY);
+  slots.assign(new_capacity, 0);
+  group_epochs.assign(new_capacity / GROUP, epoch);
+  used = entries.size();
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    std::uint64_t h = hash(entries[i].first);
+    std::size_t slot = find_free(h);
+    ctrl[slot] = h2(h);
+    slots[slot] = static_cast<std::uint32_t>(i);
+  }
+}
+
+} // namespace kvaaas
@@ -1,8 +1,17 @@
 #include "MemoryManager.h"
 #include "ByteArray.h"
+#include "BlockCache.h"
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
 #include <optional>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unistd.h>
 #include <vector>
 
 #include "json.hpp"
@@ -32,6 +41,15 @@ bool cmp_memory_type(MemoryType memory_type1, MemoryType memory_type2) {
           memory_type1.get_sst_level() < memory_type2.get_sst_level());
 }
 
+RAMMemoryManager::RAMMemoryManager(bool huge_pages) : huge_pages(huge_pages) {}
+
+ByteArrayPtr RAMMemoryManager::new_byte_array() const {
+  if (huge_pages) {
+    return ::new RAMByteArray(RAMByteArray::HUGE_PAGE_CHUNK_SIZE, true);
+  }
+  return ::new RAMByteArray();
+}
+
 ByteArrayPtr
 RAMMemoryManager::get_byte_array(MemoryPurpose memory_purpose,
                                  std::optional<std::size_t> sst_level) {
@@ -44,7 +62,7 @@ RAMMemoryManager::create_byte_array(MemoryPurpose memory_purpose,
                                     std::optional<std::size_t> sst_level) {
   MemoryType memory_type(memory_purpose, sst_level);
   assert(memory.count(memory_type) == 0);
-  memory[memory_type] = ::new RAMByteArray();
+  memory[memory_type] = new_byte_array();
   return memory[memory_type];
 }
 
@@ -53,7 +71,7 @@ RAMMemoryManager::start_overwrite(MemoryPurpose memory_purpose,
                                   std::optional<std::size_t> sst_level) {
   MemoryType memory_type(memory_purpose, sst_level);
   assert(memory_to_overwrite.count(memory_type) == 0);
-  memory_to_overwrite[memory_type] = ::new RAMByteArray();
+  memory_to_overwrite[memory_type] = new_byte_array();
   return memory_to_overwrite[memory_type];
 }
 
@@ -80,7 +98,7 @@ ByteArrayPtr RAMMemoryManager::get_byte_array(MemoryPurpose memory_purpose) {
 ByteArrayPtr RAMMemoryManager::create_byte_array(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
   assert(memory.count(memory_type) == 0);
-  memory[memory_type] = ::new RAMByteArray();
+  memory[memory_type] = new_byte_array();
   return memory[memory_type];
 }
 
@@ -96,7 +114,7 @@ RAMMemoryManager::get_or_create_byte_array(MemoryPurpose memory_purpose) {
 ByteArrayPtr RAMMemoryManager::start_overwrite(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
   assert(memory_to_overwrite.count(memory_type) == 0);
-  memory_to_overwrite[memory_type] = ::new RAMByteArray();
+  memory_to_overwrite[memory_type] = new_byte_array();
   return memory_to_overwrite[memory_type];
 }
 
@@ -124,21 +142,50 @@ RAMMemoryManager::~RAMMemoryManager() noexcept {
 
 // FileMemoryManager
 
-FileMemoryManager::FileMemoryManager(std::string root)
-    : root(root), manifest_json() {
+FileMemoryManager::FileMemoryManager(std::string root, FileMemoryOptions opt)
+    : root(root), opt(std::move(opt)), manifest_json() {
+  manifest_json[FORMAT_VERSION_KEY] = FORMAT_VERSION;
+  manifest_json[INLINE_CAPACITY_KEY] = this->opt.inline_capacity;
   update_manifest();
 }
 
 // TODO do not support sst level yet
-FileMemoryManager::FileMemoryManager(nlohmann::json mem_json, std::string root)
-    : root(root), manifest_json(mem_json) {
+FileMemoryManager::FileMemoryManager(nlohmann::json mem_json, std::string root,
+                                     FileMemoryOptions opt)
+    : root(root), opt(std::move(opt)), manifest_json(mem_json) {
+  std::uint64_t version =
+      manifest_json.value(FORMAT_VERSION_KEY, std::uint64_t{1});
+  if (version != FORMAT_VERSION) {
+    throw std::runtime_error("manifest of " + root + " has format version " +
+                             std::to_string(version) + ", expected " +
+                             std::to_string(FORMAT_VERSION));
+  }
+  std::size_t inline_capacity =
+      manifest_json.value(INLINE_CAPACITY_KEY, std::size_t{0});
+  if (inline_capacity != this->opt.inline_capacity) {
+    throw std::runtime_error("manifest of " + root + " has inline capacity " +
+                             std::to_string(inline_capacity) + ", expected " +
+                             std::to_string(this->opt.inline_capacity));
+  }
   // restore mapping from json
 
+  // bytes past the sizes of the last manifest update are the unflushed
+  // tail of a crash, a manifest without sizes takes the files as they are
+  nlohmann::json sizes = manifest_json.value(SIZES_KEY, nlohmann::json{});
   for (int i = MemoryPurpose::BEGIN; i < MemoryPurpose::END; ++i) {
     std::string purpose_name = to_string(MemoryPurpose(i));
     if (manifest_json.contains(purpose_name)) {
       std::string fname = manifest_json.at(purpose_name); // maybe error
-      memory[MemoryType(MemoryPurpose(i))] = ::new FileByteArray(fname);
+      std::optional<std::size_t> logical_size;
+      if (sizes.contains(purpose_name)) {
+        logical_size = sizes.at(purpose_name).get<std::size_t>();
+      }
+      if (this->opt.owner_sized[i]) {
+        unrestored[MemoryPurpose(i)] = logical_size;
+        logical_size.reset();
+      }
+      memory[MemoryType(MemoryPurpose(i))] =
+          open_byte_array(fname, MemoryPurpose(i), logical_size);
     }
   }
   update_manifest();
@@ -151,6 +198,23 @@ std::string FileMemoryManager::generate_new_filename(MemoryPurpose mp) {
   return root + "/file" + to_string(mp) + std::to_string(dist(mt));
 }
 
+FileBackedByteArrayPtr FileMemoryManager::open_byte_array(
+    const std::string &fname, MemoryPurpose purpose,
+    std::optional<std::size_t> logical_size) const {
+  FileArrayOptions file_opt{opt.grow_step[purpose], logical_size};
+  FileBackedByteArrayPtr arr = nullptr;
+  if (opt.backend == FileBackend::Mmap) {
+    arr = ::new MmapByteArray(fname, false, file_opt);
+  } else {
+    arr = ::new FileByteArray(fname, false,
+                              FileByteArray::DEFAULT_APPEND_BUFFER, file_opt);
+  }
+  if (opt.cache && (purpose != MemoryPurpose::KVS || opt.cache_kvs)) {
+    arr = ::new CachedByteArray(arr, opt.cache, purpose);
+  }
+  return arr;
+}
+
 [[deprecated]] ByteArrayPtr
 FileMemoryManager::get_byte_array(MemoryPurpose memory_purpose,
                                   std::optional<std::size_t> sst_level) {
@@ -164,7 +228,7 @@ FileMemoryManager::create_byte_array(MemoryPurpose memory_purpose,
   MemoryType memory_type(memory_purpose, sst_level);
   assert(memory.count(memory_type) == 0);
   memory[memory_type] =
-      ::new FileByteArray(generate_new_filename(memory_purpose));
+      open_byte_array(generate_new_filename(memory_purpose), memory_purpose);
 
   return memory[memory_type];
 }
@@ -175,7 +239,7 @@ FileMemoryManager::start_overwrite(MemoryPurpose memory_purpose,
   MemoryType memory_type(memory_purpose, sst_level);
   assert(memory_to_overwrite.count(memory_type) == 0);
   memory_to_overwrite[memory_type] =
-      ::new FileByteArray(generate_new_filename(memory_purpose));
+      open_byte_array(generate_new_filename(memory_purpose), memory_purpose);
   return memory_to_overwrite[memory_type];
 }
 
@@ -215,7 +279,7 @@ FileMemoryManager::create_byte_array(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
   assert(memory.count(memory_type) == 0);
   std::string fname = generate_new_filename(memory_purpose);
-  memory[memory_type] = ::new FileByteArray(fname);
+  memory[memory_type] = open_byte_array(fname, memory_purpose);
   manifest_json[to_string(memory_purpose)] = fname;
   update_manifest();
   return memory[memory_type];
@@ -225,28 +289,137 @@ ByteArrayPtr FileMemoryManager::start_overwrite(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
   assert(memory_to_overwrite.count(memory_type) == 0);
   memory_to_overwrite[memory_type] =
-      ::new FileByteArray(generate_new_filename(memory_purpose));
+      open_byte_array(generate_new_filename(memory_purpose), memory_purpose);
   return memory_to_overwrite[memory_type];
 }
 
-void FileMemoryManager::end_overwrite(MemoryPurpose memory_purpose) {
+void FileMemoryManager::switch_to_overwrite(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
+  // the manifest must not point to a file with a half-written tail
+  memory_to_overwrite[memory_type]->flush();
   delete memory[memory_type];
   memory[memory_type] = memory_to_overwrite[memory_type];
+  memory_to_overwrite.erase(memory_type);
+  unrestored.erase(memory_purpose);
   manifest_json[to_string(memory_purpose)] = memory[memory_type]->file_name();
+}
+
+void FileMemoryManager::end_overwrite(MemoryPurpose memory_purpose) {
+  switch_to_overwrite(memory_purpose);
+  update_manifest();
+}
+
+void FileMemoryManager::end_overwrites(
+    std::initializer_list<MemoryPurpose> purposes) {
+  for (auto purpose : purposes) {
+    switch_to_overwrite(purpose);
+  }
   update_manifest();
-  memory_to_overwrite.erase(memory_type);
 }
 
 void FileMemoryManager::remove(MemoryPurpose memory_purpose) {
   MemoryType memory_type(memory_purpose);
+  delete memory[memory_type];
+  memory.erase(memory_type);
+  unrestored.erase(memory_purpose);
   manifest_json.erase(to_string(memory_purpose));
   update_manifest();
+}
+
+void FileMemoryManager::restore_size(MemoryPurpose memory_purpose,
+                                     std::optional<std::size_t> size) {
+  auto it = unrestored.find(memory_purpose);
+  if (it == unrestored.end()) {
+    return;
+  }
+  if (!size) {
+    size = it->second;
+  }
+  unrestored.erase(it);
+  if (!size) {
+    return;
+  }
+  MemoryType memory_type(memory_purpose);
+  std::string fname = memory.at(memory_type)->file_name();
   delete memory[memory_type];
-  memory.erase(memory_type);
+  memory[memory_type] = open_byte_array(fname, memory_purpose, size);
+  update_manifest();
+}
+
+void FileMemoryManager::checkpoint(bool durable) { update_manifest(durable); }
+
+void FileMemoryManager::flush() {
+  for (auto [_, ptr] : memory) {
+    ptr->flush();
+  }
+  for (auto [_, ptr] : memory_to_overwrite) {
+    ptr->flush();
+  }
+}
+
+namespace {
+
+void sync_path(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+  int res = ::fsync(fd);
+  int err = errno;
+  ::close(fd);
+  if (res == -1) {
+    throw std::system_error(err, std::generic_category(), "fsync " + path);
+  }
+}
+
+} // namespace
+
+void FileMemoryManager::update_manifest(bool durable) {
+  nlohmann::json sizes = nlohmann::json::object();
+  for (auto [type, ptr] : memory) {
+    if (!type.has_sst_level()) {
+      sizes[to_string(type.get_memory_purpose())] = ptr->size();
+    }
+  }
+  for (auto [purpose, size] : unrestored) {
+    if (size) {
+      sizes[to_string(purpose)] = *size;
+    } else {
+      sizes.erase(to_string(purpose));
+    }
+  }
+  manifest_json[SIZES_KEY] = sizes;
+  // a crash leaves either the old manifest or the new one, never a mix
+  std::string name = root + "/manifest.json";
+  std::string tmp_name = name + ".tmp";
+  {
+    std::ofstream os(tmp_name, std::ios::trunc);
+    if (!(os << manifest_json).flush()) {
+      throw std::runtime_error("cannot write " + tmp_name);
+    }
+  }
+  if (durable) {
+    sync_path(tmp_name);
+  }
+  if (std::rename(tmp_name.c_str(), name.c_str()) != 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "rename " + tmp_name);
+  }
+  if (durable) {
+    sync_path(root);
+  }
 }
 
 FileMemoryManager::~FileMemoryManager() noexcept {
+  if (!memory.empty()) { // moved-from managers own nothing
+    try {
+      // sizes of appends that never reached the file are not recorded
+      flush();
+      update_manifest();
+    } catch (...) {
+      // the sizes of the last update stay in force, as after a crash
+    }
+  }
   for (auto [_, ptr] : memory) {
     delete ptr;
   }
@@ -255,7 +428,8 @@ FileMemoryManager::~FileMemoryManager() noexcept {
   }
 }
 
-FileMemoryManager FileMemoryManager::from_dir(std::string root) {
+FileMemoryManager FileMemoryManager::from_dir(std::string root,
+                                              FileMemoryOptions opt) {
   using namespace nlohmann;
   std::string mem_name = root + "/" + "manifest.json";
 
@@ -263,7 +437,7 @@ FileMemoryManager FileMemoryManager::from_dir(std::string root) {
   nlohmann::json memory_json;
   imem >> memory_json;
 
-  return FileMemoryManager(memory_json, root);
+  return FileMemoryManager(memory_json, root, std::move(opt));
 }
 
 } // namespace kvaaas
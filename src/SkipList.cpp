@@ -1,4 +1,6 @@
 #include "SkipList.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <optional>
 
@@ -8,14 +10,35 @@ SkipList::SkipList(const SLBottomLevelRecordViewer &bottom_,
                    const SLUpperLevelRecordViewer &upper_,
                    std::uint64_t estimated_size)
     : bottom(bottom_), upper(upper_), levels_count(1 + upper.get_levels()),
-      filter(estimated_size) {}
+      filter(estimated_size) {
+  // the filter is not stored, a reopened list fills it again
+  for (std::uint64_t node = bottom.get_head(); node != NULL_NODE;
+       node = bottom.get_next(node)) {
+    filter.add(bottom.get_record(node).key);
+  }
+}
+
+namespace {
+// whether the node a link points to has a key not above key, its key is
+// only loaded when the prefixes tie
+template <typename LoadKey>
+bool next_at_most(const SLLink &link, const KeyType &key,
+                  std::uint64_t prefix, LoadKey load_key) {
+  if (link.next == NULL_NODE || link.next_prefix > prefix) {
+    return false;
+  }
+  return link.next_prefix < prefix || load_key(link.next) <= key;
+}
+} // namespace
 
 std::uint64_t
 SkipList::insert_after_on_upper_level(std::uint64_t ind,
                                       SLUpperLevelRecord &new_node) {
-  new_node.next = upper.get_next(ind);
+  SLLink link = upper.get_link(ind);
+  new_node.next = link.next;
+  new_node.next_prefix = link.next_prefix;
   std::uint64_t pos = upper.append_record(new_node);
-  upper.set_next(ind, pos);
+  upper.set_next(ind, {pos, key_prefix(new_node.key)});
   return pos;
 }
 
@@ -23,6 +46,9 @@ std::uint64_t
 SkipList::insert_as_head_upper_level(std::uint64_t level,
                                      SLUpperLevelRecord &new_node) {
   new_node.next = upper.get_head(level);
+  if (new_node.next != NULL_NODE) {
+    new_node.next_prefix = key_prefix(upper[new_node.next].key);
+  }
   std::uint64_t pos = upper.append_record(new_node);
   upper.set_head(level, pos);
   return pos;
@@ -31,25 +57,31 @@ SkipList::insert_as_head_upper_level(std::uint64_t level,
 std::uint64_t
 SkipList::insert_after_on_bottom_level(std::uint64_t ind,
                                        SLBottomLevelRecord &new_node) {
-  new_node.next = bottom.get_next(ind);
+  SLLink link = bottom.get_link(ind);
+  new_node.next = link.next;
+  new_node.next_prefix = link.next_prefix;
   std::uint64_t pos = bottom.append_record(new_node);
-  bottom.set_next(ind, pos);
+  bottom.set_next(ind, {pos, key_prefix(new_node.key)});
   return pos;
 }
 
 std::uint64_t
 SkipList::insert_as_head_bottom_level(SLBottomLevelRecord &new_node) {
   new_node.next = bottom.get_head();
+  if (new_node.next != NULL_NODE) {
+    new_node.next_prefix = key_prefix(bottom.get_key(new_node.next));
+  }
   std::uint64_t pos = bottom.append_record(new_node);
   bottom.set_head(pos);
   return pos;
 }
 
 std::uint64_t SkipList::insert(std::uint64_t level, std::uint64_t after_pos,
-                               std::uint64_t down, std::uint64_t offset,
+                               std::uint64_t down, const IndexEntry &entry,
                                const KeyType &key) {
   if (level == 0) {
-    SLBottomLevelRecord new_record(key, offset);
+    SLBottomLevelRecord new_record(key, entry.offset);
+    new_record.value = entry.value;
     return after_pos == NULL_NODE
                ? insert_as_head_bottom_level(new_record)
                : insert_after_on_bottom_level(after_pos, new_record);
@@ -62,11 +94,12 @@ std::uint64_t SkipList::insert(std::uint64_t level, std::uint64_t after_pos,
 }
 
 void SkipList::insert_after_parents(const std::vector<std::uint64_t> &parents,
-                                    const KeyType &key, std::uint64_t offset) {
+                                    const KeyType &key,
+                                    const IndexEntry &entry) {
   std::uint64_t down = NULL_NODE;
   std::uint64_t cur_level = 0;
   while (cur_level < parents.size()) {
-    down = insert(cur_level, parents[cur_level], down, offset, key);
+    down = insert(cur_level, parents[cur_level], down, entry, key);
     ++cur_level;
     if (dist(rng) == 0) {
       break;
@@ -74,19 +107,27 @@ void SkipList::insert_after_parents(const std::vector<std::uint64_t> &parents,
   }
   if (cur_level == levels_count && dist(rng) == 1) {
     upper.append_head(NULL_NODE);
-    insert(cur_level, NULL_NODE, down, offset, key);
+    insert(cur_level, NULL_NODE, down, entry, key);
     ++levels_count;
   }
 }
 
 void SkipList::put(const KeyType &key, std::uint64_t offset) {
+  put(key, IndexEntry{offset});
+}
+
+void SkipList::put(const KeyType &key, const IndexEntry &entry) {
   filter.add(key);
   if (!bottom.has_head()) {
-    SLBottomLevelRecord new_record(key, offset);
+    SLBottomLevelRecord new_record(key, entry.offset);
+    new_record.value = entry.value;
     insert_as_head_bottom_level(new_record);
     return;
   }
 
+  std::uint64_t prefix = key_prefix(key);
+  auto upper_key = [this](std::uint64_t node) { return upper[node].key; };
+  auto bottom_key = [this](std::uint64_t node) { return bottom.get_key(node); };
   std::vector<std::uint64_t> parents(levels_count, NULL_NODE);
   std::uint64_t bottom_node = NULL_NODE;
   if (levels_count >= 2) {
@@ -97,13 +138,10 @@ void SkipList::put(const KeyType &key, std::uint64_t offset) {
     if (upper_level != -1) {
       std::uint64_t cur_node = upper.get_head(upper_level);
       while (upper_level >= 0) {
-        while (true) {
-          uint64_t next_node = upper.get_next(cur_node);
-          if (next_node != NULL_NODE && upper[next_node].key <= key) {
-            cur_node = next_node;
-          } else {
-            break;
-          }
+        for (SLLink link = upper.get_link(cur_node);
+             next_at_most(link, key, prefix, upper_key);
+             link = upper.get_link(cur_node)) {
+          cur_node = link.next;
         }
         parents[upper_level + 1] = cur_node;
         if (upper_level != 0) {
@@ -117,25 +155,31 @@ void SkipList::put(const KeyType &key, std::uint64_t offset) {
   if (bottom_node == NULL_NODE) {
     bottom_node = bottom.get_head();
   }
-  while (true) {
-    uint64_t next_node = bottom.get_next(bottom_node);
-    if (next_node != NULL_NODE && bottom[next_node].key <= key) {
-      bottom_node = next_node;
-    } else {
-      break;
-    }
+  for (SLLink link = bottom.get_link(bottom_node);
+       next_at_most(link, key, prefix, bottom_key);
+       link = bottom.get_link(bottom_node)) {
+    bottom_node = link.next;
   }
-  if (bottom_node != NULL_NODE && bottom[bottom_node].key == key) {
-    bottom.set_offset(bottom_node, offset);
+  KeyType bottom_node_key = bottom.get_key(bottom_node);
+  if (bottom_node_key == key) {
+    bottom.set_entry(bottom_node, entry);
     return;
   }
-  if (bottom_node != NULL_NODE && bottom[bottom_node].key < key) {
+  if (bottom_node_key < key) {
     parents[0] = bottom_node;
   }
-  insert_after_parents(parents, key, offset);
+  insert_after_parents(parents, key, entry);
 }
 
 std::optional<std::uint64_t> SkipList::find(const KeyType &key) {
+  auto entry = find_entry(key);
+  if (!entry) {
+    return {};
+  }
+  return entry->offset;
+}
+
+std::optional<IndexEntry> SkipList::find_entry(const KeyType &key) {
   if (!filter.has_key(key)) {
     return {};
   }
@@ -143,9 +187,12 @@ std::optional<std::uint64_t> SkipList::find(const KeyType &key) {
     return {};
   }
   std::uint64_t bottom_node = bottom.get_head();
-  if (bottom[bottom_node].key > key) {
+  if (bottom.get_key(bottom_node) > key) {
     return {};
   }
+  std::uint64_t prefix = key_prefix(key);
+  auto upper_key = [this](std::uint64_t node) { return upper[node].key; };
+  auto bottom_key = [this](std::uint64_t node) { return bottom.get_key(node); };
   if (levels_count >= 2) {
     std::int64_t upper_level = static_cast<std::int64_t>(levels_count) - 2;
     while (upper_level >= 0 && upper[upper.get_head(upper_level)].key > key) {
@@ -154,13 +201,10 @@ std::optional<std::uint64_t> SkipList::find(const KeyType &key) {
     if (upper_level != -1) {
       std::uint64_t cur_node = upper.get_head(upper_level);
       while (upper_level >= 0) {
-        while (true) {
-          uint64_t next_node = upper.get_next(cur_node);
-          if (next_node != NULL_NODE && upper[next_node].key <= key) {
-            cur_node = next_node;
-          } else {
-            break;
-          }
+        for (SLLink link = upper.get_link(cur_node);
+             next_at_most(link, key, prefix, upper_key);
+             link = upper.get_link(cur_node)) {
+          cur_node = link.next;
         }
         if (upper_level != 0) {
           cur_node = upper[cur_node].down;
@@ -170,14 +214,118 @@ std::optional<std::uint64_t> SkipList::find(const KeyType &key) {
       bottom_node = upper[cur_node].down;
     }
   }
-  while (bottom_node != NULL_NODE && bottom[bottom_node].key < key) {
-    bottom_node = bottom.get_next(bottom_node);
+  for (SLLink link = bottom.get_link(bottom_node);
+       next_at_most(link, key, prefix, bottom_key);
+       link = bottom.get_link(bottom_node)) {
+    bottom_node = link.next;
   }
-  if (bottom_node != NULL_NODE && bottom[bottom_node].key == key) {
-    return bottom[bottom_node].offset;
-  } else {
+  auto record = bottom[bottom_node];
+  if (record.key != key) {
     return {};
   }
+  return IndexEntry{record.offset, record.value};
+}
+
+std::vector<std::pair<KeyType, IndexEntry>>
+SkipList::sort_by_key(std::vector<std::pair<KeyType, IndexEntry>> entries) {
+  // counting buckets do not pay off for a handful of entries
+  if (entries.size() < RADIX_SORT_MIN_SIZE) {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.first < b.first;
+                     });
+    return entries;
+  }
+  std::vector<std::pair<KeyType, IndexEntry>> sorted(entries.size());
+  for (std::size_t byte = KEY_SIZE_BYTES; byte-- > 0;) {
+    std::array<std::size_t, 257> starts{};
+    for (const auto &entry : entries) {
+      ++starts[static_cast<std::size_t>(entry.first[byte]) + 1];
+    }
+    // every key has the same byte here
+    if (std::find(starts.begin(), starts.end(), entries.size()) !=
+        starts.end()) {
+      continue;
+    }
+    for (std::size_t i = 1; i < starts.size(); ++i) {
+      starts[i] += starts[i - 1];
+    }
+    for (const auto &entry : entries) {
+      sorted[starts[static_cast<std::size_t>(entry.first[byte])]++] = entry;
+    }
+    entries.swap(sorted);
+  }
+  return entries;
+}
+
+// preds[level] is the last node of the level with a key not above the
+// current one, NULL_NODE before the first node. As keys only grow, each
+// level is walked forward once, and a level starts from the node below
+// the predecessor above it when that one is further.
+void SkipList::push_sorted(
+    const std::vector<std::pair<KeyType, IndexEntry>> &entries) {
+  std::vector<std::uint64_t> preds(levels_count, NULL_NODE);
+  std::vector<KeyType> pred_keys(levels_count);
+  auto key_at = [this](std::size_t level, std::uint64_t node) {
+    return level == 0 ? bottom.get_key(node) : upper[node].key;
+  };
+  // the prefix of a head is not stored, it is taken from its key
+  auto link_at = [this, &key_at](std::size_t level, std::uint64_t node) {
+    if (node != NULL_NODE) {
+      return level == 0 ? bottom.get_link(node) : upper.get_link(node);
+    }
+    SLLink link{level == 0 ? bottom.get_head() : upper.get_head(level - 1)};
+    if (link.next != NULL_NODE) {
+      link.next_prefix = key_prefix(key_at(level, link.next));
+    }
+    return link;
+  };
+  for (const auto &[key, entry] : entries) {
+    filter.add(key);
+    std::uint64_t prefix = key_prefix(key);
+    for (std::size_t level = levels_count; level-- > 0;) {
+      if (level + 1 < levels_count && preds[level + 1] != NULL_NODE &&
+          (preds[level] == NULL_NODE ||
+           pred_keys[level] < pred_keys[level + 1])) {
+        preds[level] = upper[preds[level + 1]].down;
+        pred_keys[level] = pred_keys[level + 1];
+      }
+      while (true) {
+        // the usual last step stops on the prefix alone
+        SLLink link = link_at(level, preds[level]);
+        if (link.next == NULL_NODE || link.next_prefix > prefix) {
+          break;
+        }
+        KeyType next_key = key_at(level, link.next);
+        if (key < next_key) {
+          break;
+        }
+        preds[level] = link.next;
+        pred_keys[level] = next_key;
+      }
+    }
+    if (preds[0] != NULL_NODE && pred_keys[0] == key) {
+      bottom.set_entry(preds[0], entry);
+      continue;
+    }
+    // the tower of every 2^h-th node reaches level h, the list stays
+    // balanced however the keys arrive
+    std::size_t height = 1 + __builtin_ctzll(bottom.get_elems_count() + 1);
+    if (height > levels_count) {
+      // at most one new level per node
+      height = levels_count + 1;
+      upper.append_head(NULL_NODE);
+      preds.push_back(NULL_NODE);
+      pred_keys.emplace_back();
+      ++levels_count;
+    }
+    std::uint64_t down = NULL_NODE;
+    for (std::size_t level = 0; level < height; ++level) {
+      down = insert(level, preds[level], down, entry, key);
+      preds[level] = down;
+      pred_keys[level] = key;
+    }
+  }
 }
 
 bool SkipList::has_key(const KeyType &key) { return find(key).has_value(); }
@@ -1,30 +1,68 @@
 #include "SkipListRecords.h"
 #include "ByteArray.h"
 #include "Core.h"
+#include <array>
 #include <cstring>
 #include <iostream>
 #include <vector>
 
 namespace kvaaas {
 
+namespace {
+std::uint64_t load_prefix(const ByteType *bytes) {
+  std::uint64_t prefix = 0;
+  for (std::size_t i = 0; i < sizeof(prefix); ++i) {
+    prefix = prefix << 8 | std::to_integer<std::uint64_t>(bytes[i]);
+  }
+  return prefix;
+}
+
+void store_prefix(ByteType *bytes, std::uint64_t prefix) {
+  for (std::size_t i = sizeof(prefix); i-- > 0;) {
+    bytes[i] = ByteType(prefix & 0xFF);
+    prefix >>= 8;
+  }
+}
+
+// next and the prefix are adjacent, one write updates a link
+std::array<ByteType, sizeof(SLLink)> encode_link(const SLLink &link) {
+  std::array<ByteType, sizeof(SLLink)> buf;
+  std::memcpy(buf.data(), &link.next, sizeof(link.next));
+  store_prefix(buf.data() + sizeof(link.next), link.next_prefix);
+  return buf;
+}
+} // namespace
+
+std::uint64_t key_prefix(const KeyType &key) {
+  return load_prefix(key.data());
+}
+
 bool operator==(const SLBottomLevelRecord &record1,
                 const SLBottomLevelRecord &record2) {
-  return record1.next == record2.next && record1.offset == record2.offset &&
-         record1.key == record2.key;
+  return record1.next == record2.next &&
+         record1.next_prefix == record2.next_prefix &&
+         record1.offset == record2.offset && record1.key == record2.key &&
+         record1.value == record2.value;
 }
 
 SLBottomLevelRecord::SLBottomLevelRecord(const KeyType &key_,
                                          std::uint64_t offset_)
     : offset(offset_), key(key_) {}
 
-SLBottomLevelRecordViewer::SLBottomLevelRecordViewer(ByteArrayPtr byte_arr_)
-    : byte_arr(byte_arr_) {
-  byte_arr->append(std::vector<ByteType>(HEAD_SIZE));
-  set_head(NULL_NODE);
+SLBottomLevelRecordViewer::SLBottomLevelRecordViewer(
+    ByteArrayPtr byte_arr_, std::size_t inline_capacity_)
+    : byte_arr(byte_arr_), inline_capacity(inline_capacity_),
+      record_size(SLBottomLevelRecord::SIZE +
+                  InlineValue::slot_size(inline_capacity_)) {
+  // a reopened list keeps its head
+  if (byte_arr->size() == 0) {
+    byte_arr->append(std::vector<ByteType>(HEAD_SIZE));
+    set_head(NULL_NODE);
+  }
 }
 
-std::uint64_t SLBottomLevelRecordViewer::get_begin(std::uint64_t ind) {
-  return HEAD_SIZE + ind * SLBottomLevelRecord::SIZE;
+std::uint64_t SLBottomLevelRecordViewer::get_begin(std::uint64_t ind) const {
+  return HEAD_SIZE + ind * record_size;
 }
 
 bool SLBottomLevelRecordViewer::has_head() { return get_head() != NULL_NODE; }
@@ -41,23 +79,27 @@ void SLBottomLevelRecordViewer::set_head(std::uint64_t head) {
 
 SLBottomLevelRecord SLBottomLevelRecordViewer::get_record(std::uint64_t ind) {
   SLBottomLevelRecord record;
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(&record.next),
-                     get_begin(ind) + SLBottomLevelRecord::NEXT_BEGIN,
-                     get_begin(ind) + SLBottomLevelRecord::NEXT_BEGIN +
-                         sizeof(record.next));
-
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(&record.offset),
-                     get_begin(ind) + SLBottomLevelRecord::OFFSET_BEGIN,
-                     get_begin(ind) + SLBottomLevelRecord::OFFSET_BEGIN +
-                         sizeof(record.offset));
-
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(record.key.data()),
-                     get_begin(ind) + SLBottomLevelRecord::KEY_BEGIN,
-                     get_begin(ind) + SLBottomLevelRecord::KEY_BEGIN +
-                         record.key.size());
+  auto view = byte_arr->view(get_begin(ind), get_begin(ind) + record_size);
+  std::memcpy(&record.next, view.data() + SLBottomLevelRecord::NEXT_BEGIN,
+              sizeof(record.next));
+  record.next_prefix =
+      load_prefix(view.data() + SLBottomLevelRecord::NEXT_PREFIX_BEGIN);
+  std::memcpy(&record.offset, view.data() + SLBottomLevelRecord::OFFSET_BEGIN,
+              sizeof(record.offset));
+  std::memcpy(record.key.data(), view.data() + SLBottomLevelRecord::KEY_BEGIN,
+              record.key.size());
+  record.value = InlineValue::load(
+      view.data() + SLBottomLevelRecord::VALUE_BEGIN, inline_capacity);
   return record;
 }
 
+KeyType SLBottomLevelRecordViewer::get_key(std::uint64_t ind) {
+  KeyType key;
+  std::uint64_t begin = get_begin(ind) + SLBottomLevelRecord::KEY_BEGIN;
+  byte_arr->read_ptr(key.data(), begin, begin + KEY_SIZE_BYTES);
+  return key;
+}
+
 std::uint64_t SLBottomLevelRecordViewer::get_next(std::uint64_t ind) {
   std::uint64_t next = 0;
   byte_arr->read_ptr(reinterpret_cast<ByteType *>(&next),
@@ -67,10 +109,23 @@ std::uint64_t SLBottomLevelRecordViewer::get_next(std::uint64_t ind) {
   return next;
 }
 
+SLLink SLBottomLevelRecordViewer::get_link(std::uint64_t ind) {
+  std::array<ByteType, sizeof(SLLink)> buf;
+  byte_arr->read_ptr(buf.data(),
+                     get_begin(ind) + SLBottomLevelRecord::NEXT_BEGIN,
+                     get_begin(ind) + SLBottomLevelRecord::NEXT_BEGIN +
+                         buf.size());
+  SLLink link;
+  std::memcpy(&link.next, buf.data(), sizeof(link.next));
+  link.next_prefix = load_prefix(buf.data() + sizeof(link.next));
+  return link;
+}
+
 void SLBottomLevelRecordViewer::set_next(std::uint64_t ind,
-                                         std::uint64_t new_next) {
+                                         const SLLink &link) {
+  auto buf = encode_link(link);
   byte_arr->rewrite(get_begin(ind) + SLBottomLevelRecord::NEXT_BEGIN,
-                    reinterpret_cast<ByteType *>(&new_next), sizeof(new_next));
+                    buf.data(), buf.size());
 }
 
 void SLBottomLevelRecordViewer::set_offset(std::uint64_t ind,
@@ -80,23 +135,42 @@ void SLBottomLevelRecordViewer::set_offset(std::uint64_t ind,
                     sizeof(new_offset));
 }
 
+void SLBottomLevelRecordViewer::set_entry(std::uint64_t ind,
+                                          const IndexEntry &entry) {
+  set_offset(ind, entry.offset);
+  if (inline_capacity != 0) {
+    std::array<ByteType, InlineValue::slot_size(MAX_INLINE_VALUE_SIZE)> slot;
+    entry.value.store(slot.data(), inline_capacity);
+    byte_arr->rewrite(get_begin(ind) + SLBottomLevelRecord::VALUE_BEGIN,
+                      slot.data(), InlineValue::slot_size(inline_capacity));
+  }
+}
+
 SLBottomLevelRecord SLBottomLevelRecordViewer::operator[](std::uint64_t ind) {
   return get_record(ind);
 }
 
 std::uint64_t
 SLBottomLevelRecordViewer::append_record(const SLBottomLevelRecord &record) {
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.next),
-                   sizeof(record.next));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.offset),
-                   sizeof(record.offset));
-  byte_arr->append(reinterpret_cast<const ByteType *>(record.key.data()),
-                   KEY_SIZE_BYTES);
-  return byte_arr->size() / SLBottomLevelRecord::SIZE - 1;
+  std::array<ByteType, SLBottomLevelRecord::SIZE +
+                          InlineValue::slot_size(MAX_INLINE_VALUE_SIZE)>
+      buf;
+  std::memcpy(buf.data() + SLBottomLevelRecord::NEXT_BEGIN, &record.next,
+              sizeof(record.next));
+  store_prefix(buf.data() + SLBottomLevelRecord::NEXT_PREFIX_BEGIN,
+               record.next_prefix);
+  std::memcpy(buf.data() + SLBottomLevelRecord::OFFSET_BEGIN, &record.offset,
+              sizeof(record.offset));
+  std::memcpy(buf.data() + SLBottomLevelRecord::KEY_BEGIN, record.key.data(),
+              KEY_SIZE_BYTES);
+  record.value.store(buf.data() + SLBottomLevelRecord::VALUE_BEGIN,
+                     inline_capacity);
+  byte_arr->append(buf.data(), record_size);
+  return get_elems_count() - 1;
 }
 
 std::uint64_t SLBottomLevelRecordViewer::get_elems_count() const {
-  return (byte_arr->size() - HEAD_SIZE) / SLBottomLevelRecord::SIZE;
+  return (byte_arr->size() - HEAD_SIZE) / record_size;
 }
 
 SLUpperLevelRecord::SLUpperLevelRecord(const KeyType &key_, std::uint64_t down_)
@@ -104,85 +178,74 @@ SLUpperLevelRecord::SLUpperLevelRecord(const KeyType &key_, std::uint64_t down_)
 
 bool operator==(const SLUpperLevelRecord &record1,
                 const SLUpperLevelRecord &record2) {
-  return record1.next == record2.next && record1.down == record2.down &&
-         record1.key == record2.key;
+  return record1.next == record2.next &&
+         record1.next_prefix == record2.next_prefix &&
+         record1.down == record2.down && record1.key == record2.key;
 }
 
 SLUpperLevelRecordViewer::SLUpperLevelRecordViewer(ByteArrayPtr byte_arr_,
                                                    ByteArrayPtr heads_)
-    : byte_arr(byte_arr_), heads(heads_) {}
-
-std::uint64_t SLUpperLevelRecordViewer::get_levels() {
-  return heads->size() / HEAD_SIZE;
+    : byte_arr(byte_arr_), heads(heads_) {
+  auto stored_heads = heads->read(0, heads->size());
+  level_heads.resize(stored_heads.size() / HEAD_SIZE);
+  for (std::size_t i = 0; i < level_heads.size(); ++i) {
+    std::memcpy(&level_heads[i], stored_heads.data() + i * HEAD_SIZE,
+                HEAD_SIZE);
+  }
+  auto stored = byte_arr->read(0, byte_arr->size());
+  records.resize(stored.size() / SLUpperLevelRecord::SIZE);
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    const ByteType *data = stored.data() + get_begin(i);
+    std::memcpy(&records[i].next, data + SLUpperLevelRecord::NEXT_BEGIN,
+                sizeof(records[i].next));
+    records[i].next_prefix =
+        load_prefix(data + SLUpperLevelRecord::NEXT_PREFIX_BEGIN);
+    std::memcpy(&records[i].down, data + SLUpperLevelRecord::DOWN_BEGIN,
+                sizeof(records[i].down));
+    std::memcpy(records[i].key.data(), data + SLUpperLevelRecord::KEY_BEGIN,
+                records[i].key.size());
+  }
 }
 
 std::uint64_t SLUpperLevelRecordViewer::get_begin(std::uint64_t ind) {
   return ind * SLUpperLevelRecord::SIZE;
 }
 
-std::uint64_t SLUpperLevelRecordViewer::get_head(std::uint64_t list_ind) {
-  std::uint64_t head = 0;
-  heads->read_ptr(reinterpret_cast<ByteType *>(&head), list_ind * HEAD_SIZE,
-                  (list_ind + 1) * HEAD_SIZE);
-  return head;
-}
-
 void SLUpperLevelRecordViewer::set_head(std::uint64_t list_ind,
                                         std::uint64_t head) {
+  level_heads[list_ind] = head;
   heads->rewrite(list_ind * HEAD_SIZE,
                  reinterpret_cast<const ByteType *>(&head), HEAD_SIZE);
 }
 
 void SLUpperLevelRecordViewer::append_head(std::uint64_t head) {
+  level_heads.push_back(head);
   heads->append(reinterpret_cast<const ByteType *>(&head), HEAD_SIZE);
 }
 
-SLUpperLevelRecord SLUpperLevelRecordViewer::get_record(std::uint64_t ind) {
-  SLUpperLevelRecord record;
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(&record.next),
-                     get_begin(ind) + SLUpperLevelRecord::NEXT_BEGIN,
-                     get_begin(ind) + SLUpperLevelRecord::NEXT_BEGIN +
-                         sizeof(record.next));
-
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(&record.down),
-                     get_begin(ind) + SLUpperLevelRecord::DOWN_BEGIN,
-                     get_begin(ind) + SLUpperLevelRecord::DOWN_BEGIN +
-                         sizeof(record.down));
-
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(record.key.data()),
-                     get_begin(ind) + SLUpperLevelRecord::KEY_BEGIN,
-                     get_begin(ind) + SLUpperLevelRecord::KEY_BEGIN +
-                         record.key.size());
-  return record;
-}
-
-std::uint64_t SLUpperLevelRecordViewer::get_next(std::uint64_t ind) {
-  std::uint64_t next = 0;
-  byte_arr->read_ptr(reinterpret_cast<ByteType *>(&next), get_begin(ind),
-                     get_begin(ind) + sizeof(SLUpperLevelRecord::next));
-  return next;
-}
-
 void SLUpperLevelRecordViewer::set_next(std::uint64_t ind,
-                                        std::uint64_t new_next) {
+                                        const SLLink &link) {
+  records[ind].next = link.next;
+  records[ind].next_prefix = link.next_prefix;
+  auto buf = encode_link(link);
   byte_arr->rewrite(get_begin(ind) + SLUpperLevelRecord::NEXT_BEGIN,
-                    reinterpret_cast<const ByteType *>(&new_next),
-                    sizeof(new_next));
-}
-
-SLUpperLevelRecord SLUpperLevelRecordViewer::operator[](std::uint64_t ind) {
-  return get_record(ind);
+                    buf.data(), buf.size());
 }
 
 std::uint64_t
 SLUpperLevelRecordViewer::append_record(const SLUpperLevelRecord &record) {
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.next),
-                   sizeof(record.next));
-  byte_arr->append(reinterpret_cast<const ByteType *>(&record.down),
-                   sizeof(record.down));
-  byte_arr->append(reinterpret_cast<const ByteType *>(record.key.data()),
-                   KEY_SIZE_BYTES);
-  return byte_arr->size() / SLUpperLevelRecord::SIZE - 1;
-}
-
-} // namespace kvaaas
\ No newline at end of file
+  std::array<ByteType, SLUpperLevelRecord::SIZE> buf;
+  std::memcpy(buf.data() + SLUpperLevelRecord::NEXT_BEGIN, &record.next,
+              sizeof(record.next));
+  store_prefix(buf.data() + SLUpperLevelRecord::NEXT_PREFIX_BEGIN,
+               record.next_prefix);
+  std::memcpy(buf.data() + SLUpperLevelRecord::DOWN_BEGIN, &record.down,
+              sizeof(record.down));
+  std::memcpy(buf.data() + SLUpperLevelRecord::KEY_BEGIN, record.key.data(),
+              KEY_SIZE_BYTES);
+  byte_arr->append(buf.data(), buf.size());
+  records.push_back(record);
+  return records.size() - 1;
+}
+
+} // namespace kvaaas
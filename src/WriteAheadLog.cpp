@@ -0,0 +1,120 @@
+#include "WriteAheadLog.h"
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace kvaaas {
+
+namespace {
+constexpr std::size_t CHECKSUM_SIZE = sizeof(std::uint32_t);
+} // namespace
+
+WriteAheadLog::WriteAheadLog(ByteArrayPtr arr_, WalOptions opt_)
+    : arr(arr_), opt(opt_), last_commit(std::chrono::steady_clock::now()) {}
+
+std::size_t WriteAheadLog::replay(Log &log) {
+  // the whole log in one read
+  std::vector<ByteType> bytes = arr->read(0, arr->size());
+  std::vector<std::pair<KeyType, IndexEntry>> uncommitted;
+  std::size_t pos = 0;
+  std::size_t count = 0;
+  intact = 0;
+  while (pos + CHECKSUM_SIZE + 1 <= bytes.size()) {
+    const ByteType *rec = bytes.data() + pos;
+    auto inline_size = static_cast<std::uint8_t>(rec[CHECKSUM_SIZE]);
+    std::size_t size = inline_size == COMMIT_MARKER
+                           ? COMMIT_RECORD_SIZE
+                           : MIN_RECORD_SIZE + inline_size;
+    if ((inline_size != COMMIT_MARKER &&
+         inline_size > MAX_INLINE_VALUE_SIZE) ||
+        pos + size > bytes.size()) {
+      break;
+    }
+    std::uint32_t checksum;
+    std::memcpy(&checksum, rec, CHECKSUM_SIZE);
+    if (checksum != XXH32(rec + CHECKSUM_SIZE, size - CHECKSUM_SIZE, 0)) {
+      break;
+    }
+    const ByteType *body = rec + CHECKSUM_SIZE + 1;
+    pos += size;
+    if (inline_size == COMMIT_MARKER) {
+      WalSizes sizes;
+      std::memcpy(&sizes, body, sizeof(sizes));
+      last_sizes = sizes;
+      for (const auto &[key, entry] : uncommitted) {
+        log.add(key, entry);
+      }
+      count += uncommitted.size();
+      uncommitted.clear();
+      intact = pos;
+      continue;
+    }
+    KeyType key;
+    std::memcpy(key.data(), body, KEY_SIZE_BYTES);
+    IndexEntry entry;
+    std::memcpy(&entry.offset, body + KEY_SIZE_BYTES, sizeof(entry.offset));
+    entry.value.size = inline_size;
+    const ByteType *value = body + KEY_SIZE_BYTES + sizeof(entry.offset);
+    std::copy(value, value + inline_size, entry.value.bytes.begin());
+    uncommitted.emplace_back(key, entry);
+  }
+  return count;
+}
+
+void WriteAheadLog::append(const KeyType &key, const IndexEntry &entry) {
+  std::array<ByteType, MIN_RECORD_SIZE + MAX_INLINE_VALUE_SIZE> buf;
+  std::size_t pos = CHECKSUM_SIZE;
+  buf[pos++] = ByteType(entry.value.size);
+  std::memcpy(buf.data() + pos, key.data(), KEY_SIZE_BYTES);
+  pos += KEY_SIZE_BYTES;
+  std::memcpy(buf.data() + pos, &entry.offset, sizeof(entry.offset));
+  pos += sizeof(entry.offset);
+  std::copy(entry.value.bytes.begin(),
+            entry.value.bytes.begin() + entry.value.size, buf.begin() + pos);
+  pos += entry.value.size;
+  std::uint32_t checksum =
+      XXH32(buf.data() + CHECKSUM_SIZE, pos - CHECKSUM_SIZE, 0);
+  std::memcpy(buf.data(), &checksum, CHECKSUM_SIZE);
+  arr->append(buf.data(), pos);
+}
+
+bool WriteAheadLog::due() {
+  switch (opt.mode) {
+  case WalMode::Disabled:
+    return false;
+  case WalMode::NoSync:
+  case WalMode::Sync:
+    return true;
+  case WalMode::GroupCommit:
+    return ++pending_ops >= opt.group_ops ||
+           std::chrono::steady_clock::now() - last_commit >=
+               opt.group_interval;
+  }
+  return false;
+}
+
+void WriteAheadLog::commit(const WalSizes &sizes) {
+  std::array<ByteType, COMMIT_RECORD_SIZE> buf;
+  buf[CHECKSUM_SIZE] = ByteType(COMMIT_MARKER);
+  std::memcpy(buf.data() + CHECKSUM_SIZE + 1, &sizes, sizeof(sizes));
+  std::uint32_t checksum =
+      XXH32(buf.data() + CHECKSUM_SIZE, buf.size() - CHECKSUM_SIZE, 0);
+  std::memcpy(buf.data(), &checksum, CHECKSUM_SIZE);
+  arr->append(buf.data(), buf.size());
+  last_sizes = sizes;
+  if (opt.mode == WalMode::NoSync) {
+    arr->flush();
+  } else {
+    arr->sync();
+  }
+  pending_ops = 0;
+  last_commit = std::chrono::steady_clock::now();
+}
+
+void WriteAheadLog::reset(ByteArrayPtr new_arr) {
+  arr = new_arr;
+  pending_ops = 0;
+}
+
+} // namespace kvaaas
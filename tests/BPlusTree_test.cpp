@@ -0,0 +1,127 @@
+#include "BPlusTree.h"
+
+#include "doctest.h"
+
+#include <map>
+#include <random>
+
+using namespace kvaaas;
+
+namespace {
+KeyType random_key(std::mt19937_64 &rnd, std::size_t shared_prefix = 0) {
+  KeyType key{};
+  for (std::size_t i = shared_prefix; i < key.size(); ++i) {
+    key[i] = ByteType(rnd());
+  }
+  return key;
+}
+
+void check_same(BPlusTree &tree, const std::map<KeyType, IndexEntry> &map) {
+  CHECK(tree.size() == map.size());
+  for (const auto &[key, entry] : map) {
+    auto found = tree.find_entry(key);
+    REQUIRE(found);
+    CHECK(found->offset == entry.offset);
+    CHECK(found->value == entry.value);
+  }
+  auto it = tree.begin();
+  for (const auto &[key, entry] : map) {
+    REQUIRE(it != tree.end());
+    CHECK((*it).key == key);
+    CHECK((*it).offset == entry.offset);
+    ++it;
+  }
+  CHECK(it == tree.end());
+}
+} // namespace
+
+TEST_CASE("Empty B+-tree") {
+  RAMByteArray pages;
+  BPlusTree tree(&pages);
+  CHECK(tree.size() == 0);
+  CHECK(tree.height() == 1);
+  CHECK(tree.begin() == tree.end());
+  CHECK(!tree.find(KeyType{}));
+}
+
+TEST_CASE("B+-tree puts and finds") {
+  std::mt19937_64 rnd(0);
+  RAMByteArray pages;
+  BPlusTree tree(&pages);
+  std::map<KeyType, IndexEntry> map;
+  std::vector<KeyType> keys;
+  for (std::size_t i = 0; i < 20000; ++i) {
+    KeyType key = random_key(rnd);
+    if (!keys.empty() && i % 4 == 0) {
+      key = keys[rnd() % keys.size()];
+    }
+    keys.push_back(key);
+    map[key] = IndexEntry{i};
+    tree.put(key, i);
+  }
+  // 20000 entries take two levels of 4 KiB pages
+  CHECK(tree.height() == 2);
+  check_same(tree, map);
+  for (std::size_t i = 0; i < 1000; ++i) {
+    KeyType key = random_key(rnd);
+    CHECK(tree.find(key) == (map.count(key) ? map[key].offset
+                                            : std::optional<std::uint64_t>{}));
+  }
+}
+
+TEST_CASE("B+-tree inner pages with shared prefixes") {
+  std::mt19937_64 rnd(1);
+  RAMByteArray pages;
+  // inline values make the leaves small, so there are inner page splits
+  BPlusTree tree(&pages, 64);
+  std::map<KeyType, IndexEntry> map;
+  for (std::size_t i = 0; i < 20000; ++i) {
+    // most keys share 12 bytes, which the inner pages store once
+    KeyType key = random_key(rnd, i % 8 ? 12 : 0);
+    ValueType value(i % 65, ByteType(i));
+    map[key] = IndexEntry{INLINE_OFFSET, InlineValue(value)};
+    tree.put(key, map[key]);
+  }
+  CHECK(tree.height() == 3);
+  check_same(tree, map);
+}
+
+TEST_CASE("B+-tree sorted pushes") {
+  RAMByteArray pages;
+  BPlusTree tree(&pages);
+  std::vector<std::pair<KeyType, std::uint64_t>> pairs;
+  for (std::size_t i = 0; i < 5000; ++i) {
+    KeyType key{};
+    key[14] = ByteType(i / 256);
+    key[15] = ByteType(i);
+    pairs.emplace_back(key, i);
+  }
+  tree.push_from(pairs.begin(), pairs.end());
+  // appends fill the leaves instead of splitting them in half
+  CHECK(pages.size() <= BPlusTree::PAGE_SIZE * (2 + 5000 / 168 + 2));
+  std::map<KeyType, IndexEntry> map;
+  for (const auto &[key, offset] : pairs) {
+    map[key] = IndexEntry{offset};
+  }
+  check_same(tree, map);
+  // the meta page is stored once, after the batch
+  BPlusTree reopened(&pages);
+  CHECK(reopened.height() == tree.height());
+  check_same(reopened, map);
+}
+
+TEST_CASE("B+-tree reopens") {
+  std::mt19937_64 rnd(2);
+  RAMByteArray pages;
+  std::map<KeyType, IndexEntry> map;
+  {
+    BPlusTree tree(&pages);
+    for (std::size_t i = 0; i < 3000; ++i) {
+      KeyType key = random_key(rnd);
+      map[key] = IndexEntry{i};
+      tree.put(key, i);
+    }
+  }
+  BPlusTree tree(&pages);
+  check_same(tree, map);
+}
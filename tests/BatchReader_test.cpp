@@ -0,0 +1,80 @@
+#include "BatchReader.h"
+#include "ByteArray.h"
+#include "KVSRecordsViewer.h"
+#include "doctest.h"
+#include <fcntl.h>
+#include <random>
+#include <unistd.h>
+
+using namespace kvaaas;
+
+namespace {
+std::vector<ByteType> gen_random(std::size_t n) {
+  std::vector<ByteType> arr(n);
+  std::mt19937_64 rnd(42);
+  for (auto &b : arr) {
+    b = static_cast<ByteType>(rnd() & 0xFF);
+  }
+  return arr;
+}
+
+void check_reader(BatchReader &reader) {
+  auto bytes = gen_random(100'000);
+  {
+    FileByteArray arr("batchReaderFile", false, 0);
+    arr.append(bytes);
+  }
+  int fd = ::open("batchReaderFile", O_RDONLY);
+  REQUIRE(fd != -1);
+
+  // more than one ring worth of requests
+  std::vector<std::vector<ByteType>> out(200);
+  std::vector<PositionalRead> reads;
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    out[i].resize(100 + i);
+    reads.push_back({fd, i * 400, out[i].size(), out[i].data()});
+  }
+  reader.read(reads);
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    CHECK(std::equal(out[i].begin(), out[i].end(), bytes.begin() + i * 400));
+  }
+  ::close(fd);
+  std::remove("batchReaderFile");
+}
+} // namespace
+
+TEST_CASE("ThreadPoolReader") {
+  ThreadPoolReader pool(3);
+  check_reader(pool);
+}
+
+TEST_CASE("IoUringReader") {
+  auto ring = IoUringReader::try_create();
+  if (ring) {
+    check_reader(*ring);
+  } else {
+    MESSAGE("io_uring is not available, only the fallback is tested");
+  }
+}
+
+TEST_CASE("BatchReader local") { check_reader(BatchReader::local()); }
+
+TEST_CASE("KVS batched read") {
+  FileByteArray arr("batchReaderKVS", true, 1000);
+  KVSRecordsViewer viewer(&arr, nullptr);
+  std::vector<std::uint64_t> offsets;
+  std::vector<ValueType> values;
+  for (std::size_t i = 0; i < 100; ++i) {
+    KeyType key{ByteType(i)};
+    // both raw and compressed records, the tail stays in the append buffer
+    values.push_back(i % 2 ? ValueType(10 + i, ByteType(i))
+                           : gen_random(1000 + 37 * i));
+    offsets.push_back(viewer.append_not_deleted_record(key, values.back()));
+  }
+  auto records = viewer.read_records(offsets);
+  REQUIRE(records.size() == offsets.size());
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    CHECK(records[i] == viewer.read_record(offsets[i]));
+    CHECK(records[i].value == values[i]);
+  }
+}
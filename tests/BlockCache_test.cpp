@@ -0,0 +1,136 @@
+#include "BlockCache.h"
+#include "Shard.h"
+#include "doctest.h"
+#include <algorithm>
+#include <random>
+
+using namespace kvaaas;
+
+namespace {
+std::vector<ByteType> gen_random(std::size_t n) {
+  std::vector<ByteType> arr(n);
+  std::mt19937_64 rnd(7);
+  for (auto &b : arr) {
+    b = static_cast<ByteType>(rnd() & 0xFF);
+  }
+  return arr;
+}
+
+constexpr std::size_t BS = BlockCache::BLOCK_SIZE;
+} // namespace
+
+TEST_CASE("Cached reads match the file") {
+  auto cache = std::make_shared<BlockCache>(64 * BS);
+  CachedByteArray arr(new FileByteArray("cachedArray", true), cache,
+                      MemoryPurpose::SST);
+  auto bytes = gen_random(10 * BS + 100);
+  arr.append(bytes);
+
+  CHECK(arr.read(0, bytes.size()) == bytes);
+  auto first = cache->stats(MemoryPurpose::SST);
+  CHECK(first.hits == 0);
+  CHECK(first.misses == 10);
+
+  CHECK(arr.read(BS - 10, 3 * BS + 10) ==
+        std::vector<ByteType>(bytes.begin() + BS - 10,
+                              bytes.begin() + 3 * BS + 10));
+  CHECK(cache->stats(MemoryPurpose::SST).hits == 4);
+  CHECK(cache->stats(MemoryPurpose::KVS).hits == 0);
+}
+
+TEST_CASE("Cached rewrites and appends stay coherent") {
+  auto cache = std::make_shared<BlockCache>(64 * BS);
+  CachedByteArray arr(new FileByteArray("cachedArray", true), cache,
+                      MemoryPurpose::SKIP_LIST_BL);
+  auto bytes = gen_random(3 * BS + 10);
+  arr.append(bytes);
+  CHECK(arr.read(0, bytes.size()) == bytes);
+
+  // spans two cached blocks
+  auto patch = gen_random(200);
+  std::copy(patch.begin(), patch.end(), bytes.begin() + BS - 100);
+  arr.rewrite(BS - 100, patch);
+  CHECK(arr.read(0, bytes.size()) == bytes);
+
+  // completes the partial tail block, which becomes cacheable
+  auto tail = gen_random(BS);
+  arr.append(tail);
+  bytes.insert(bytes.end(), tail.begin(), tail.end());
+  CHECK(arr.read(0, bytes.size()) == bytes);
+  CHECK(arr.read(0, bytes.size()) == bytes);
+}
+
+TEST_CASE("Cached batches and views") {
+  auto cache = std::make_shared<BlockCache>(64 * BS);
+  CachedByteArray arr(new FileByteArray("cachedArray", true), cache,
+                      MemoryPurpose::KVS);
+  auto bytes = gen_random(4 * BS + 100);
+  arr.append(bytes);
+  auto expected = [&](std::size_t l, std::size_t r) {
+    return std::vector<ByteType>(bytes.begin() + l, bytes.begin() + r);
+  };
+
+  // two requests share block 1, the last one ends in the tail
+  std::vector<std::vector<ByteType>> out{std::vector<ByteType>(BS),
+                                         std::vector<ByteType>(100),
+                                         std::vector<ByteType>(200)};
+  std::vector<ReadRequest> requests{{10, BS + 10, out[0].data()},
+                                    {BS + 50, BS + 150, out[1].data()},
+                                    {4 * BS - 100, 4 * BS + 100,
+                                     out[2].data()}};
+  arr.read_batch(requests);
+  CHECK(out[0] == expected(10, BS + 10));
+  CHECK(out[1] == expected(BS + 50, BS + 150));
+  CHECK(out[2] == expected(4 * BS - 100, 4 * BS + 100));
+  CHECK(cache->stats(MemoryPurpose::KVS).hits == 0);
+
+  // blocks 0, 1 and 3 were loaded by the batch
+  arr.read_batch(requests);
+  CHECK(cache->stats(MemoryPurpose::KVS).hits == 4);
+  CHECK(out[1] == expected(BS + 50, BS + 150));
+
+  ByteView cached = arr.view(BS + 50, BS + 150);
+  CHECK(std::equal(cached.begin(), cached.end(),
+                   bytes.begin() + BS + 50));
+  CHECK(cache->stats(MemoryPurpose::KVS).hits == 5);
+  ByteView tail = arr.view(4 * BS + 10, 4 * BS + 100);
+  CHECK(std::equal(tail.begin(), tail.end(), bytes.begin() + 4 * BS + 10));
+  CHECK(cache->stats(MemoryPurpose::KVS).hits == 5);
+}
+
+TEST_CASE("Cache respects its budget") {
+  auto cache = std::make_shared<BlockCache>(BlockCache::SHARDS * BS);
+  CachedByteArray arr(new FileByteArray("cachedArray", true), cache,
+                      MemoryPurpose::SST);
+  auto bytes = gen_random(200 * BS);
+  arr.append(bytes);
+  for (int round = 0; round < 2; ++round) {
+    CHECK(arr.read(0, bytes.size()) == bytes);
+  }
+  // one block per shard can not hold a sequential scan
+  CHECK(cache->stats(MemoryPurpose::SST).misses > 200);
+}
+
+TEST_CASE("Shard with block cache") {
+  std::filesystem::create_directory("cache_shard_test");
+  {
+    Shard shard("cache_shard_test",
+                ShardOption{true, ManagerType::FileMM, 2, 2, 2000, 0.5,
+                            1 << 20});
+    const std::size_t N = 600;
+    std::vector<KeyType> keys(N);
+    for (std::size_t i = 0; i < N; ++i) {
+      keys[i] = {ByteType(i % 256), ByteType(i / 256)};
+      shard.add(keys[i], ValueType(10, ByteType(i)));
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+      CHECK(shard.get(keys[i])->second == ValueType(10, ByteType(i)));
+    }
+    REQUIRE(shard.block_cache() != nullptr);
+    auto sst = shard.block_cache()->stats(MemoryPurpose::SST);
+    CHECK(sst.hits + sst.misses > 0);
+    auto kvs = shard.block_cache()->stats(MemoryPurpose::KVS);
+    CHECK(kvs.hits + kvs.misses == 0);
+  }
+  std::filesystem::remove_all("cache_shard_test");
+}
@@ -0,0 +1,199 @@
+#include "doctest.h"
+#include <Compressor.h>
+#include <KVSRecordsViewer.h>
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace kvaaas;
+using namespace std::chrono_literals;
+
+namespace {
+ValueType text_value(std::size_t n) {
+  ValueType value(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    value[i] = ByteType("abcdefgh"[i % 8]);
+  }
+  return value;
+}
+
+ValueType noise_value(std::size_t n) {
+  std::mt19937_64 rnd(n);
+  ValueType value(n);
+  for (auto &b : value) {
+    b = ByteType(rnd() & 0xFF);
+  }
+  return value;
+}
+
+std::size_t compressed_size(Compressor &compressor, const ValueType &value) {
+  std::vector<ByteType> dst(Compressor::bound(value.size()));
+  return compressor.compress(dst.data(), dst.size(), value.data(),
+                             value.size());
+}
+} // namespace
+
+TEST_CASE("Fixed compression modes") {
+  auto value = text_value(4000);
+  CompressionOptions opt;
+  opt.mode = CompressionMode::None;
+  Compressor none(opt);
+  CHECK(compressed_size(none, value) == 0);
+
+  for (auto mode : {CompressionMode::Fixed, CompressionMode::Fast,
+                    CompressionMode::High}) {
+    opt.mode = mode;
+    Compressor compressor(opt);
+    CHECK(compressed_size(compressor, value) != 0);
+    CHECK(compressed_size(compressor, text_value(100)) == 0); // < min_size
+    CHECK(compressed_size(compressor, noise_value(4000)) == 0);
+  }
+}
+
+TEST_CASE("Adaptive level follows the latency budget") {
+  AdaptivePolicy policy(7, 10us);
+  CHECK(policy.choose(1024) == 7);
+  for (std::size_t i = 0; i < AdaptivePolicy::ADJUST_EVERY; ++i) {
+    policy.observe(1024, 100, 50us);
+  }
+  CHECK(policy.level() == 6);
+
+  for (int round = 0; round < 20; ++round) {
+    for (std::size_t i = 0; i < AdaptivePolicy::ADJUST_EVERY; ++i) {
+      policy.observe(1024, 100, 50us);
+    }
+  }
+  CHECK(policy.level() == AdaptivePolicy::MIN_LEVEL);
+
+  for (int round = 0; round < 20; ++round) {
+    for (std::size_t i = 0; i < AdaptivePolicy::ADJUST_EVERY; ++i) {
+      policy.observe(1024, 100, 1us);
+    }
+  }
+  CHECK(policy.level() == 7);
+}
+
+TEST_CASE("Adaptive skips incompressible values") {
+  AdaptivePolicy policy(3, 10us);
+  for (std::size_t i = 0; i < 200; ++i) {
+    policy.observe(1024, 1024, 1us);
+  }
+  REQUIRE(policy.skipping());
+  std::size_t probes = 0;
+  for (std::size_t i = 0; i < 10 * AdaptivePolicy::PROBE_EVERY; ++i) {
+    probes += policy.choose(1024).has_value();
+  }
+  CHECK(probes == 10);
+
+  // compressible again
+  for (std::size_t i = 0; i < 200 && policy.skipping(); ++i) {
+    policy.observe(1024, 100, 1us);
+  }
+  CHECK(!policy.skipping());
+  CHECK(policy.choose(1024) == 3);
+}
+
+TEST_CASE("Decompression errors") {
+  auto value = text_value(4000);
+  Compressor compressor;
+  std::vector<ByteType> frame(Compressor::bound(value.size()));
+  frame.resize(compressor.compress(frame.data(), frame.size(), value.data(),
+                                   value.size()));
+  REQUIRE(!frame.empty());
+  ValueType out(value.size());
+  compressor.decompress(out.data(), out.size(), frame.data(), frame.size());
+  CHECK(out == value);
+  CHECK_THROWS_AS(compressor.decompress(out.data(), out.size() - 1,
+                                        frame.data(), frame.size()),
+                  std::runtime_error);
+  auto corrupted = frame;
+  corrupted[0] ^= ByteType{0xFF}; // the magic number
+  CHECK_THROWS_AS(compressor.decompress(out.data(), out.size(),
+                                        corrupted.data(), corrupted.size()),
+                  std::runtime_error);
+
+  std::vector<ValueType> samples;
+  for (std::size_t i = 0; i < 500; ++i) {
+    std::string s = "{\"user\": " + std::to_string(i * 37) +
+                    ", \"state\": \"active\", \"plan\": \"premium\"}";
+    samples.emplace_back(s.size());
+    std::memcpy(samples.back().data(), s.data(), s.size());
+  }
+  auto dict = Compressor::train_dictionary(samples, 1024);
+  REQUIRE(compressor.add_dictionary(dict) != 0);
+  frame.resize(Compressor::bound(value.size()));
+  frame.resize(compressor.compress(frame.data(), frame.size(), value.data(),
+                                   value.size()));
+  REQUIRE(!frame.empty());
+  Compressor without_dict;
+  CHECK_THROWS_AS(without_dict.decompress(out.data(), out.size(),
+                                          frame.data(), frame.size()),
+                  std::runtime_error);
+}
+
+TEST_CASE("Records stay readable under a changing policy") {
+  CompressionOptions opt;
+  opt.mode = CompressionMode::Adaptive;
+  opt.latency_budget = 1ns; // forces the level down
+  Compressor compressor(opt);
+  RAMByteArray arr;
+  KVSRecordsViewer viewer(&arr, &compressor);
+
+  std::vector<KVSRecord> records;
+  std::vector<std::uint64_t> offsets;
+  for (std::size_t i = 0; i < 500; ++i) {
+    KVSRecord record{};
+    record.key[0] = ByteType(i);
+    record.value = i % 3 ? text_value(1000 + i) : noise_value(1000 + i);
+    record.value_size = record.value.size();
+    offsets.push_back(viewer.append(record));
+    records.push_back(record);
+    if (i == 250) {
+      compressor.set_policy(std::make_unique<FixedLevelPolicy>(std::nullopt));
+    }
+  }
+  CHECK(dynamic_cast<FixedLevelPolicy *>(&compressor.compression_policy()));
+  CHECK(viewer.read_records(offsets) == records);
+}
+
+TEST_CASE("Compression pool") {
+  Compressor compressor;
+  CompressionPool pool(compressor.options(), 4);
+  RAMByteArray arr;
+  KVSRecordsViewer viewer(&arr, &compressor);
+
+  std::vector<KVSRecord> records;
+  for (std::size_t i = 0; i < 300; ++i) {
+    KVSRecord record{};
+    record.key[0] = ByteType(i);
+    record.value = i % 3 ? text_value(2000 + i) : noise_value(2000 + i);
+    record.value_size = record.value.size();
+    records.push_back(record);
+  }
+  std::vector<std::future<CompressedValue>> compressed;
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    if (i == 150) {
+      // the second half is compressed with a dictionary
+      std::vector<ValueType> samples;
+      for (std::size_t j = 0; j < 500; ++j) {
+        std::string s = "{\"user\": " + std::to_string(j * 37) +
+                        ", \"state\": \"active\", \"plan\": \"premium\"}";
+        samples.emplace_back(s.size());
+        std::memcpy(samples.back().data(), s.data(), s.size());
+      }
+      auto dict = Compressor::train_dictionary(samples, 1024);
+      REQUIRE(compressor.add_dictionary(dict) != 0);
+      pool.set_dictionary(dict);
+    }
+    compressed.push_back(pool.submit(records[i].value));
+  }
+  std::vector<std::uint64_t> offsets;
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    CompressedValue value = compressed[i].get();
+    // incompressible values come back empty and are stored raw
+    CHECK(value.empty() == (i % 3 == 0));
+    offsets.push_back(
+        viewer.append_compressed(records[i].key, records[i].value, value));
+  }
+  CHECK(viewer.read_records(offsets) == records);
+}
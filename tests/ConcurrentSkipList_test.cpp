@@ -0,0 +1,131 @@
+#include "ConcurrentSkipList.h"
+
+#include "doctest.h"
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+
+using namespace kvaaas;
+
+namespace {
+KeyType key_of(std::uint64_t i) {
+  KeyType key{};
+  // spread the keys, so the threads put all over the list
+  std::uint64_t mixed = i * 0x9E3779B97F4A7C15ULL;
+  for (std::size_t b = 0; b < sizeof(mixed); ++b) {
+    key[b] = ByteType(mixed >> (8 * (7 - b)));
+  }
+  return key;
+}
+} // namespace
+
+TEST_CASE("Concurrent skip list on one thread") {
+  std::mt19937_64 rnd(0);
+  ConcurrentSkipList list;
+  CHECK(list.begin() == list.end());
+  std::map<KeyType, std::uint64_t> map;
+  for (std::size_t i = 0; i < 5000; ++i) {
+    KeyType key = key_of(rnd() % 3000);
+    map[key] = i;
+    list.put(key, i);
+  }
+  CHECK(list.size() == map.size());
+  for (std::size_t i = 0; i < 4000; ++i) {
+    auto it = map.find(key_of(i));
+    CHECK(list.find(key_of(i)) == (it == map.end()
+                                       ? std::optional<std::uint64_t>{}
+                                       : it->second));
+  }
+  auto it = list.begin();
+  for (const auto &[key, offset] : map) {
+    REQUIRE(it != list.end());
+    CHECK(*it == SSTRecord{key, offset});
+    CHECK((*it).offset == offset);
+    ++it;
+  }
+  CHECK(it == list.end());
+}
+
+TEST_CASE("Concurrent skip list with many writers") {
+  constexpr std::size_t WRITERS = 4;
+  constexpr std::size_t PER_WRITER = 5000;
+  ConcurrentSkipList list;
+  std::atomic<bool> done = false;
+  std::atomic<bool> ok = true;
+  // a reader finds every key of the first writer it has seen put
+  std::atomic<std::size_t> first_put{0};
+  std::thread reader([&] {
+    while (!done) {
+      std::size_t seen = first_put.load();
+      for (std::size_t i = 0; i < seen; i += 7) {
+        if (!list.find(key_of(i))) {
+          ok = false;
+        }
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (std::size_t t = 0; t < WRITERS; ++t) {
+    writers.emplace_back([&, t] {
+      for (std::size_t i = 0; i < PER_WRITER; ++i) {
+        std::size_t n = t * PER_WRITER + i;
+        list.put(key_of(n), n);
+        // every writer also puts a key all of them share
+        list.put(key_of(WRITERS * PER_WRITER + i % 100), t);
+        if (t == 0) {
+          first_put = i + 1;
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  reader.join();
+  CHECK(ok);
+  CHECK(list.size() == WRITERS * PER_WRITER + 100);
+  for (std::size_t n = 0; n < WRITERS * PER_WRITER; ++n) {
+    CHECK(list.find(key_of(n)) == n);
+  }
+  for (std::size_t i = 0; i < 100; ++i) {
+    CHECK(list.find(key_of(WRITERS * PER_WRITER + i)) < WRITERS);
+  }
+  std::size_t visited = 0;
+  KeyType last{};
+  for (auto it = list.begin(); it != list.end(); ++it, ++visited) {
+    if (visited != 0) {
+      CHECK(last < (*it).key);
+    }
+    last = (*it).key;
+  }
+  CHECK(visited == list.size());
+}
+
+TEST_CASE("Concurrent skip list merges into an SST") {
+  ConcurrentSkipList list;
+  RAMByteArray old_bytes;
+  SSTRecordViewer old_view(&old_bytes, NewSSTRV{});
+  std::map<KeyType, std::uint64_t> map;
+  for (std::uint64_t i = 0; i < 1000; i += 2) {
+    KeyType key{ByteType(i / 256), ByteType(i)};
+    old_view.append(SSTRecord{key, i});
+    map[key] = i;
+  }
+  SST old_sst(old_view);
+  for (std::uint64_t i = 0; i < 1000; i += 3) {
+    KeyType key{ByteType(i / 256), ByteType(i)};
+    list.put(key, i + 1);
+    map[key] = i + 1;
+  }
+  RAMByteArray new_bytes;
+  SSTRecordViewer new_view(&new_bytes, NewSSTRV{});
+  SST merged = SST::merge_into_sst(list.begin(), list.end(), old_sst.begin(),
+                                   old_sst.end(), new_view);
+  CHECK(merged.size() == map.size());
+  for (const auto &[key, offset] : map) {
+    CHECK(merged.find_offset(key) == offset);
+  }
+}
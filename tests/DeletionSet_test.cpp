@@ -0,0 +1,40 @@
+#include "DeletionSet.h"
+
+#include "doctest.h"
+
+#include <cstdio>
+
+using namespace kvaaas;
+
+TEST_CASE("Deletion set") {
+  RAMByteArray arr;
+  DeletionSet deleted(&arr);
+  CHECK(deleted.size() == 0);
+  CHECK(deleted.insert(42));
+  CHECK(deleted.insert(std::uint64_t{1} << 63 | 7));
+  CHECK(!deleted.insert(42));
+  CHECK(deleted.contains(42));
+  CHECK(!deleted.contains(43));
+  // every address is written once
+  CHECK(arr.size() == 2 * sizeof(std::uint64_t));
+}
+
+TEST_CASE("Deletion set reload") {
+  std::remove("deletionSet");
+  {
+    FileByteArray arr("deletionSet");
+    DeletionSet deleted(&arr);
+    for (std::uint64_t i = 0; i < 1000; i += 3) {
+      deleted.insert(i);
+    }
+  }
+  {
+    FileByteArray arr("deletionSet");
+    DeletionSet deleted(&arr);
+    CHECK(deleted.size() == 334);
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+      CHECK(deleted.contains(i) == (i % 3 == 0));
+    }
+  }
+  std::remove("deletionSet");
+}
@@ -6,6 +6,7 @@
 #include <KVSRecordsViewer.h>
 #include <iostream>
 #include <random>
+#include <thread>
 
 using namespace kvaaas;
 
@@ -89,6 +90,89 @@ ByteType *gen_random_ptr(int n) {
      offset += bArr.size();
    }
  }
+
+TEST_CASE("Concurrent readers") {
+  FileByteArray arr("fileArrayConcurrent", true);
+  const std::size_t CHUNK = 4096;
+  const std::size_t CHUNKS = 64;
+  std::vector<std::vector<ByteType>> chunks(CHUNKS);
+  for (auto &chunk : chunks) {
+    chunk = gen_random(CHUNK);
+  }
+  arr.append(chunks[0]);
+
+  std::atomic<bool> ok = true;
+  std::vector<std::thread> readers;
+  for (std::size_t t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      for (std::size_t it = 0; it < 500; ++it) {
+        std::size_t ready = arr.size() / CHUNK;
+        std::size_t i = it % ready;
+        if (arr.read(i * CHUNK, (i + 1) * CHUNK) != chunks[i]) {
+          ok = false;
+        }
+      }
+    });
+  }
+  for (std::size_t i = 1; i < CHUNKS; ++i) {
+    arr.append(chunks[i]);
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  CHECK(ok);
+  CHECK(arr.size() == CHUNK * CHUNKS);
+}
+
+TEST_CASE("Rewrite in the middle") {
+  FileByteArray arr("fileArray", true);
+  auto startArr = gen_random(20000);
+  arr.append(startArr);
+  auto changedArr = gen_random(1000);
+  std::copy(changedArr.begin(), changedArr.end(), startArr.begin() + 5000);
+  arr.rewrite(5000, changedArr);
+  arr.append(changedArr);
+  startArr.insert(startArr.end(), changedArr.begin(), changedArr.end());
+  CHECK(arr.size() == startArr.size());
+  CHECK(arr.read(0, startArr.size()) == startArr);
+}
+
+TEST_CASE("Buffered appends are readable before flush") {
+  FileByteArray arr("fileArray", true, 1000);
+  std::vector<ByteType> expected;
+  for (int i = 0; i < 50; ++i) {
+    auto chunk = gen_random(90);
+    arr.append(chunk);
+    expected.insert(expected.end(), chunk.begin(), chunk.end());
+    CHECK(arr.size() == expected.size());
+    CHECK(arr.read(0, expected.size()) == expected);
+  }
+
+  // spans the flushed prefix and the buffered tail
+  std::size_t l = arr.size() - 1500;
+  auto changed = gen_random(1450);
+  std::copy(changed.begin(), changed.end(), expected.begin() + l);
+  arr.rewrite(l, changed);
+  CHECK(arr.read(0, expected.size()) == expected);
+
+  arr.flush();
+  CHECK(arr.read(0, expected.size()) == expected);
+}
+
+TEST_CASE("Buffered appends survive reopen") {
+  auto bytes = gen_random(3000);
+  {
+    FileByteArray arr("fileArrayReopen");
+    arr.append(bytes);
+  }
+  {
+    FileByteArray arr("fileArrayReopen");
+    CHECK(arr.size() == bytes.size());
+    CHECK(arr.read(0, bytes.size()) == bytes);
+  }
+  std::remove("fileArrayReopen");
+}
+
 //
 // TEST_CASE("Rewrite") {
 //   FileByteArray arr("fileArray", true);
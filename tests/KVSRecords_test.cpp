@@ -85,6 +85,235 @@ TEST_CASE("Multiple is_deleted") {
     offset += KVSRecordsViewer::get_value_size(record2);
   }
 }
+TEST_CASE("Values around the read window") {
+  RAMByteArray arr;
+  KVSRecordsViewer viewer(&arr, nullptr);
+
+  const std::uint64_t window =
+      KVSRecordsViewer::READ_WINDOW - KVSRecordsViewer::HEADER_SIZE;
+  std::vector<std::uint64_t> sizes = {0,          1,          window - 1,
+                                      window,     window + 1, 999,
+                                      1000,       2 * window, 5000};
+  std::vector<KVSRecord> records;
+  std::vector<std::uint64_t> offsets;
+  for (auto size : sizes) {
+    KVSRecord record{};
+    record.key[0] = ByteType(size & 0xFF);
+    record.value_size = size;
+    for (std::uint64_t i = 0; i < size; ++i) {
+      record.value.push_back(ByteType(i % 7));
+    }
+    offsets.push_back(viewer.append(record));
+    records.push_back(record);
+  }
+
+  // the last record ends before a full window, the read must not overrun
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    CHECK(viewer.read_record(offsets[i]) == records[i]);
+  }
+  CHECK(viewer.read_records(offsets) == records);
+}
+
+TEST_CASE("Compression options") {
+  RAMByteArray arr;
+  Compressor compressor({3, 10});
+  KVSRecordsViewer viewer(&arr, &compressor);
+
+  KVSRecord small{};
+  small.value_size = 100;
+  small.value = ValueType(100, ByteType(7));
+  auto small_offset = viewer.append(small);
+  // compressible and above min_size, so it is stored compressed
+  CHECK(KVSRecordsViewer::get_value_size(viewer.read_record(small_offset)) <
+        KVSRecordsViewer::HEADER_SIZE + 100);
+
+  KVSRecord noise = gen_random();
+  auto noise_offset = viewer.append(noise);
+  // incompressible values are stored raw
+  CHECK(KVSRecordsViewer::get_value_size(viewer.read_record(noise_offset)) ==
+        KVSRecordsViewer::HEADER_SIZE + noise.value_size);
+
+  // a viewer with other options still reads both
+  Compressor other({19, 1 << 20});
+  KVSRecordsViewer other_viewer(&arr, &other);
+  CHECK(other_viewer.read_record(small_offset) == small);
+  CHECK(other_viewer.read_record(noise_offset) == noise);
+  CHECK(other_viewer.read_records({small_offset, noise_offset}) ==
+        std::vector{small, noise});
+}
+
+TEST_CASE("Dictionaries") {
+  std::vector<ValueType> samples;
+  for (int i = 0; i < 500; ++i) {
+    std::string s = "{\"user\": " + std::to_string(i * 37) +
+                    ", \"state\": \"active\", \"plan\": \"premium\"}";
+    samples.emplace_back(s.size());
+    std::memcpy(samples.back().data(), s.data(), s.size());
+  }
+  auto dict = Compressor::train_dictionary(samples, 1024);
+  REQUIRE(!dict.empty());
+
+  RAMByteArray arr;
+  Compressor compressor({3, 1000, 1024, 16});
+  KVSRecordsViewer viewer(&arr, &compressor);
+  KVSRecord record{};
+  record.value = samples[0];
+  record.value_size = record.value.size();
+
+  auto plain_offset = viewer.append(record);
+  unsigned id = compressor.add_dictionary(dict);
+  REQUIRE(id != 0);
+  CHECK(compressor.dictionary_id() == id);
+  auto dict_offset = viewer.append(record);
+  // short values are only compressed with a dictionary
+  CHECK(KVSRecordsViewer::get_value_size(viewer.read_record(plain_offset)) ==
+        KVSRecordsViewer::HEADER_SIZE + record.value_size);
+  CHECK(KVSRecordsViewer::get_value_size(viewer.read_record(dict_offset)) <
+        KVSRecordsViewer::HEADER_SIZE + record.value_size);
+
+  // records of the previous dictionary stay readable until retain_only_current
+  auto other = Compressor::train_dictionary(
+      std::vector<ValueType>(samples.rbegin(), samples.rend()), 512);
+  REQUIRE(compressor.add_dictionary(other) != 0);
+  auto other_offset = viewer.append(record);
+  CHECK(viewer.read_records({plain_offset, dict_offset, other_offset}) ==
+        std::vector{record, record, record});
+  compressor.retain_only_current();
+  CHECK(viewer.read_record(other_offset) == record);
+  CHECK(viewer.read_record(plain_offset) == record);
+}
+
+TEST_CASE("Value blocks") {
+  FileByteArray arr("fileArray", true);
+  CompressionOptions opt;
+  opt.block_size = 4096;
+  Compressor compressor(opt);
+
+  std::vector<KVSRecord> records;
+  std::vector<std::uint64_t> offsets;
+  {
+    KVSRecordsViewer plain(&arr, nullptr);
+    records.push_back(gen_random());
+    offsets.push_back(plain.append(records.back()));
+  }
+  {
+    KVSRecordsViewer viewer(&arr, &compressor);
+    for (std::size_t i = 0; i < 300; ++i) {
+      KVSRecord record{};
+      record.key[0] = ByteType(i);
+      record.value = ValueType(i % 50, ByteType(i));
+      record.value_size = record.value.size();
+      records.push_back(record);
+      offsets.push_back(viewer.append(record));
+      // readable while the block is still pending
+      CHECK(viewer.read_record(offsets.back()) == record);
+    }
+    CHECK(viewer.read_records(offsets) == records);
+
+    viewer.mark_as_deleted(offsets[1]);
+    viewer.mark_as_deleted(offsets.back());
+    records[1].is_deleted = ByteType{1};
+    records.back().is_deleted = ByteType{1};
+    CHECK(viewer.is_deleted(offsets[1]));
+    CHECK(viewer.is_deleted(offsets.back()));
+    CHECK(!viewer.is_deleted(offsets[2]));
+  }
+
+  // a fresh viewer decodes every block from the array
+  KVSRecordsViewer viewer(&arr, &compressor);
+  CHECK(viewer.is_deleted(offsets[1]));
+  CHECK(viewer.is_deleted(offsets.back()));
+  CHECK(!viewer.is_deleted(offsets[2]));
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    CHECK(viewer.read_record(offsets[i]) == records[i]);
+  }
+  viewer.mark_as_deleted(offsets[2]);
+  CHECK(KVSRecordsViewer(&arr, &compressor).is_deleted(offsets[2]));
+  // records are compressed together, so the array is smaller than the values
+  CHECK(arr.size() < records[0].value.size() + 300 * 25);
+}
+
+TEST_CASE("Chunked values") {
+  for (std::size_t block_size : {0, 4096}) {
+    RAMByteArray arr;
+    CompressionOptions opt;
+    opt.chunk_size = 1000;
+    opt.block_size = block_size;
+    Compressor compressor(opt);
+    KVSRecordsViewer viewer(&arr, &compressor);
+
+    std::vector<KVSRecord> records;
+    std::vector<std::uint64_t> offsets;
+    for (std::uint64_t size : {0, 500, 1000, 1001, 2500, 10000}) {
+      for (bool noise : {false, true}) {
+        KVSRecord record = gen_random();
+        record.is_deleted = ByteType{0};
+        record.value.resize(size);
+        if (!noise) {
+          for (std::uint64_t i = 0; i < size; ++i) {
+            record.value[i] = ByteType(i / 10 % 7);
+          }
+        }
+        record.value_size = size;
+        records.push_back(record);
+        offsets.push_back(viewer.append(record));
+      }
+    }
+    viewer.flush();
+    CHECK(viewer.read_records(offsets) == records);
+
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      const auto &value = records[i].value;
+      CHECK(viewer.read_record(offsets[i]).chunked == (value.size() > 1000));
+      for (std::uint64_t begin : {0, 1, 999, 1000, 1001, 2400, 20000}) {
+        for (std::uint64_t len : {0, 1, 1000, 1500, 100000}) {
+          KVSRecord range = viewer.read_range(offsets[i], begin, len);
+          std::uint64_t from = std::min<std::uint64_t>(begin, value.size());
+          std::uint64_t to = std::min<std::uint64_t>(from + len, value.size());
+          CHECK(range.key == records[i].key);
+          CHECK(range.value_size == value.size());
+          CHECK(range.value == ValueType(value.begin() + from,
+                                         value.begin() + to));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Chunked value as long as its payload") {
+  CompressionOptions opt;
+  opt.chunk_size = 1000;
+  opt.min_size = 1;
+  Compressor compressor(opt);
+  std::mt19937_64 rnd(603);
+  // a noise chunk stays raw, so the payload is value_size once the chunk
+  // table (24 bytes) and the second chunk compressed take 1000 bytes
+  bool collided = false;
+  for (std::size_t noise = 900; noise < 1000 && !collided; ++noise) {
+    RAMByteArray arr;
+    KVSRecordsViewer viewer(&arr, &compressor);
+    KVSRecord record = gen_random();
+    record.is_deleted = ByteType{0};
+    record.value.assign(2000, ByteType{0});
+    record.value_size = record.value.size();
+    for (std::size_t i = 0; i < 1000 + noise; ++i) {
+      record.value[i] = ByteType(rnd());
+    }
+    std::uint64_t offset = viewer.append(record);
+    KVSRecord stored = viewer.read_record(offset);
+    if (stored.compressed_size != stored.value_size) {
+      continue;
+    }
+    collided = true;
+    CHECK(stored.chunked);
+    CHECK(stored == record);
+    CHECK(viewer.read_records({offset}).front() == record);
+    CHECK(viewer.read_range(offset, 990, 20).value ==
+          ValueType(record.value.begin() + 990, record.value.begin() + 1010));
+  }
+  CHECK(collided);
+}
+
 /*
 TEST_CASE("Multiple markDeleted") {
   FileByteArray arr("fileArray", true);
@@ -17,6 +17,28 @@ KvaaasOption little_on_disk{
     3 // kvaaas_cnt
 };
 
+KvaaasOption little_mmap_on_disk{
+    true, ManagerType::MmapMM,
+    2,    // log max size
+    2,    // skip list max size
+    2000, // sst max size
+    0.5,
+    3 // kvaaas_cnt
+};
+
+KvaaasOption little_inline_on_disk{
+    true, ManagerType::FileMM,
+    2,    // log max size
+    2,    // skip list max size
+    2000, // sst max size
+    0.5,
+    3, // kvaaas_cnt
+    0,
+    0,
+    {},
+    64 // inline threshold
+};
+
 KvaaasOption big_on_disk{
     true,   ManagerType::FileMM,
     1000,   // log max size
@@ -125,6 +147,56 @@ TEST_CASE("Remove") {
   }
 }
 
+TEST_CASE("Mmap Remove") {
+  Kvaaas kvaaas("kvaaas_test", little_mmap_on_disk);
+  const std::size_t N = 1200;
+  std::array<KeyType, N> keys{};
+  std::array<ValueType, N> values;
+  for (std::size_t i = 0; i < N; ++i) {
+    keys[i] = gen_key();
+    values[i] = ValueType(100, gen_byte());
+    kvaaas.add(keys[i], values[i]);
+  }
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i % 2) {
+      kvaaas.remove(keys[i]);
+    }
+  }
+
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i % 2) {
+      CHECK(!kvaaas.get(keys[i]));
+    } else {
+      CHECK((*kvaaas.get(keys[i])) == std::pair{keys[i], values[i]});
+    }
+  }
+}
+
+TEST_CASE("Inline Remove") {
+  Kvaaas kvaaas("kvaaas_test", little_inline_on_disk);
+  const std::size_t N = 1200;
+  std::array<KeyType, N> keys{};
+  std::array<ValueType, N> values;
+  for (std::size_t i = 0; i < N; ++i) {
+    keys[i] = gen_key();
+    values[i] = ValueType(i % 3 ? 40 : 100, gen_byte());
+    kvaaas.add(keys[i], values[i]);
+  }
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i % 2) {
+      kvaaas.remove(keys[i]);
+    }
+  }
+
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i % 2) {
+      CHECK(!kvaaas.get(keys[i]));
+    } else {
+      CHECK((*kvaaas.get(keys[i])) == std::pair{keys[i], values[i]});
+    }
+  }
+}
+
 void put(std::map<KeyType, ValueType> &map, Kvaaas &kvaaas, const KeyType &key,
          const ValueType &value) {
   map[key] = value;
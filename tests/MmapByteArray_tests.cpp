@@ -0,0 +1,96 @@
+#include "ByteArray.h"
+#include "doctest.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+
+using namespace kvaaas;
+
+namespace {
+std::vector<ByteType> gen_random(int n) {
+
+  std::vector<ByteType> arr(n);
+  std::random_device rd;
+  std::mt19937_64 rnd(rd());
+  std::uniform_int_distribution<unsigned char> dist;
+
+  for (auto &b : arr) {
+    b = static_cast<std::byte>(dist(rnd));
+  }
+
+  return arr;
+}
+} // namespace
+
+TEST_CASE("Mmap create") {
+  MmapByteArray arr("mmapArray", true);
+  CHECK(arr.size() == 0);
+}
+
+TEST_CASE("Mmap multiple append, but different offsets") {
+  MmapByteArray arr("mmapArray", true);
+  std::vector<std::vector<ByteType>> bArrs(100);
+
+  std::random_device rd;
+  std::mt19937_64 rnd(rd());
+  std::uniform_int_distribution<int> dist(10000, 50000);
+
+  std::size_t count = 0;
+  for (auto &bArr : bArrs) {
+    bArr = gen_random(dist(rnd));
+    arr.append(bArr);
+    count += bArr.size();
+    CHECK(count == arr.size());
+  }
+
+  std::uint64_t offset = 0;
+  for (auto &bArr : bArrs) {
+    CHECK(arr.read(offset, offset + bArr.size()) == bArr);
+    offset += bArr.size();
+  }
+}
+
+TEST_CASE("Mmap rewrite") {
+  MmapByteArray arr("mmapArray", true);
+  auto startArr = gen_random(200000);
+  arr.append(startArr);
+
+  auto changedArr = gen_random(1000);
+  std::copy(changedArr.begin(), changedArr.end(), startArr.begin() + 500);
+  arr.rewrite(500, changedArr.data(), changedArr.size());
+
+  CHECK(arr.size() == startArr.size());
+  std::vector<ByteType> read(startArr.size());
+  arr.read_ptr(read.data(), 0, read.size());
+  CHECK(read == startArr);
+}
+
+TEST_CASE("Mmap reopen keeps logical size") {
+  auto bytes = gen_random(12345);
+  {
+    MmapByteArray arr("mmapArrayReopen");
+    arr.append(bytes);
+  }
+  {
+    MmapByteArray arr("mmapArrayReopen");
+    CHECK(arr.size() == bytes.size());
+    CHECK(arr.read(0, bytes.size()) == bytes);
+  }
+  std::remove("mmapArrayReopen");
+}
+
+TEST_CASE("Mmap does not grow under a view") {
+  MmapByteArray arr("mmapArray", true);
+  auto bytes = gen_random(1000);
+  arr.append(bytes);
+  auto big = gen_random(1 << 17); // past the initial mapping
+  {
+    ByteView view = arr.view(0, bytes.size());
+    CHECK_THROWS_AS(arr.append(big), std::runtime_error);
+    CHECK(arr.size() == bytes.size());
+    CHECK(std::equal(view.begin(), view.end(), bytes.begin()));
+  }
+  arr.append(big);
+  CHECK(arr.size() == bytes.size() + big.size());
+}
@@ -3,6 +3,13 @@
 #include "doctest.h"
 
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <type_traits>
 #include <vector>
 
 namespace {
@@ -240,4 +247,599 @@ TEST_CASE("Shard with map stress-tests") {
   }
 }
 
+ValueType json_value(std::size_t i) {
+  std::string s = R"({"id": )" + std::to_string(i) +
+                  R"(, "name": "user_)" + std::to_string(i * 7919) +
+                  R"(", "email": "user_)" + std::to_string(i) +
+                  R"(@example.com", "tags": ["alpha", "beta", "gamma"], )"
+                  R"("active": )" +
+                  (i % 3 ? "true" : "false") + R"(, "score": )" +
+                  std::to_string(i * 31 % 1000) + "}";
+  ValueType value(s.size());
+  std::memcpy(value.data(), s.data(), s.size());
+  return value;
+}
+
+TEST_CASE("Dictionary compression") {
+  ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5, 0, 0,
+                  CompressionOptions{3, 1000, 4096, 64}};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i % 500), std::byte(i % 500 / 256)};
+    map[key] = json_value(i);
+    shard.add(key, map[key]);
+  }
+  CHECK(shard.get_rebuild_cnt() > 1);
+  CHECK(shard.dictionary_id() != 0);
+  for (const auto &[key, value] : map) {
+    CHECK(shard.get(key) == std::pair{key, value});
+  }
+}
+
+TEST_CASE("Value blocks") {
+  CompressionOptions compression;
+  compression.block_size = 16 * 1024;
+  ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5, 0, 0,
+                  compression};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i % 500), std::byte(i % 500 / 256)};
+    map[key] = json_value(i);
+    shard.add(key, map[key]);
+    if (i % 7 == 0) {
+      shard.remove(key);
+      map.erase(key);
+    }
+  }
+  CHECK(shard.get_rebuild_cnt() > 1);
+  for (std::size_t i = 0; i < 500; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("Value blocks need group commit") {
+  CompressionOptions compression;
+  compression.block_size = 16 * 1024;
+  for (auto mode : {WalMode::NoSync, WalMode::Sync}) {
+    WalOptions wal;
+    wal.mode = mode;
+    ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5, 0, 0,
+                    compression, 0, 0, wal};
+    CHECK_THROWS_AS(Shard("shard_test", opt), std::invalid_argument);
+  }
+  WalOptions wal;
+  wal.mode = WalMode::GroupCommit;
+  ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5, 0, 0,
+                  compression, 0, 0, wal};
+  Shard shard("shard_test", opt);
+  shard.add(KeyType{std::byte(1)}, json_value(1));
+  CHECK(shard.get(KeyType{std::byte(1)}) ==
+        std::pair{KeyType{std::byte(1)}, json_value(1)});
+}
+
+TEST_CASE("Inline small values") {
+  ShardOption opt{true, ManagerType::RAMMM, 20, 100, 100000, 0.5, 0, 0, {},
+                  32};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i % 300), std::byte(i % 300 / 256)};
+    // every third value goes to the KVS
+    map[key] = ValueType(i % 3 ? i % 33 : 100 + i % 50, std::byte(i));
+    shard.add(key, map[key]);
+    if (i % 11 == 0) {
+      shard.remove(key);
+      map.erase(key);
+    }
+  }
+  CHECK(shard.get_rebuild_cnt() > 0);
+  for (std::size_t i = 0; i < 300; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("Batched adds") {
+  ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5, 0, 0,
+                  CompressionOptions{3, 100, 4096, 64}, 16, 4};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t batch = 0; batch < 30; ++batch) {
+    std::vector<std::pair<KeyType, ValueType>> pairs;
+    for (std::size_t i = batch * 100; i < (batch + 1) * 100; ++i) {
+      KeyType key{std::byte(i % 500), std::byte(i % 500 / 256)};
+      // short values are inline, the rest goes through the pool
+      ValueType value =
+          i % 5 ? json_value(i) : ValueType(i % 16, std::byte(i));
+      pairs.emplace_back(key, value);
+      map[key] = value;
+    }
+    shard.add_batch(pairs);
+  }
+  // rebuilds retrain the dictionary between batches
+  CHECK(shard.get_rebuild_cnt() > 1);
+  CHECK(shard.dictionary_id() != 0);
+  for (const auto &[key, value] : map) {
+    CHECK(shard.get(key) == std::pair{key, value});
+  }
+}
+
+TEST_CASE("Value ranges") {
+  CompressionOptions compression;
+  compression.chunk_size = 4096;
+  ShardOption opt{true, ManagerType::RAMMM, 20, 100, 100000, 0.5, 0, 0,
+                  compression, 16};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 300; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    ValueType value;
+    for (std::size_t j = 0; value.size() < i * 137 % 20000; ++j) {
+      auto part = json_value(j);
+      value.insert(value.end(), part.begin(), part.end());
+    }
+    map[key] = value;
+    shard.add(key, value);
+  }
+  for (const auto &[key, value] : map) {
+    for (std::uint64_t begin : {0, 5, 4090, 9000}) {
+      std::uint64_t from = std::min<std::uint64_t>(begin, value.size());
+      std::uint64_t to = std::min<std::uint64_t>(from + 5000, value.size());
+      CHECK(shard.get_range(key, begin, 5000) ==
+            std::pair{key, ValueType(value.begin() + from,
+                                     value.begin() + to)});
+    }
+  }
+  KeyType removed{std::byte(7)};
+  shard.remove(removed);
+  CHECK(!shard.get_range(removed, 0, 10));
+}
+
+TEST_CASE("Removes survive a reopen") {
+  std::filesystem::remove_all("shard_test_dir");
+  std::filesystem::create_directory("shard_test_dir");
+  // no rebuild, so the removes are only in the deletion set, and every
+  // push goes on to the SST, the skip list is not restored on reopen
+  ShardOption create{true, ManagerType::FileMM, 20, 0, 100000, 1e9};
+  ShardOption reopen{false, ManagerType::FileMM, 20, 0, 100000, 1e9};
+  std::map<KeyType, ValueType> map;
+  {
+    Shard shard("shard_test_dir", create);
+    for (std::size_t i = 0; i < 300; ++i) {
+      KeyType key{std::byte(i), std::byte(i / 256)};
+      map[key] = ValueType(100 + i % 50, std::byte(i));
+      shard.add(key, map[key]);
+      if (i % 3 == 0) {
+        shard.remove(key);
+        map.erase(key);
+      }
+    }
+    CHECK(shard.get_rebuild_cnt() == 0);
+  }
+  Shard shard("shard_test_dir", reopen);
+  for (std::size_t i = 0; i < 300; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("Log survives a crash") {
+  ManagerType type = ManagerType::FileMM;
+  SUBCASE("stream") {}
+  // mapped files keep their preallocated tail after a crash
+  SUBCASE("mmap") { type = ManagerType::MmapMM; }
+  std::filesystem::remove_all("shard_wal_dir");
+  std::filesystem::create_directory("shard_wal_dir");
+  WalOptions wal;
+  wal.mode = WalMode::Sync;
+  // the log never fills up, so every entry is only in the log and the WAL
+  ShardOption create{true, type, 100000, 1000, 100000, 1e9,
+                     0,    0,    {},     16,   0,      wal};
+  ShardOption reopen{false, type, 100000, 1000, 100000, 1e9,
+                     0,     0,    {},     16,   0,      wal};
+  std::map<KeyType, ValueType> map;
+  {
+    // never destroyed, as if the process died
+    static std::aligned_storage_t<sizeof(Shard), alignof(Shard)> storage[2];
+    Shard *shard = new (&storage[type == ManagerType::MmapMM])
+        Shard("shard_wal_dir", create);
+    for (std::size_t i = 0; i < 300; ++i) {
+      KeyType key{std::byte(i), std::byte(i / 256)};
+      map[key] = ValueType(i % 3 ? 100 + i : i % 16, std::byte(i));
+      shard->add(key, map[key]);
+      if (i % 7 == 0) {
+        shard->remove(key);
+        map.erase(key);
+      }
+    }
+  }
+  Shard shard("shard_wal_dir", reopen);
+  for (std::size_t i = 0; i < 300; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("WAL commits leave the manifest alone") {
+  std::filesystem::remove_all("shard_commit_dir");
+  std::filesystem::create_directory("shard_commit_dir");
+  WalOptions wal;
+  wal.mode = WalMode::Sync;
+  ShardOption create{true, ManagerType::FileMM, 100000, 1000, 100000, 1e9,
+                     0, 0, {}, 16, 0, wal};
+  auto manifest = [] {
+    std::ifstream is("shard_commit_dir/manifest.json");
+    return std::string(std::istreambuf_iterator<char>(is), {});
+  };
+  Shard shard("shard_commit_dir", create);
+  std::string before = manifest();
+  for (std::size_t i = 0; i < 50; ++i) {
+    KeyType key{std::byte(i)};
+    shard.add(key, ValueType(100, std::byte(i)));
+    if (i % 5 == 0) {
+      shard.remove(key);
+    }
+  }
+  CHECK(manifest() == before);
+}
+
+TEST_CASE("Explicit commit of a group") {
+  std::filesystem::remove_all("shard_group_dir");
+  std::filesystem::create_directory("shard_group_dir");
+  WalOptions wal;
+  wal.mode = WalMode::GroupCommit;
+  wal.group_ops = 1000;
+  wal.group_interval = std::chrono::hours(1);
+  ShardOption create{true, ManagerType::FileMM, 100000, 1000, 100000, 1e9,
+                     0, 0, {}, 16, 0, wal};
+  ShardOption reopen{false, ManagerType::FileMM, 100000, 1000, 100000, 1e9,
+                     0, 0, {}, 16, 0, wal};
+  auto key = [](std::size_t i) { return KeyType{std::byte(i)}; };
+  auto value = [](std::size_t i) { return ValueType(100, std::byte(i)); };
+  // never destroyed, as if the process died
+  static std::aligned_storage_t<sizeof(Shard), alignof(Shard)> storage;
+  Shard *shard = new (&storage) Shard("shard_group_dir", create);
+  for (std::size_t i = 0; i < 5; ++i) {
+    shard->add(key(i), value(i));
+  }
+  // neither the group size nor the interval is reached
+  shard->commit();
+  shard->add(key(5), value(5));
+
+  Shard reopened("shard_group_dir", reopen);
+  for (std::size_t i = 0; i < 5; ++i) {
+    CHECK(reopened.get(key(i)) == std::pair{key(i), value(i)});
+  }
+  CHECK(!reopened.get(key(5)));
+}
+
+TEST_CASE("Closed shard reopens") {
+  std::filesystem::remove_all("shard_close_dir");
+  std::filesystem::create_directory("shard_close_dir");
+  ShardOption create{true, ManagerType::FileMM, 100, 1000, 100000, 1e9};
+  ShardOption reopen{false, ManagerType::FileMM, 100, 1000, 100000, 1e9};
+  auto key = [](std::size_t i) { return KeyType{std::byte(i)}; };
+  auto value = [](std::size_t i) { return ValueType(100, std::byte(i)); };
+  {
+    Shard shard("shard_close_dir", create);
+    for (std::size_t i = 0; i < 150; ++i) {
+      shard.add(key(i), value(i));
+    }
+    shard.close();
+    shard.close(); // a no-op, as is the destructor
+  }
+  Shard reopened("shard_close_dir", reopen);
+  for (std::size_t i = 0; i < 150; ++i) {
+    CHECK(reopened.get(key(i)) == std::pair{key(i), value(i)});
+  }
+}
+
+TEST_CASE("Rebuilds survive a crash") {
+  ManagerType type = ManagerType::FileMM;
+  SUBCASE("stream") {}
+  SUBCASE("mmap") { type = ManagerType::MmapMM; }
+  std::filesystem::remove_all("shard_rebuild_dir");
+  std::filesystem::create_directory("shard_rebuild_dir");
+  WalOptions wal;
+  wal.mode = WalMode::Sync;
+  ShardOption create{true, type, 20, 100, 100000, 0.5,
+                     0,    0,    {}, 16,  0,      wal};
+  ShardOption reopen{false, type, 20, 100, 100000, 0.5,
+                     0,     0,    {}, 16,  0,      wal};
+  std::map<KeyType, ValueType> map;
+  // never destroyed, as if the process died
+  static std::aligned_storage_t<sizeof(Shard), alignof(Shard)> storage[2];
+  Shard *shard = new (&storage[type == ManagerType::MmapMM])
+      Shard("shard_rebuild_dir", create);
+  for (std::size_t i = 0; i < 1000; ++i) {
+    KeyType key{std::byte(i % 300), std::byte(i % 300 / 256)};
+    if (i % 4 == 3) {
+      shard->remove(key);
+      map.erase(key);
+    } else {
+      map[key] = ValueType(i % 3 ? 100 + i % 50 : i % 16, std::byte(i));
+      shard->add(key, map[key]);
+    }
+  }
+  CHECK(shard->get_rebuild_cnt() > 0);
+
+  Shard reopened("shard_rebuild_dir", reopen);
+  for (std::size_t i = 0; i < 300; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!reopened.get(key));
+    } else {
+      CHECK(reopened.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("Torn WAL tail is cut at open") {
+  std::filesystem::remove_all("shard_torn_dir");
+  std::filesystem::create_directory("shard_torn_dir");
+  WalOptions wal;
+  wal.mode = WalMode::Sync;
+  ShardOption create{true, ManagerType::FileMM, 100000, 1000, 100000, 1e9,
+                     0, 0, {}, 16, 0, wal};
+  ShardOption reopen{false, ManagerType::FileMM, 100000, 1000, 100000, 1e9,
+                     0, 0, {}, 16, 0, wal};
+  auto key = [](std::size_t i) { return KeyType{std::byte(i)}; };
+  auto value = [](std::size_t i) { return ValueType(100, std::byte(i)); };
+  // never destroyed, as if the process died
+  static std::aligned_storage_t<sizeof(Shard), alignof(Shard)> storage[2];
+  Shard *shard = new (&storage[0]) Shard("shard_torn_dir", create);
+  for (std::size_t i = 0; i < 5; ++i) {
+    shard->add(key(i), value(i));
+  }
+  {
+    // a record the crash cut short
+    nlohmann::json manifest;
+    std::ifstream("shard_torn_dir/manifest.json") >> manifest;
+    std::ofstream(manifest.at("_log_wal").get<std::string>(),
+                  std::ios::app | std::ios::binary)
+        << "torn";
+  }
+  shard = new (&storage[1]) Shard("shard_torn_dir", reopen);
+  shard->add(key(99), value(99));
+
+  Shard reopened("shard_torn_dir", reopen);
+  for (std::size_t i : {0, 1, 2, 3, 4, 99}) {
+    CHECK(reopened.get(key(i)) == std::pair{key(i), value(i)});
+  }
+}
+
+TEST_CASE("Skip list survives a reopen") {
+  std::filesystem::remove_all("shard_sl_dir");
+  std::filesystem::create_directory("shard_sl_dir");
+  // entries end up in the skip list, not in the SST
+  ShardOption create{true, ManagerType::FileMM, 20, 1000, 100000, 1e9};
+  ShardOption reopen{false, ManagerType::FileMM, 20, 1000, 100000, 1e9};
+  std::map<KeyType, ValueType> map;
+  {
+    Shard shard("shard_sl_dir", create);
+    for (std::size_t i = 0; i < 300; ++i) {
+      KeyType key{std::byte(i), std::byte(i / 256)};
+      map[key] = ValueType(100 + i, std::byte(i));
+      shard.add(key, map[key]);
+    }
+  }
+  Shard shard("shard_sl_dir", reopen);
+  for (const auto &[key, value] : map) {
+    CHECK(shard.get(key) == std::pair{key, value});
+  }
+}
+
+TEST_CASE("Reopen with another inline threshold") {
+  std::filesystem::remove_all("shard_inline_dir");
+  std::filesystem::create_directory("shard_inline_dir");
+  ShardOption create{true, ManagerType::FileMM, 20, 1000, 100000, 1e9,
+                     0,    0,                   {}, 16};
+  ShardOption reopen{false, ManagerType::FileMM, 20, 1000, 100000, 1e9,
+                     0,     0,                   {}, 16};
+  ShardOption other{false, ManagerType::FileMM, 20, 1000, 100000, 1e9,
+                    0,     0,                   {}, 32};
+  KeyType key{std::byte(1)};
+  ValueType value(8, std::byte(1));
+  {
+    Shard shard("shard_inline_dir", create);
+    shard.add(key, value);
+  }
+  // inlined values are read with the slot size they were written with
+  CHECK_THROWS_AS(Shard("shard_inline_dir", other), std::runtime_error);
+  Shard shard("shard_inline_dir", reopen);
+  CHECK(shard.get(key) == std::pair{key, value});
+}
+
+TEST_CASE("Background flush") {
+  // at most two full logs wait for the flusher, reads see all of them
+  ShardOption opt{true, ManagerType::RAMMM, 20, 100, 100000, 0.5, 0, 0,
+                  {},   16,                 0,  {},  2};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i * 7 % 600), std::byte(i * 7 % 600 / 256)};
+    if (i % 5 == 4) {
+      shard.remove(key);
+      map.erase(key);
+    } else {
+      map[key] = ValueType(i % 3 ? 100 + i % 50 : i % 16, std::byte(i));
+      shard.add(key, map[key]);
+    }
+    KeyType probe{std::byte(i * 13 % 600), std::byte(i * 13 % 600 / 256)};
+    auto it = map.find(probe);
+    if (it == map.end()) {
+      CHECK(!shard.get(probe));
+    } else {
+      CHECK(shard.get(probe) == std::pair{probe, it->second});
+    }
+  }
+  CHECK(shard.get_rebuild_cnt() > 0);
+}
+
+TEST_CASE("Background flush survives a reopen") {
+  std::filesystem::remove_all("shard_bg_dir");
+  std::filesystem::create_directory("shard_bg_dir");
+  WalOptions wal;
+  wal.mode = WalMode::GroupCommit;
+  ShardOption create{true, ManagerType::FileMM, 20, 200, 100000, 1e9,
+                     0,    0,                   {}, 16,  0,      wal, 1};
+  ShardOption reopen{false, ManagerType::FileMM, 20, 200, 100000, 1e9,
+                     0,     0,                   {}, 16,  0,      wal, 1};
+  std::map<KeyType, ValueType> map;
+  {
+    Shard shard("shard_bg_dir", create);
+    for (std::size_t i = 0; i < 1000; ++i) {
+      KeyType key{std::byte(i), std::byte(i / 256)};
+      map[key] = ValueType(i % 3 ? 100 + i % 50 : i % 16, std::byte(i));
+      shard.add(key, map[key]);
+    }
+  }
+  Shard shard("shard_bg_dir", reopen);
+  for (const auto &[key, value] : map) {
+    CHECK(shard.get(key) == std::pair{key, value});
+  }
+}
+
+TEST_CASE("Index pushed in the background survives a crash") {
+  WalOptions wal;
+  wal.mode = WalMode::Sync;
+  for (auto index : {IndexType::SkipList, IndexType::BPlusTree}) {
+    std::filesystem::remove_all("shard_push_dir");
+    std::filesystem::create_directory("shard_push_dir");
+    ShardOption create{true, ManagerType::FileMM, 20, 1000, 100000, 1e9,
+                       0,    0,                   {}, 16,   0,      wal,
+                       1,    index};
+    ShardOption reopen{false, ManagerType::FileMM, 20, 1000, 100000, 1e9,
+                       0,     0,                   {}, 16,   0,      wal,
+                       1,     index};
+    std::map<KeyType, ValueType> map;
+    // never destroyed, as if the process died
+    static std::aligned_storage_t<sizeof(Shard), alignof(Shard)> storage[2];
+    Shard *shard = new (&storage[index == IndexType::BPlusTree])
+        Shard("shard_push_dir", create);
+    // the last add hands the full log to the flusher, no write follows
+    for (std::size_t i = 0; i < 21; ++i) {
+      KeyType key{std::byte(i)};
+      map[key] = ValueType(100 + i, std::byte(i));
+      shard->add(key, map[key]);
+    }
+    shard->wait_for_background_flush();
+
+    Shard reopened("shard_push_dir", reopen);
+    for (const auto &[key, value] : map) {
+      CHECK(reopened.get(key) == std::pair{key, value});
+    }
+  }
+}
+
+TEST_CASE("B+-tree index") {
+  std::filesystem::remove_all("shard_tree_dir");
+  std::filesystem::create_directory("shard_tree_dir");
+  ShardOption create{true, ManagerType::FileMM, 20, 500, 100000, 0.5,
+                     0,    0,                   {}, 16,  0,      {},
+                     0,    IndexType::BPlusTree};
+  ShardOption reopen{false, ManagerType::FileMM, 20, 500, 100000, 0.5,
+                     0,     0,                   {}, 16,  0,      {},
+                     0,     IndexType::BPlusTree};
+  std::map<KeyType, ValueType> map;
+  {
+    Shard shard("shard_tree_dir", create);
+    for (std::size_t i = 0; i < 2000; ++i) {
+      KeyType key{std::byte(i * 7 % 900), std::byte(i * 7 % 900 / 256)};
+      if (i % 6 == 5) {
+        shard.remove(key);
+        map.erase(key);
+      } else {
+        map[key] = ValueType(i % 3 ? 100 + i % 50 : i % 16, std::byte(i));
+        shard.add(key, map[key]);
+      }
+    }
+    CHECK(shard.get_rebuild_cnt() > 0);
+  }
+  Shard shard("shard_tree_dir", reopen);
+  for (std::size_t i = 0; i < 900; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+}
+
+TEST_CASE("Concurrent skip list index") {
+  ShardOption opt{true, ManagerType::RAMMM,          20, 300, 100000, 0.5,
+                  0,    0,                           {}, 16,  0,      {},
+                  2,    IndexType::ConcurrentSkipList};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i * 7 % 700), std::byte(i * 7 % 700 / 256)};
+    if (i % 5 == 4) {
+      shard.remove(key);
+      map.erase(key);
+    } else {
+      map[key] = ValueType(i % 3 ? 100 + i % 50 : i % 16, std::byte(i));
+      shard.add(key, map[key]);
+    }
+  }
+  for (std::size_t i = 0; i < 700; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    auto it = map.find(key);
+    if (it == map.end()) {
+      CHECK(!shard.get(key));
+    } else {
+      CHECK(shard.get(key) == std::pair{key, it->second});
+    }
+  }
+
+  ShardOption on_disk{true, ManagerType::FileMM, 20, 300, 100000, 0.5,
+                      0,    0,                   {}, 16,  0,      {},
+                      0,    IndexType::ConcurrentSkipList};
+  std::filesystem::create_directory("shard_csl_dir");
+  CHECK_THROWS_AS(Shard("shard_csl_dir", on_disk), std::invalid_argument);
+  std::filesystem::remove_all("shard_csl_dir");
+}
+
+TEST_CASE("Huge page arrays") {
+  ShardOption opt{true, ManagerType::RAMMM, 100, 1000, 100000, 0.5,
+                  0,    0,                  {},  0,    0,      {},
+                  0,    IndexType::SkipList, true};
+  Shard shard("shard_test", opt);
+  std::map<KeyType, ValueType> map;
+  for (std::size_t i = 0; i < 3000; ++i) {
+    KeyType key{std::byte(i % 1000), std::byte(i % 1000 / 256)};
+    map[key] = ValueType(100 + i % 50, std::byte(i));
+    shard.add(key, map[key]);
+  }
+  for (const auto &[key, value] : map) {
+    CHECK(shard.get(key) == std::pair{key, value});
+  }
+}
+
 } // namespace
@@ -0,0 +1,123 @@
+#include "WriteAheadLog.h"
+
+#include "doctest.h"
+
+#include <vector>
+
+using namespace kvaaas;
+
+namespace {
+std::vector<std::pair<KeyType, IndexEntry>> gen_entries(std::size_t n) {
+  std::vector<std::pair<KeyType, IndexEntry>> entries;
+  for (std::size_t i = 0; i < n; ++i) {
+    KeyType key{std::byte(i), std::byte(i / 256)};
+    IndexEntry entry{i * 100};
+    if (i % 3 == 0) {
+      entry.offset = INLINE_OFFSET;
+      entry.value = InlineValue(ValueType(i % 65, std::byte(i)));
+    }
+    entries.emplace_back(key, entry);
+  }
+  return entries;
+}
+
+void check_log(Log &log,
+               const std::vector<std::pair<KeyType, IndexEntry>> &entries) {
+  CHECK(log.size() == entries.size());
+  for (const auto &[key, entry] : entries) {
+    auto found = log.get_entry(key);
+    REQUIRE(found);
+    CHECK(found->offset == entry.offset);
+    CHECK(found->value == entry.value);
+  }
+}
+} // namespace
+
+TEST_CASE("WAL replay") {
+  RAMByteArray arr;
+  auto entries = gen_entries(1000);
+  {
+    WriteAheadLog wal(&arr, {WalMode::Sync});
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      wal.append(entries[i].first, entries[i].second);
+      CHECK(wal.due());
+      wal.commit({i, 2 * i});
+    }
+  }
+  WriteAheadLog wal(&arr, {WalMode::Sync});
+  Log log;
+  CHECK(wal.replay(log) == entries.size());
+  check_log(log, entries);
+  REQUIRE(wal.committed());
+  CHECK(wal.committed()->kvs == entries.size() - 1);
+  CHECK(wal.committed()->deleted == 2 * (entries.size() - 1));
+  CHECK(wal.intact_size() == arr.size());
+}
+
+TEST_CASE("WAL replay stops at a torn record") {
+  RAMByteArray arr;
+  auto entries = gen_entries(10);
+  WriteAheadLog wal(&arr, {WalMode::NoSync});
+  for (const auto &[key, entry] : entries) {
+    wal.append(key, entry);
+  }
+  wal.commit({1, 2});
+  std::size_t intact = arr.size();
+  wal.append(KeyType{std::byte(200)}, IndexEntry{7});
+  wal.commit({3, 4});
+
+  SUBCASE("truncated") {
+    RAMByteArray torn;
+    torn.append(arr.read(0, arr.size() - 3));
+    Log log;
+    WriteAheadLog replayed(&torn, {});
+    CHECK(replayed.replay(log) == entries.size());
+    CHECK(replayed.intact_size() == intact);
+    check_log(log, entries);
+  }
+  SUBCASE("corrupted") {
+    ByteType garbage{0xFF};
+    arr.rewrite(intact + 10, &garbage, 1);
+    Log log;
+    WriteAheadLog replayed(&arr, {});
+    CHECK(replayed.replay(log) == entries.size());
+    CHECK(replayed.intact_size() == intact);
+    check_log(log, entries);
+  }
+  SUBCASE("uncommitted") {
+    RAMByteArray uncommitted;
+    uncommitted.append(
+        arr.read(0, arr.size() - WriteAheadLog::COMMIT_RECORD_SIZE));
+    Log log;
+    WriteAheadLog replayed(&uncommitted, {});
+    CHECK(replayed.replay(log) == entries.size());
+    CHECK(replayed.intact_size() == intact);
+    check_log(log, entries);
+  }
+  SUBCASE("intact") {
+    Log log;
+    WriteAheadLog replayed(&arr, {});
+    CHECK(replayed.replay(log) == entries.size() + 1);
+    REQUIRE(replayed.committed());
+    CHECK(replayed.committed()->kvs == 3);
+  }
+}
+
+TEST_CASE("WAL group commit") {
+  RAMByteArray arr;
+  WalOptions opt;
+  opt.mode = WalMode::GroupCommit;
+  opt.group_ops = 10;
+  opt.group_interval = std::chrono::hours(1);
+  WriteAheadLog wal(&arr, opt);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 9; ++i) {
+      CHECK(!wal.due());
+    }
+    CHECK(wal.due());
+    wal.commit({});
+  }
+  opt.group_interval = std::chrono::microseconds(0);
+  WriteAheadLog timed(&arr, opt);
+  CHECK(timed.due());
+}
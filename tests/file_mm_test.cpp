@@ -4,7 +4,10 @@
 #include "doctest.h"
 
 #include <filesystem>
+#include <fstream>
 #include <iostream> // see later
+#include <sys/wait.h>
+#include <unistd.h>
 namespace {
 
 constexpr bool CREATE_N_DELETE_DIRS = true;
@@ -111,4 +114,150 @@ TEST_CASE("Overwrite + restore") {
   auto sst = manager.get_byte_array(MemoryPurpose::SST);
   CHECK(sst->read(0, 100) == std::vector<std::byte>(100, std::byte(42)));
 }
+TEST_CASE("Mmap overwrite + restore") {
+  RAIDir _("fmm_test5");
+  {
+    FileMemoryManager manager("fmm_test5", {FileBackend::Mmap});
+    auto sst_old = manager.create_byte_array(MemoryPurpose::SST);
+    sst_old->append(std::vector<std::byte>(100, std::byte(0)));
+
+    auto new_sst = manager.start_overwrite(MemoryPurpose::SST);
+    new_sst->append(std::vector<std::byte>(1000, std::byte(42)));
+    manager.end_overwrite(MemoryPurpose::SST);
+  }
+
+  FileMemoryManager manager =
+      FileMemoryManager::from_dir("fmm_test5", {FileBackend::Mmap});
+  auto sst = manager.get_byte_array(MemoryPurpose::SST);
+  CHECK(sst->size() == 1000);
+  CHECK(sst->read(0, 100) == std::vector<std::byte>(100, std::byte(42)));
+}
+TEST_CASE("Preallocated files keep their logical size") {
+  RAIDir _("fmm_test6");
+  FileMemoryOptions opt;
+  opt.grow_step[MemoryPurpose::KVS] = 1 << 20;
+  std::string kvs_name;
+  {
+    FileMemoryManager manager("fmm_test6", opt);
+    auto kvs = manager.create_byte_array(MemoryPurpose::KVS);
+    for (int i = 0; i < 100; ++i) {
+      kvs->append(std::vector<std::byte>(1000, std::byte(i)));
+    }
+    kvs->flush();
+    kvs_name = dynamic_cast<FileBackedByteArray *>(kvs)->file_name();
+    CHECK(std::filesystem::file_size(kvs_name) == 100'000);
+  }
+  CHECK(std::filesystem::file_size(kvs_name) == 100'000);
+
+  FileMemoryManager manager = FileMemoryManager::from_dir("fmm_test6", opt);
+  auto kvs = manager.get_byte_array(MemoryPurpose::KVS);
+  CHECK(kvs->size() == 100'000);
+  kvs->append({std::byte(42)});
+  CHECK(kvs->read(99'999, 100'001) ==
+        std::vector<std::byte>{std::byte(99), std::byte(42)});
+}
+
+// runs child in a forked process that exits without running the
+// destructors of what child leaks, as if it crashed, returns its status
+template <typename F> int run_and_crash(F child) {
+  pid_t pid = ::fork();
+  if (pid == 0) {
+    int code = 0;
+    try {
+      child();
+    } catch (...) {
+      code = 1;
+    }
+    ::_exit(code);
+  }
+  int status = -1;
+  ::waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST_CASE("Checkpoint hides an unclean tail") {
+  RAIDir _("fmm_test7");
+  CHECK(run_and_crash([] {
+          auto *manager = new FileMemoryManager("fmm_test7");
+          auto sst = manager->create_byte_array(MemoryPurpose::SST);
+          sst->append(std::vector<std::byte>(100, std::byte(1)));
+          sst->sync();
+          manager->checkpoint(true);
+          // reaches the file, but no checkpoint accounts for it
+          sst->append(std::vector<std::byte>(10, std::byte(3)));
+          sst->flush();
+        }) == 0);
+
+  FileMemoryManager manager = FileMemoryManager::from_dir("fmm_test7");
+  auto sst = manager.get_byte_array(MemoryPurpose::SST);
+  CHECK(sst->size() == 100);
+  sst->append({std::byte(2)});
+  CHECK(sst->read(99, 101) ==
+        std::vector<std::byte>{std::byte(1), std::byte(2)});
+}
+
+TEST_CASE("Mapped file after an unclean exit") {
+  RAIDir _("fmm_test9");
+  FileMemoryOptions opt{FileBackend::Mmap};
+  CHECK(run_and_crash([&] {
+          // the file is as long as the mapping until a clean close
+          auto *manager = new FileMemoryManager("fmm_test9", opt);
+          auto sst = manager->create_byte_array(MemoryPurpose::SST);
+          sst->append(std::vector<std::byte>(100, std::byte(1)));
+          sst->sync();
+          manager->checkpoint(true);
+        }) == 0);
+
+  FileMemoryManager manager = FileMemoryManager::from_dir("fmm_test9", opt);
+  auto sst = manager.get_byte_array(MemoryPurpose::SST);
+  CHECK(sst->size() == 100);
+  sst->append({std::byte(2)});
+  CHECK(sst->read(99, 101) ==
+        std::vector<std::byte>{std::byte(1), std::byte(2)});
+}
+
+TEST_CASE("Overwrites end together") {
+  RAIDir _("fmm_test11");
+  {
+    FileMemoryManager manager("fmm_test11");
+    manager.create_byte_array(MemoryPurpose::KVS)->append({std::byte(1)});
+    manager.create_byte_array(MemoryPurpose::KVS_DELETED)
+        ->append({std::byte(1)});
+    manager.start_overwrite(MemoryPurpose::KVS)->append({std::byte(2)});
+    manager.start_overwrite(MemoryPurpose::KVS_DELETED)
+        ->append({std::byte(2)});
+    manager.end_overwrites({MemoryPurpose::KVS, MemoryPurpose::KVS_DELETED});
+  }
+  FileMemoryManager manager = FileMemoryManager::from_dir("fmm_test11");
+  for (auto purpose : {MemoryPurpose::KVS, MemoryPurpose::KVS_DELETED}) {
+    CHECK(manager.get_byte_array(purpose)->read(0, 1) ==
+          std::vector{std::byte(2)});
+  }
+}
+
+TEST_CASE("Manifest of another format version") {
+  RAIDir _("fmm_test8");
+  {
+    FileMemoryManager manager("fmm_test8");
+    manager.create_byte_array(MemoryPurpose::SKIP_LIST_BL);
+  }
+  CHECK_NOTHROW(FileMemoryManager::from_dir("fmm_test8"));
+  // written before the manifest had a version
+  std::ofstream("fmm_test8/manifest.json") << "{}";
+  CHECK_THROWS_AS(FileMemoryManager::from_dir("fmm_test8"),
+                  std::runtime_error);
+}
+
+TEST_CASE("Manifest of another inline capacity") {
+  RAIDir _("fmm_test10");
+  FileMemoryOptions opt;
+  opt.inline_capacity = 16;
+  {
+    FileMemoryManager manager("fmm_test10", opt);
+    manager.create_byte_array(MemoryPurpose::SST);
+  }
+  CHECK_THROWS_AS(FileMemoryManager::from_dir("fmm_test10"),
+                  std::runtime_error);
+  CHECK_NOTHROW(FileMemoryManager::from_dir("fmm_test10", opt));
+}
 } // namespace
@@ -4,6 +4,7 @@
 #include "doctest.h"
 
 #include <algorithm>
+#include <random>
 #include <unordered_map>
 
 namespace kvaaas {
@@ -13,6 +14,52 @@ TEST_CASE("JustWorks") {
   std::byte z = std::byte{0};
   mapa[KeyType{z, z, z}] = 2;
   log.add(KeyType{z, z, z}, 2);
-  CHECK(std::equal(log.begin(), log.end(), mapa.begin(), mapa.end()));
+  CHECK(std::equal(log.begin(), log.end(), mapa.begin(), mapa.end(),
+                   [](const auto &entry, const auto &expected) {
+                     return entry.first == expected.first &&
+                            entry.second.offset == expected.second;
+                   }));
+}
+
+TEST_CASE("Same as unordered_map") {
+  std::mt19937_64 rnd(42);
+  std::unordered_map<KeyType, std::uint64_t> mapa;
+  Log log;
+  for (int round = 0; round < 3; ++round) {
+    // outside the random keys, gone after the clear of its round
+    KeyType key_of_round{std::byte(200 + round)};
+    log.add(key_of_round, 0);
+    mapa[key_of_round] = 0;
+    for (std::uint64_t i = 0; i < 20000; ++i) {
+      // few distinct keys, so adds overwrite and removes hit
+      KeyType key{};
+      key[rnd() % key.size()] = std::byte(rnd() % 64);
+      key[0] = std::byte(rnd() % 64);
+      if (rnd() % 4 == 0) {
+        mapa.erase(key);
+        log.remove(key);
+      } else {
+        mapa[key] = i;
+        log.add(key, i);
+      }
+    }
+    CHECK(log.size() == mapa.size());
+    for (const auto &[key, offset] : mapa) {
+      CHECK(log.get_offset(key) == offset);
+    }
+    std::size_t seen = 0;
+    for (const auto &[key, entry] : log) {
+      CHECK(mapa.at(key) == entry.offset);
+      ++seen;
+    }
+    CHECK(seen == mapa.size());
+    CHECK(!log.get_entry(KeyType{std::byte(100)}));
+
+    log.clear();
+    mapa.clear();
+    CHECK(log.size() == 0);
+    CHECK(log.begin() == log.end());
+    CHECK(!log.get_offset(key_of_round));
+  }
 }
 } // namespace kvaaas
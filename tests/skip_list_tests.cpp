@@ -35,6 +35,7 @@ TEST_CASE("SLBottomLevelRecordViewer tests") {
   std::mt19937_64 rnd(rd());
   for (std::size_t i = 0; i < SIZE; ++i) {
     records[i].next = rnd();
+    records[i].next_prefix = rnd();
     records[i].offset = rnd();
     for (ByteType &j : records[i].key) {
       j = static_cast<ByteType>(rnd() % (UCHAR_MAX + 1));
@@ -79,6 +80,7 @@ TEST_CASE("SLUpperLevelRecordViewer tests") {
   std::vector<SLUpperLevelRecord> records(SIZE);
   for (std::size_t i = 0; i < SIZE; ++i) {
     records[i].next = rnd();
+    records[i].next_prefix = rnd();
     records[i].down = rnd();
     for (ByteType &j : records[i].key) {
       j = static_cast<ByteType>(rnd() % (UCHAR_MAX + 1));
@@ -100,6 +102,36 @@ TEST_CASE("SLUpperLevelRecordViewer tests") {
   }
 }
 
+TEST_CASE("SLUpperLevelRecordViewer reloads its mirror") {
+  FileByteArray arr("skipListFile", true);
+  FileByteArray heads_arr("HeadsFile", true);
+  SLUpperLevelRecordViewer viewer(&arr, &heads_arr);
+  static constexpr std::size_t SIZE = 100;
+  std::mt19937_64 rnd(0);
+  for (std::size_t i = 0; i < SIZE; ++i) {
+    SLUpperLevelRecord record;
+    record.next = rnd();
+    record.next_prefix = rnd();
+    record.down = rnd();
+    for (ByteType &byte : record.key) {
+      byte = static_cast<ByteType>(rnd() % (UCHAR_MAX + 1));
+    }
+    viewer.append_record(record);
+    viewer.append_head(rnd());
+  }
+  for (std::size_t i = 0; i < SIZE; i += 3) {
+    viewer.set_next(i, {rnd(), rnd()});
+    viewer.set_head(i, rnd());
+  }
+  // a viewer over the same arrays starts from what the first one wrote
+  SLUpperLevelRecordViewer reloaded(&arr, &heads_arr);
+  REQUIRE(reloaded.get_levels() == SIZE);
+  for (std::size_t i = 0; i < SIZE; ++i) {
+    CHECK(reloaded[i] == viewer[i]);
+    CHECK(reloaded.get_head(i) == viewer.get_head(i));
+  }
+}
+
 namespace {
 
 ByteType gen_byte() {
@@ -363,4 +395,140 @@ TEST_CASE("SkipList with map stress-tests") {
   }
 }
 
-} // namespace
\ No newline at end of file
+TEST_CASE("SkipList bulk pushes") {
+  std::mt19937_64 rnd(0);
+  RAMByteArray bottom;
+  RAMByteArray heads;
+  RAMByteArray upper;
+  SLBottomLevelRecordViewer bottom_viewer(&bottom);
+  SkipList skip_list(bottom_viewer, SLUpperLevelRecordViewer(&upper, &heads),
+                     SKIP_LIST_ESTIMATED_SIZE);
+  std::map<KeyType, std::uint64_t> map;
+  std::vector<KeyType> used_keys;
+  // small batches are sorted by comparison, big ones by radix
+  for (std::size_t batch_size : {1, 5, 300, 2, 1000, 63, 64, 2000}) {
+    std::vector<std::pair<KeyType, std::uint64_t>> batch;
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      KeyType key = gen_key();
+      if (!used_keys.empty() && rnd() % 3 == 0) {
+        key = used_keys[rnd() % used_keys.size()];
+      }
+      // only a few bytes differ, so most radix passes are skipped
+      if (rnd() % 2 == 0) {
+        std::fill(key.begin() + 2, key.end(), ByteType{7});
+      }
+      used_keys.push_back(key);
+      batch.emplace_back(key, gen_offset());
+      // the later pair with a key wins
+      map[key] = batch.back().second;
+    }
+    skip_list.push_from(batch.begin(), batch.end());
+    KeyType key = gen_key();
+    put(map, skip_list, key, gen_offset());
+    used_keys.push_back(key);
+  }
+  CHECK(skip_list.size() == map.size());
+  for (const auto &[key, offset] : map) {
+    CHECK(skip_list.find(key) == offset);
+  }
+  auto it = skip_list.begin();
+  for (const auto &[key, offset] : map) {
+    REQUIRE(it != skip_list.end());
+    CHECK(*it == SSTRecord{key, offset});
+    ++it;
+  }
+  CHECK(it == skip_list.end());
+}
+
+TEST_CASE("SkipList with inline values") {
+  RAMByteArray bottom;
+  RAMByteArray upper;
+  RAMByteArray heads;
+  SLBottomLevelRecordViewer bottom_viewer(&bottom, 16);
+  SkipList skip_list(bottom_viewer, SLUpperLevelRecordViewer(&upper, &heads),
+                     SKIP_LIST_ESTIMATED_SIZE);
+
+  std::map<KeyType, ValueType> values;
+  for (std::size_t i = 0; i < 200; ++i) {
+    KeyType key{std::byte(i % 100)};
+    ValueType value(i % 17, std::byte(i));
+    values[key] = value;
+    skip_list.put(key, IndexEntry{INLINE_OFFSET, InlineValue(value)});
+  }
+  skip_list.put({std::byte(200)}, 42);
+
+  for (const auto &[key, value] : values) {
+    auto entry = skip_list.find_entry(key);
+    REQUIRE(entry);
+    CHECK(entry->offset == INLINE_OFFSET);
+    CHECK(entry->value.to_value() == value);
+  }
+  CHECK(skip_list.find({std::byte(200)}) == 42);
+  auto it = skip_list.begin();
+  CHECK((*it).value.to_value() == values.begin()->second);
+}
+
+TEST_CASE("SkipList links carry the next key prefix") {
+  CHECK(key_prefix({std::byte(1), std::byte(2), std::byte(0xFF)}) ==
+        0x0102FF0000000000ULL);
+  std::mt19937_64 rnd(1);
+  RAMByteArray bottom;
+  RAMByteArray heads;
+  RAMByteArray upper;
+  std::map<KeyType, std::uint64_t> map;
+  {
+    SkipList skip_list(SLBottomLevelRecordViewer(&bottom),
+                       SLUpperLevelRecordViewer(&upper, &heads),
+                       SKIP_LIST_ESTIMATED_SIZE);
+    std::vector<std::pair<KeyType, std::uint64_t>> batch;
+    for (std::size_t i = 0; i < 3000; ++i) {
+      KeyType key = gen_key();
+      // every other key ties on the prefix with many others
+      if (i % 2 == 0) {
+        std::fill(key.begin(), key.begin() + 8, ByteType(rnd() % 3));
+      }
+      if (i % 3 == 0) {
+        batch.emplace_back(key, i);
+        map[key] = i;
+      } else {
+        put(map, skip_list, key, i);
+      }
+    }
+    skip_list.push_from(batch.begin(), batch.end());
+    for (std::size_t i = 0; i < 1000; ++i) {
+      KeyType key = gen_key();
+      std::fill(key.begin(), key.begin() + 8, ByteType(rnd() % 3));
+      auto it = map.find(key);
+      CHECK(skip_list.find(key) == (it == map.end()
+                                        ? std::optional<std::uint64_t>{}
+                                        : it->second));
+    }
+    for (const auto &[key, offset] : map) {
+      CHECK(skip_list.find(key) == offset);
+    }
+  }
+  SLBottomLevelRecordViewer bottom_viewer(&bottom);
+  std::size_t nodes = 0;
+  for (std::uint64_t node = bottom_viewer.get_head(); node != NULL_NODE;
+       ++nodes) {
+    SLLink link = bottom_viewer.get_link(node);
+    if (link.next != NULL_NODE) {
+      CHECK(link.next_prefix == key_prefix(bottom_viewer.get_key(link.next)));
+    }
+    node = link.next;
+  }
+  CHECK(nodes == map.size());
+  SLUpperLevelRecordViewer upper_viewer(&upper, &heads);
+  REQUIRE(upper_viewer.get_levels() != 0);
+  for (std::size_t level = 0; level < upper_viewer.get_levels(); ++level) {
+    for (std::uint64_t node = upper_viewer.get_head(level); node != NULL_NODE;
+         node = upper_viewer.get_next(node)) {
+      SLLink link = upper_viewer.get_link(node);
+      if (link.next != NULL_NODE) {
+        CHECK(link.next_prefix == key_prefix(upper_viewer[link.next].key));
+      }
+    }
+  }
+}
+
+} // namespace
@@ -199,4 +199,27 @@ TEST_CASE("SST::change offset") {
   CHECK(sst.find_offset(rec.key) == 1);
 }
 
+
+TEST_CASE("SST with inline values") {
+  RAMByteArray ba1, ba2, ba3;
+  SSTRecordViewer view1(&ba1, NewSSTRV{}, 8), view2(&ba2, NewSSTRV{}, 8);
+  for (std::size_t i = 0; i < 10; ++i) {
+    SSTRecord rec;
+    rec.key = {std::byte(i)};
+    rec.offset = INLINE_OFFSET;
+    rec.value = InlineValue(ValueType(i % 9, std::byte(i)));
+    (i % 2 ? view1 : view2).append(rec);
+  }
+  CHECK(ba1.size() == 5 * (KEY_SIZE_BYTES + 8 + 9));
+  SST sst1(view1), sst2(view2);
+  SST sst = SST::merge_into_sst(sst1.begin(), sst1.end(), sst2.begin(),
+                                sst2.end(), {&ba3, NewSSTRV{}, 8});
+  CHECK(sst.size() == 10);
+  for (std::size_t i = 0; i < 10; ++i) {
+    auto entry = sst.find_entry({std::byte(i)});
+    CHECK(entry.offset == INLINE_OFFSET);
+    CHECK(entry.value.to_value() == ValueType(i % 9, std::byte(i)));
+  }
+}
+
 } // namespace
@@ -2,6 +2,7 @@
 #include "ByteArray.h"
 #include "MemoryManager.h"
 #include "doctest.h"
+#include <cstdint>
 #include <memory>
 
 using namespace kvaaas;
@@ -141,3 +142,76 @@ TEST_CASE("BloomFilter") {
   CHECK(filter.has_key(key1));
   CHECK(filter.has_key(key2));
 }
+
+TEST_CASE("ByteView") {
+  RAMByteArray ram_arr;
+  ByteArray &arr = ram_arr;
+  arr.append(bytes({0, 1, 2, 3, 4}));
+  {
+    ByteView view = arr.view(1, 4);
+    CHECK(view.size() == 3);
+    CHECK(std::vector<ByteType>(view.begin(), view.end()) == bytes({1, 2, 3}));
+    ByteView moved = std::move(view);
+    CHECK(moved[2] == ByteType{3});
+  }
+  arr.append(std::vector<ByteType>(1000, ByteType{7}));
+
+  // copying fallback, both inline and on the heap
+  ByteView small = arr.ByteArray::view(0, 5);
+  CHECK(std::vector<ByteType>(small.begin(), small.end()) ==
+        bytes({0, 1, 2, 3, 4}));
+  ByteView big = arr.ByteArray::view(5, 1005);
+  ByteView moved = std::move(big);
+  CHECK(moved.size() == 1000);
+  CHECK(std::vector<ByteType>(moved.begin(), moved.end()) ==
+        std::vector<ByteType>(1000, ByteType{7}));
+}
+
+TEST_CASE("RAMByteArray across chunks") {
+  RAMByteArray arr(16);
+  std::vector<ByteType> expected;
+  for (unsigned char i = 0; i < 100; ++i) {
+    auto piece = bytes({i, static_cast<unsigned char>(i + 1),
+                        static_cast<unsigned char>(i + 2)});
+    arr.append(piece);
+    expected.insert(expected.end(), piece.begin(), piece.end());
+  }
+  CHECK(arr.size() == expected.size());
+  CHECK(arr.read(0, expected.size()) == expected);
+  CHECK(arr.read(14, 35) ==
+        std::vector<ByteType>(expected.begin() + 14, expected.begin() + 35));
+
+  arr.rewrite(10, std::vector<ByteType>(40, ByteType{9}));
+  std::fill(expected.begin() + 10, expected.begin() + 50, ByteType{9});
+  CHECK(arr.read(0, expected.size()) == expected);
+
+  ByteView crossing = arr.view(12, 20);
+  CHECK(std::vector<ByteType>(crossing.begin(), crossing.end()) ==
+        std::vector<ByteType>(expected.begin() + 12, expected.begin() + 20));
+}
+
+TEST_CASE("RAMByteArray never moves stored bytes") {
+  RAMByteArray arr(1 << 10);
+  arr.append(bytes({1, 2, 3}));
+  ByteView view = arr.view(0, 3);
+  const ByteType *before = view.data();
+  arr.append(std::vector<ByteType>(1 << 20, ByteType{4}));
+  CHECK(arr.view(0, 3).data() == before);
+  CHECK(view[2] == ByteType{3});
+}
+
+TEST_CASE("RAMByteArray with huge pages") {
+  RAMMemoryManager manager(true);
+  ByteArrayPtr arr = manager.create_byte_array(MemoryPurpose::KVS);
+  arr->append(std::vector<ByteType>(5 << 20, ByteType{5}));
+  arr->append(bytes({6}));
+  CHECK(arr->size() == (5 << 20) + 1);
+  CHECK(arr->read((5 << 20) - 1, (5 << 20) + 1) == bytes({5, 6}));
+  // every chunk starts on a huge page
+  for (std::size_t at = 0; at < arr->size();
+       at += RAMByteArray::HUGE_PAGE_CHUNK_SIZE) {
+    ByteView view = arr->view(at, at + 1);
+    auto address = reinterpret_cast<std::uintptr_t>(view.data());
+    CHECK(address % RAMByteArray::HUGE_PAGE_CHUNK_SIZE == 0);
+  }
+}